@@ -0,0 +1,21 @@
+# LovyanGFX built for the development machine, to draw into sprites in memory. Its Linux framebuffer
+# platform provides what sprites need from the system; no panel is ever opened. Used by the glyph
+# atlas builder and the host view tests.
+set(LOVYANGFX_DIR ${CMAKE_CURRENT_LIST_DIR}/../components/LovyanGFX)
+
+if(NOT TARGET lovyangfx_host)
+    file(GLOB lovyangfx_host_sources CONFIGURE_DEPENDS
+         ${LOVYANGFX_DIR}/src/lgfx/Fonts/efont/*.c
+         ${LOVYANGFX_DIR}/src/lgfx/Fonts/IPA/*.c
+         ${LOVYANGFX_DIR}/src/lgfx/utility/*.c
+         ${LOVYANGFX_DIR}/src/lgfx/v1/*.cpp
+         ${LOVYANGFX_DIR}/src/lgfx/v1/misc/*.cpp
+         ${LOVYANGFX_DIR}/src/lgfx/v1/panel/Panel_Device.cpp
+         ${LOVYANGFX_DIR}/src/lgfx/v1/panel/Panel_FrameBufferBase.cpp
+         ${LOVYANGFX_DIR}/src/lgfx/v1/platforms/framebuffer/*.cpp)
+    find_package(Threads REQUIRED)
+    add_library(lovyangfx_host STATIC ${lovyangfx_host_sources})
+    target_include_directories(lovyangfx_host PUBLIC ${LOVYANGFX_DIR}/src)
+    target_compile_definitions(lovyangfx_host PUBLIC LGFX_USE_V1 LGFX_LINUX_FB)
+    target_link_libraries(lovyangfx_host PUBLIC Threads::Threads)
+endif()
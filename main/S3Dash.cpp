@@ -1,418 +1,1158 @@
-#include <stdio.h>
-#include <string.h>
-#include <atomic>
-#include "ble.h"
-#include "esp_err.h"
-#include "esp_log.h"
-#include "sdkconfig.h"
-#include "driver/gpio.h"
-#include "driver/ledc.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/queue.h"
-#include "freertos/semphr.h"
-#include "esp_chip_info.h"
-#include "esp_flash.h"
-#include "esp_lcd_types.h"
-#include "esp_lcd_panel_io.h"
-#include "esp_lcd_panel_vendor.h"
-#include "esp_lcd_panel_ops.h"
-#include "esp_timer.h"
-#include "esp_pm.h"
-#include "driver/gpio_filter.h"
-
-#define LGFX_USE_V1
-#include <LovyanGFX.h>
-
-#include "color.h"
-#include "dash_data.h"
-#include "lcd.h"
-#include "sprite.h"
-#include "views/ConnectingView.h"
-#include "views/DashMountedView.h"
-#include "views/DisplayModeView.h"
-#include "views/SteeringWheelMountedView.h"
-
-LGFX lcd;
-Sprite sprite;
-
-#define LEDC_TIMER              LEDC_TIMER_0
-#define LEDC_MODE               LEDC_LOW_SPEED_MODE
-#define LEDC_OUTPUT_IO          (38) // Define the output GPIO
-#define LEDC_CHANNEL            LEDC_CHANNEL_0
-#define LEDC_DUTY_RES           LEDC_TIMER_13_BIT // Set duty resolution to 13 bits
-#define LEDC_DUTY               (4095) // Set duty to 50%. ((2 ** 13) - 1) * 50% = 4095
-#define LEDC_FREQUENCY          (5000) // Frequency in Hertz. Set frequency at 5 kHz
-
-#define EXAMPLE_LCD_PIXEL_CLOCK_HZ (2 * 1000 * 1000)
-#define EXAMPLE_LCD_BK_LIGHT_ON_LEVEL 1
-#define EXAMPLE_LCD_BK_LIGHT_OFF_LEVEL !EXAMPLE_LCD_BK_LIGHT_ON_LEVEL
-
-#define EXAMPLE_PIN_NUM_DATA0 39    // 6
-#define EXAMPLE_PIN_NUM_DATA1 40    // 7
-#define EXAMPLE_PIN_NUM_DATA2 41    // 8
-#define EXAMPLE_PIN_NUM_DATA3 42    // 9
-#define EXAMPLE_PIN_NUM_DATA4 45    // 10
-#define EXAMPLE_PIN_NUM_DATA5 46    // 11
-#define EXAMPLE_PIN_NUM_DATA6 47    // 12
-#define EXAMPLE_PIN_NUM_DATA7 48    // 13
-#define EXAMPLE_PIN_NUM_PCLK 8      // 5
-#define EXAMPLE_PIN_NUM_CS 6        // 3
-#define EXAMPLE_PIN_NUM_DC 7        // 4
-#define EXAMPLE_PIN_NUM_RST 5       // 2
-#define EXAMPLE_PIN_NUM_BK_LIGHT 38 // 1
-#define EXAMPLE_PIN_NUM_POWER 15
-
-#define EXAMPLE_LCD_CMD_BITS 8
-#define EXAMPLE_LCD_PARAM_BITS 8
-
-#define EXAMPLE_PSRAM_DATA_ALIGNMENT 32
-
-#define PIN_LCD_RD 9
-
-#define CPU_CORE_0 0
-#define CPU_CORE_1 1
-
-dash_data_atomic_t dash_data_share;
-
-std::atomic<bool> is_connected = false;
-std::atomic<bool> invert_color;
-
-void vTask_LCD(void *pvParameters);
-void vTask_DataInput(void *pvParameters);
-void vTask_DataMock(void *pvParameter);
-void notify_cb(uint8_t *data, size_t len);
-void gpio_interrupt_handler(void *args);
-static void tick_timer_cb(void *arg);
-
-enum DataSource { BLE, MOCK };
-DataSource dataSource(BLE);
-
-typedef struct {
-    uint16_t displayMode;
-    uint16_t oilpressureMode;
-} NvsDisplayMode;
-
-std::atomic<uint32_t> atomic_display_mode = 0;
-std::atomic<bool> nvs_mode_changed = false;
-
-uint16_t framebuffer[LCD_V_RES][LCD_H_RES];
-
-nvs_handle_t display_mode_nvs_handle;
-void set_nvs_display_mode(NvsDisplayMode mode)
-{
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &display_mode_nvs_handle);
-    if (err) 
-    { 
-        ESP_LOGE("DISPLAY MODE", "error opening nvs handle for display mode, %s", esp_err_to_name(err)); 
-    }
-    err = nvs_set_u32(display_mode_nvs_handle, "display_mode", *reinterpret_cast<uint32_t*>(&mode));
-    if (err) 
-    { 
-        ESP_LOGE("DISPLAY MODE", "nvs set operation failed %s", esp_err_to_name(err)); 
-    }
-    err = nvs_commit(display_mode_nvs_handle);
-    if (err) 
-    { 
-        ESP_LOGE("DISPLAY MODE", "nvs commit failed %s", esp_err_to_name(err)); 
-    }
-    nvs_close(display_mode_nvs_handle);
-    ESP_LOGI("NVS", "DisplayMode commited to NVS memory");
-}
-
-void print_mcu_info()
-{
-    /* Print chip information */
-    esp_chip_info_t chip_info;
-    esp_chip_info(&chip_info);
-    printf("This is %s chip with %d CPU core(s), WiFi%s%s, ",
-           CONFIG_IDF_TARGET,
-           chip_info.cores,
-           (chip_info.features & CHIP_FEATURE_BT) ? "/BT" : "",
-           (chip_info.features & CHIP_FEATURE_BLE) ? "/BLE" : "");
-
-    printf("silicon revision %" PRIi16 ", ", chip_info.revision);
-
-    uint32_t size_flash_chip;
-    esp_flash_get_size(NULL, &size_flash_chip);
-    printf("%ldMB %s flash\n", size_flash_chip / (1024 * 1024),
-           (chip_info.features & CHIP_FEATURE_EMB_FLASH) ? "embedded" : "external");
-
-    printf("Minimum free heap size: %ld bytes\n", esp_get_minimum_free_heap_size());
-}
-
-void configureInputOnPin(gpio_num_t pin)
-{
-    gpio_config_t io_conf;
-    memset(&io_conf, 0, sizeof(gpio_config_t));
-    io_conf.intr_type = GPIO_INTR_POSEDGE;
-    io_conf.pin_bit_mask |= 1ULL << pin;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
-    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
-    ESP_ERROR_CHECK(gpio_config(&io_conf));
-    gpio_pin_glitch_filter_config_t glitch_filter = {
-        .clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT,
-        .gpio_num = pin,
-    };
-    gpio_glitch_filter_handle_t glitch_handle;
-    ESP_ERROR_CHECK(gpio_new_pin_glitch_filter(&glitch_filter, &glitch_handle));
-    ESP_ERROR_CHECK(gpio_glitch_filter_enable(glitch_handle));
-    ESP_ERROR_CHECK(gpio_isr_handler_add(pin, gpio_interrupt_handler, (void*) pin));
-}
-
-void restoreDisplayMode()
-{
-    NvsDisplayMode displayMode;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &display_mode_nvs_handle);
-    if (err) 
-    { 
-        ESP_LOGE("DISPLAY MODE", "Failed to open nvs handle for display mode, %s", esp_err_to_name(err)); 
-    }
-
-    uint32_t nvs_display_mode;
-    err = nvs_get_u32(display_mode_nvs_handle, "display_mode", &nvs_display_mode);
-    nvs_close(nvs_display_mode);
-    if (err == ESP_OK) {
-        displayMode = *reinterpret_cast<NvsDisplayMode*>(&nvs_display_mode);
-        if (displayMode.displayMode > STEERING_WHEEL_MOUNT || displayMode.oilpressureMode > OILP_1) {
-            ESP_LOGW("DISPLAY MODE", "Unknown display mode. Revert to default");
-            displayMode.displayMode = DASH_MOUNT;
-            displayMode.oilpressureMode = OILP_0;
-            set_nvs_display_mode(displayMode);
-        } else {
-            ESP_LOGI("DISPLAY MODE", "Display mode restored");
-        }
-    } else {
-        ESP_LOGI("DISPLAY MODE", "No persisted display mode. Persisting default mode.");
-        displayMode.displayMode = DASH_MOUNT;
-        displayMode.oilpressureMode = OILP_0;
-        set_nvs_display_mode(displayMode);
-    }
-    atomic_display_mode = *reinterpret_cast<uint32_t *>(&displayMode);
-}
-
-extern "C" void app_main(void)
-{
-    print_mcu_info();
-    esp_err_t err = gpio_install_isr_service(0);
-    if (err)
-    {
-        ESP_LOGE("MAIN", "Failed enable gpio isr service");
-    }
-    err = gpio_set_direction(GPIO_NUM_15, GPIO_MODE_OUTPUT);
-    if (err)
-    {
-        ESP_LOGE("MAIN", "Failed to set pin 15 to output");
-    }
-    err = gpio_set_level(GPIO_NUM_15, 1);
-    if (err)
-    {
-        ESP_LOGE("MAIN", "Failed to set pin 15 to 1");
-    }
-
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
-    {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
-
-    restoreDisplayMode();
-
-    configureInputOnPin(GPIO_NUM_0);
-    configureInputOnPin(GPIO_NUM_14);
-
-    lcd.init();
-    lcd.setRotation(0);
-    lcd.setColorDepth(16);
-    lcd.fillScreen(0);
-    lcd.setBrightness(255);
-    sprite.setBuffer(framebuffer, LCD_H_RES, LCD_V_RES, 16);
-    ESP_LOGI("S3Dash", "LCD Init complete");
-
-    switch (dataSource)
-    {
-    case BLE:
-        ble_init();
-        set_ble_notify_callback(notify_cb);
-        break;
-    case MOCK:
-        xTaskCreatePinnedToCore(vTask_DataMock, "dataTask", 1024*2, NULL, tskIDLE_PRIORITY, NULL, CPU_CORE_0);
-        break;
-    }
-    invert_color = false;
-    const esp_timer_create_args_t tick_timer_args = {
-        .callback = &tick_timer_cb,
-        .arg = NULL,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "tick_timer",
-        .skip_unhandled_events = false,
-    };
-
-    esp_timer_handle_t tick_timer = NULL;
-    ESP_ERROR_CHECK(esp_timer_create(&tick_timer_args, &tick_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(tick_timer, 100000));
-    xTaskCreatePinnedToCore(vTask_LCD, "lcdTask", 1024 * 16, NULL, 1, NULL, CPU_CORE_1);
-}
-
-dash_data_t dash_data;
-void vTask_LCD(void *pvParameters)
-{
-
-    while (3)
-    {
-        vTaskDelay(10/portTICK_PERIOD_MS);
-        DashData::dash_data_copy(dash_data_share, dash_data);        
-        DashData::clamp(&dash_data);
-        uint32_t displayModeRaw = atomic_display_mode;
-        NvsDisplayMode displayMode = *reinterpret_cast<NvsDisplayMode*>(&displayModeRaw);
-        sprite.startWrite();
-        if (!is_connected)
-        //if (false)
-        {
-            ConnectingView(&sprite).render();
-        }
-        else
-        {
-            switch (displayMode.displayMode) { 
-                case DASH_MOUNT:
-                {
-                    DashMountedView view(&sprite);
-                    view.setOilP(static_cast<OilPressureMode>(displayMode.oilpressureMode));
-                    view.setInvertColor(invert_color);
-                    view.render(&dash_data);
-                }
-                break;
-                case STEERING_WHEEL_MOUNT:
-                SteeringWheelMountedView(&sprite).render(&dash_data);
-                break;
-            }
-        }
-        if (nvs_mode_changed) {
-            nvs_mode_changed = false;
-            set_nvs_display_mode(displayMode);
-        }
-        // Function will block until all data are written.
-        sprite.pushSprite(&lcd, 0, 0);
-        sprite.endWrite();
-    }
-}
-
-void vTask_DataMock(void *pvParameter)
-{
-    vTaskDelay(300);
-    srand(100);
-    bool direction_up = true;
-    is_connected = true;
-    while (1)
-    {
-        /*
-        int r2 = rand();
-        int r3 = rand();
-        int r4 = rand();
-        int r5 = rand();
-        int r6 = rand();
-        xSemaphoreTake(dash_data_lock, portMAX_DELAY);
-
-        dash_data_share.rpm = (dash_data_share.rpm + (2000000 / (dash_data_share.rpm + 1)) - 160) % 7800;
-        dash_data_share.oil_pressure0 = dash_data_share.rpm * 0.01 + 10;
-        dash_data_share.oil_temp = r2 % 250;
-        dash_data_share.engine_coolant_temp = r3 % 250;
-        dash_data_share.throttle_per = r4 % 100;
-        dash_data_share.brake_per = r5 % 100;
-        dash_data_share.steering = r6 % 1800 - 900;
-
-        xSemaphoreGive(dash_data_lock);
-        */
-        dash_data_share.rpm = 4000;
-        if (direction_up) {
-            dash_data_share.oil_pressure0 += 1;
-            dash_data_share.oil_pressure1 += 1;
-        }
-        else {
-            dash_data_share.oil_pressure0 -= 1;
-            dash_data_share.oil_pressure1 -= 1;
-        }
-        if (dash_data_share.oil_pressure0 > 60)
-            direction_up = false;
-        if (dash_data_share.oil_pressure0 < 10)
-            direction_up = true;
-        vTaskDelay(80);
-    }
-}
-
-void IRAM_ATTR notify_cb(uint8_t *data, size_t len)
-{
-    if (len < 12)
-        return;
-    uint32_t can_id = *(uint32_t *)data;
-    uint8_t *payload = data + 4;
-
-    is_connected = true;
-    switch (can_id)
-    {
-    case 0x40:
-        dash_data_share.rpm = static_cast<uint16_t>(bitsToUIntLe(payload, 16, 14));
-        dash_data_share.throttle_per = ((int)*(payload + 4)) * 100 / 255;
-        break;
-    case 0x138:
-        dash_data_share.steering = *(int16_t *)(payload + 2) / 10;
-        break;
-    case 0x139:
-        dash_data_share.brake_per = ((int)*(payload + 5)) * 128 / 100;
-        break;
-    case 0x345:
-        dash_data_share.oil_temp = ((int)*(payload + 3)) - 40;
-        dash_data_share.oil_temp = dash_data_share.oil_temp * 9 / 5 + 32;
-        dash_data_share.engine_coolant_temp = ((int)*(payload + 4)) - 40;
-        dash_data_share.engine_coolant_temp = dash_data_share.engine_coolant_temp * 9 / 5 + 32;
-        break;
-    case 0x662:        
-        dash_data_share.oil_pressure0 = static_cast<uint16_t>(bitsToUIntLe(payload, 0, 16)) / 10;
-        dash_data_share.oil_pressure1 = static_cast<uint16_t>(bitsToUIntLe(payload, 16, 16)) / 10;
-        break;
-    }
-}
-
-void IRAM_ATTR gpio_interrupt_handler(void *args)
-{
-    uint32_t displayModeRaw = atomic_display_mode;
-    NvsDisplayMode displayMode = *reinterpret_cast<NvsDisplayMode*>(&displayModeRaw);
-    uint16_t pinNumber = (int)args;
-    {
-        if (pinNumber == GPIO_NUM_14)
-        {
-            displayMode.displayMode++;
-            if (displayMode.displayMode > STEERING_WHEEL_MOUNT)
-                displayMode.displayMode = DASH_MOUNT;
-        }
-
-        if (pinNumber == GPIO_NUM_0)
-        {
-            displayMode.oilpressureMode++;
-            if (displayMode.oilpressureMode > OILP_1)
-                displayMode.oilpressureMode = OILP_0;
-        }
-    }
-    atomic_display_mode = *reinterpret_cast<uint32_t *>(&displayMode);
-    nvs_mode_changed = true;
-}
-
-static void tick_timer_cb(void *arg)
-{
-    uint32_t displayModeRaw = atomic_display_mode;
-    NvsDisplayMode displayMode = *reinterpret_cast<NvsDisplayMode*>(&displayModeRaw);
-    if (dash_data_share.rpm >=3500) {
-        if (displayMode.oilpressureMode == OILP_0 && dash_data_share.oil_pressure0 <35) {
-            invert_color = !invert_color;
-            return;
-        }
-        if (displayMode.oilpressureMode == OILP_1 && dash_data_share.oil_pressure1 <35) {
-            invert_color = !invert_color;
-            return;
-        }
-    }
-    invert_color = false;
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "ble.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_chip_info.h"
+#include "esp_flash.h"
+#include "esp_lcd_types.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_vendor.h"
+#include "esp_lcd_panel_ops.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+#include "esp_heap_caps.h"
+#include "esp_cpu.h"
+#include "driver/gpio_filter.h"
+
+#define LGFX_USE_V1
+#include <LovyanGFX.h>
+
+#include "alloc_tracker.h"
+#include "arrival_histogram.h"
+#include "can_dbc.h"
+#include "can_signals.h"
+#include "color.h"
+#include "dash_data.h"
+#include "display_list.h"
+#include "frame_profiler.h"
+#include "glyph_atlas.h"
+#include "glyph_atlas_store.h"
+#include "layout.h"
+#include "lcd.h"
+#include "pixel_kernels.h"
+#include "region_scheduler.h"
+#include "spsc_ring.h"
+#include "sprite.h"
+#include "view_renderer.h"
+#include "views/DashMountedView.h"
+
+LGFX lcd;
+Sprite sprite;
+// Rasterizes part of each frame on core 0, into the framebuffer of sprite.
+Sprite helper_sprite;
+RegionScheduler regionScheduler;
+GlyphAtlas glyphAtlases[GLYPH_ATLAS_COUNT];
+DisplayList displayLists[3];
+
+#define LEDC_TIMER              LEDC_TIMER_0
+#define LEDC_MODE               LEDC_LOW_SPEED_MODE
+#define LEDC_OUTPUT_IO          (38) // Define the output GPIO
+#define LEDC_CHANNEL            LEDC_CHANNEL_0
+#define LEDC_DUTY_RES           LEDC_TIMER_13_BIT // Set duty resolution to 13 bits
+#define LEDC_DUTY               (4095) // Set duty to 50%. ((2 ** 13) - 1) * 50% = 4095
+#define LEDC_FREQUENCY          (5000) // Frequency in Hertz. Set frequency at 5 kHz
+
+#define EXAMPLE_LCD_PIXEL_CLOCK_HZ (2 * 1000 * 1000)
+#define EXAMPLE_LCD_BK_LIGHT_ON_LEVEL 1
+#define EXAMPLE_LCD_BK_LIGHT_OFF_LEVEL !EXAMPLE_LCD_BK_LIGHT_ON_LEVEL
+
+#define EXAMPLE_PIN_NUM_DATA0 39    // 6
+#define EXAMPLE_PIN_NUM_DATA1 40    // 7
+#define EXAMPLE_PIN_NUM_DATA2 41    // 8
+#define EXAMPLE_PIN_NUM_DATA3 42    // 9
+#define EXAMPLE_PIN_NUM_DATA4 45    // 10
+#define EXAMPLE_PIN_NUM_DATA5 46    // 11
+#define EXAMPLE_PIN_NUM_DATA6 47    // 12
+#define EXAMPLE_PIN_NUM_DATA7 48    // 13
+#define EXAMPLE_PIN_NUM_PCLK 8      // 5
+#define EXAMPLE_PIN_NUM_CS 6        // 3
+#define EXAMPLE_PIN_NUM_DC 7        // 4
+#define EXAMPLE_PIN_NUM_RST 5       // 2
+#define EXAMPLE_PIN_NUM_BK_LIGHT 38 // 1
+#define EXAMPLE_PIN_NUM_POWER 15
+
+#define EXAMPLE_LCD_CMD_BITS 8
+#define EXAMPLE_LCD_PARAM_BITS 8
+
+#define EXAMPLE_PSRAM_DATA_ALIGNMENT 32
+
+#define PIN_LCD_RD 9
+
+#define CPU_CORE_0 0
+#define CPU_CORE_1 1
+
+// Frames between two dumps of the frame profile and render stats to the console.
+#define LCD_STATS_INTERVAL_FRAMES 1000
+
+#define LCD_RENDER_FULL_FRAME 0
+#define LCD_RENDER_BANDS 1
+// Full frame keeps the whole frame in RAM and renders each view once per frame. Bands only keep two
+// buffers of LCD_BAND_HEIGHT rows and render each view once per band, clipped to the band.
+#define LCD_RENDER_MODE LCD_RENDER_FULL_FRAME
+#define LCD_BAND_HEIGHT (DAMAGE_TILE_H * 2)
+// 16 renders RGB565. 8 renders RGB332, halving framebuffer memory, and expands it back to RGB565 through
+// a color LUT when pushing; the colors from color.h are reproduced exactly. The bus carries RGB565
+// either way, so 8 saves memory, not bus bytes. It also lets the oil pressure alarm blink through the
+// LUT instead of redrawing.
+#define LCD_COLOR_DEPTH 16
+// Render into a second framebuffer while the previous frame is streamed to the panel over DMA.
+// Only applies to full frame rendering; bands are always double buffered when memory allows.
+#define LCD_DOUBLE_BUFFER 1
+// Upper bound on the time between two renders when no new data arrives.
+#define LCD_IDLE_REFRESH_MS 500
+// Split full frame rendering between both cores: a helper task on core 0 rasterizes the rows from
+// LCD_SPLIT_Y down while the LCD task rasterizes the rows above. Either this or LCD_RETAINED_MODE,
+// see there.
+#define LCD_DUAL_CORE_RENDER 0
+#define LCD_SPLIT_Y (LCD_V_RES / 2)
+// Render on core 1 only while BLE notifications arrived this recently, so the helper does not
+// compete with Bluedroid for core 0.
+#define LCD_HELPER_BT_BACKOFF_US 2000
+// Cache the static parts of the current view in a full frame background image, in PSRAM if available.
+#define LCD_BACKGROUND_CACHE 1
+// Record the draw calls of each frame and only redraw the ones that changed. Only applies to full
+// frame rendering. Retained mode and LCD_DUAL_CORE_RENDER are a choice of one: the split only covers
+// immediate mode, which retained mode falls back to for frames too large to record, so with both the
+// helper would idle on core 0 for all other frames. Retained mode keeps core 0 free for Bluedroid and
+// the CAN decoder and does the least work when little changes between frames; the split shares
+// frames that change everywhere, e.g. after switching views, between both cores.
+#define LCD_RETAINED_MODE 1
+#if LCD_RETAINED_MODE && LCD_DUAL_CORE_RENDER
+#error "Choose either LCD_RETAINED_MODE or LCD_DUAL_CORE_RENDER"
+#endif
+// Pre-render the font and size combinations of the views into glyph atlases at startup.
+#define LCD_GLYPH_ATLASES 1
+// Log the cycles per pixel of the fill kernels and the cycles per call of the number renderers at
+// startup.
+#define LCD_BENCHMARK_PIXEL_KERNELS 0
+#define LCD_BENCHMARK_ITERATIONS 100
+// Check every view at startup over a sweep of dash data: frames rendered with glyph atlases, the
+// background cache and retained mode must match the same frames drawn through plain LovyanGFX. Logs
+// render cycles, pixels changed per step and a hash of the frames to compare across firmware versions.
+#define LCD_VERIFY_VIEWS 0
+#define LCD_VERIFY_STEPS 32
+// Decode notifications through the functions generated from s3dash.dbc at build time instead of the
+// signal table, unless a signal table was stored in NVS.
+#define CAN_DECODE_GENERATED 1
+// Log the time the signal table and the generated functions take to decode a notification at startup.
+#define CAN_BENCHMARK_DECODE 0
+#define CAN_BENCHMARK_ITERATIONS 10000
+// Frames queued between the BLE callback and the decoder task, and decoded per batch.
+#define CAN_RING_FRAMES 128
+#define CAN_DECODE_BATCH 16
+// The CAN bridge may pack several frames back to back into one notification.
+#define CAN_MAX_FRAMES_PER_NOTIFICATION (BLE_NOTIFY_MAX_BYTES / CAN_FRAME_BYTES)
+// Keep histograms of the time between frames of each CAN message, logged every stats interval.
+#define CAN_ARRIVAL_HISTOGRAMS 1
+// Show the connecting view again when the CAN bridge sent nothing for this long.
+#define DASH_LINK_TIMEOUT_MS 1000
+
+dash_data_atomic_t dash_data_share;
+// Decodes notifications into dash_data_share. Loaded once at boot, read only afterwards.
+CanSignalTable can_signal_table;
+// Whether the decoder task decodes through CanDbc, set once at boot.
+bool can_decode_generated = false;
+typedef struct {
+    can_frame_t frame;
+    // Low 32 bits of esp_timer_get_time when the notification carrying it arrived.
+    uint32_t receivedUs;
+} received_frame_t;
+
+// Raw frames from notify_cb, on the Bluedroid task, to the decoder task.
+SpscRing<received_frame_t, CAN_RING_FRAMES> can_frame_ring;
+TaskHandle_t can_decoder_task_handle = NULL;
+// Recorded by the decoder task.
+ArrivalHistograms arrival_histograms;
+// Notifications by the number of frames they carried, and notifications with trailing bytes short of
+// a frame, which are ignored. Only written by notify_cb.
+std::atomic<uint32_t> notify_frame_counts[CAN_MAX_FRAMES_PER_NOTIFICATION + 1];
+std::atomic<uint32_t> notify_partial_count = 0;
+
+std::atomic<bool> is_connected = false;
+// Blink phase of the oil pressure alarm, toggled by tick_timer_cb while oil_pressure_alarm is set.
+std::atomic<bool> invert_color;
+// Set by the LCD task from its dash data snapshot. The timer only reads this flag: a snapshot taken
+// on core 0 above the priority of the decoder could spin forever on an update it preempted.
+std::atomic<bool> oil_pressure_alarm = false;
+
+TaskHandle_t lcd_task_handle = NULL;
+TaskHandle_t render_helper_task_handle = NULL;
+SemaphoreHandle_t render_helper_start = NULL;
+SemaphoreHandle_t render_helper_done = NULL;
+std::atomic<int64_t> last_notify_us = 0;
+FrameProfiler frame_profiler;
+// Rendering a frame and decoding a notification must not allocate once running.
+AllocGuard lcd_alloc_guard("vTask_LCD");
+AllocGuard notify_alloc_guard("notify_cb");
+AllocGuard decoder_alloc_guard("vTask_CanDecoder");
+// Profile of the frames up to the last stats interval, see get_frame_profile.
+frame_profile_t frame_profile = {};
+SemaphoreHandle_t frame_profile_lock = NULL;
+
+void build_glyph_atlases();
+void benchmark_pixel_kernels();
+void verify_views();
+void benchmark_can_decode();
+void vTask_LCD(void *pvParameters);
+bool get_frame_profile(frame_profile_t *out);
+void vTask_RenderHelper(void *pvParameters);
+void vTask_DataInput(void *pvParameters);
+void vTask_CanDecoder(void *pvParameters);
+void get_can_ring_stats(spsc_ring_stats_t *out);
+void log_notify_stats();
+void disconnect_cb();
+void vTask_DataMock(void *pvParameter);
+void notify_cb(uint8_t *data, size_t len);
+void gpio_interrupt_handler(void *args);
+static void tick_timer_cb(void *arg);
+bool is_oil_pressure_alarm(const dash_data_t &data, NvsDisplayMode displayMode, bool connected);
+
+enum DataSource { BLE, MOCK };
+DataSource dataSource(BLE);
+
+std::atomic<uint32_t> atomic_display_mode = 0;
+// Custom view layout from the layout partition. Loaded once at boot, read only afterwards.
+Layout layout;
+std::atomic<bool> nvs_mode_changed = false;
+// Set when the cached view background no longer matches the display mode.
+std::atomic<bool> background_stale = false;
+
+#if LCD_RENDER_MODE == LCD_RENDER_FULL_FRAME
+alignas(16) uint8_t framebuffer[LCD_V_RES][LCD_H_RES * LCD_COLOR_DEPTH / 8];
+#endif
+
+nvs_handle_t display_mode_nvs_handle;
+void set_nvs_display_mode(NvsDisplayMode mode)
+{
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &display_mode_nvs_handle);
+    if (err) 
+    { 
+        ESP_LOGE("DISPLAY MODE", "error opening nvs handle for display mode, %s", esp_err_to_name(err)); 
+    }
+    err = nvs_set_u32(display_mode_nvs_handle, "display_mode", *reinterpret_cast<uint32_t*>(&mode));
+    if (err) 
+    { 
+        ESP_LOGE("DISPLAY MODE", "nvs set operation failed %s", esp_err_to_name(err)); 
+    }
+    err = nvs_commit(display_mode_nvs_handle);
+    if (err) 
+    { 
+        ESP_LOGE("DISPLAY MODE", "nvs commit failed %s", esp_err_to_name(err)); 
+    }
+    nvs_close(display_mode_nvs_handle);
+    ESP_LOGI("NVS", "DisplayMode commited to NVS memory");
+}
+
+void print_mcu_info()
+{
+    /* Print chip information */
+    esp_chip_info_t chip_info;
+    esp_chip_info(&chip_info);
+    printf("This is %s chip with %d CPU core(s), WiFi%s%s, ",
+           CONFIG_IDF_TARGET,
+           chip_info.cores,
+           (chip_info.features & CHIP_FEATURE_BT) ? "/BT" : "",
+           (chip_info.features & CHIP_FEATURE_BLE) ? "/BLE" : "");
+
+    printf("silicon revision %" PRIi16 ", ", chip_info.revision);
+
+    uint32_t size_flash_chip;
+    esp_flash_get_size(NULL, &size_flash_chip);
+    printf("%ldMB %s flash\n", size_flash_chip / (1024 * 1024),
+           (chip_info.features & CHIP_FEATURE_EMB_FLASH) ? "embedded" : "external");
+
+    printf("Minimum free heap size: %ld bytes\n", esp_get_minimum_free_heap_size());
+}
+
+void configureInputOnPin(gpio_num_t pin)
+{
+    gpio_config_t io_conf;
+    memset(&io_conf, 0, sizeof(gpio_config_t));
+    io_conf.intr_type = GPIO_INTR_POSEDGE;
+    io_conf.pin_bit_mask |= 1ULL << pin;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    io_conf.pull_up_en = GPIO_PULLUP_DISABLE;
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+    gpio_pin_glitch_filter_config_t glitch_filter = {
+        .clk_src = GLITCH_FILTER_CLK_SRC_DEFAULT,
+        .gpio_num = pin,
+    };
+    gpio_glitch_filter_handle_t glitch_handle;
+    ESP_ERROR_CHECK(gpio_new_pin_glitch_filter(&glitch_filter, &glitch_handle));
+    ESP_ERROR_CHECK(gpio_glitch_filter_enable(glitch_handle));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(pin, gpio_interrupt_handler, (void*) pin));
+}
+
+/**
+ * The last display mode the mode button cycles through, the custom layout if one is loaded.
+ */
+static inline uint16_t last_display_mode()
+{
+    return layout.isLoaded() ? CUSTOM_LAYOUT : STEERING_WHEEL_MOUNT;
+}
+
+void restoreDisplayMode()
+{
+    NvsDisplayMode displayMode;
+    esp_err_t err = nvs_open("storage", NVS_READWRITE, &display_mode_nvs_handle);
+    if (err) 
+    { 
+        ESP_LOGE("DISPLAY MODE", "Failed to open nvs handle for display mode, %s", esp_err_to_name(err)); 
+    }
+
+    uint32_t nvs_display_mode;
+    err = nvs_get_u32(display_mode_nvs_handle, "display_mode", &nvs_display_mode);
+    nvs_close(nvs_display_mode);
+    if (err == ESP_OK) {
+        displayMode = *reinterpret_cast<NvsDisplayMode*>(&nvs_display_mode);
+        if (displayMode.displayMode > last_display_mode() || displayMode.oilpressureMode > OILP_1) {
+            ESP_LOGW("DISPLAY MODE", "Unknown display mode. Revert to default");
+            displayMode.displayMode = DASH_MOUNT;
+            displayMode.oilpressureMode = OILP_0;
+            set_nvs_display_mode(displayMode);
+        } else {
+            ESP_LOGI("DISPLAY MODE", "Display mode restored");
+        }
+    } else {
+        ESP_LOGI("DISPLAY MODE", "No persisted display mode. Persisting default mode.");
+        displayMode.displayMode = DASH_MOUNT;
+        displayMode.oilpressureMode = OILP_0;
+        set_nvs_display_mode(displayMode);
+    }
+    atomic_display_mode = *reinterpret_cast<uint32_t *>(&displayMode);
+}
+
+extern "C" void app_main(void)
+{
+    print_mcu_info();
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err)
+    {
+        ESP_LOGE("MAIN", "Failed enable gpio isr service");
+    }
+    err = gpio_set_direction(GPIO_NUM_15, GPIO_MODE_OUTPUT);
+    if (err)
+    {
+        ESP_LOGE("MAIN", "Failed to set pin 15 to output");
+    }
+    err = gpio_set_level(GPIO_NUM_15, 1);
+    if (err)
+    {
+        ESP_LOGE("MAIN", "Failed to set pin 15 to 1");
+    }
+
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
+    }
+    ESP_ERROR_CHECK(ret);
+
+    layout.load();
+    bool custom_signals = can_signal_table.load(&dash_data_share);
+    can_decode_generated = CAN_DECODE_GENERATED && !custom_signals;
+    restoreDisplayMode();
+
+    configureInputOnPin(GPIO_NUM_0);
+    configureInputOnPin(GPIO_NUM_14);
+
+    lcd.init();
+    lcd.setRotation(0);
+    lcd.setColorDepth(16);
+    lcd.fillScreen(0);
+    lcd.setBrightness(255);
+#if LCD_RENDER_MODE == LCD_RENDER_FULL_FRAME
+    void *second_framebuffer = NULL;
+#if LCD_DOUBLE_BUFFER
+    second_framebuffer = heap_caps_aligned_alloc(16, sizeof(framebuffer), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!second_framebuffer)
+    {
+        ESP_LOGW("S3Dash", "Not enough DMA capable memory for a second framebuffer, rendering single buffered");
+    }
+#endif
+    sprite.setFrameBuffers(framebuffer, second_framebuffer, LCD_COLOR_DEPTH);
+#else
+    const size_t band_bytes = LCD_BAND_HEIGHT * LCD_H_RES * LCD_COLOR_DEPTH / 8;
+    void *first_band = heap_caps_aligned_alloc(16, band_bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    void *second_band = heap_caps_aligned_alloc(16, band_bytes, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!first_band)
+    {
+        ESP_LOGE("S3Dash", "Failed to allocate band buffer");
+        return;
+    }
+    if (!second_band)
+    {
+        ESP_LOGW("S3Dash", "Not enough DMA capable memory for a second band buffer, rendering single buffered");
+    }
+    sprite.setBandBuffers(first_band, second_band, LCD_BAND_HEIGHT, LCD_COLOR_DEPTH);
+#endif
+    ESP_LOGI("S3Dash", "Framebuffer memory %d bytes", sprite.getFrameBufferBytes());
+#if LCD_GLYPH_ATLASES
+    build_glyph_atlases();
+#endif
+#if LCD_RETAINED_MODE
+    sprite.setDisplayLists(displayLists);
+#endif
+#if LCD_BACKGROUND_CACHE
+    const size_t background_bytes = LCD_V_RES * LCD_H_RES * LCD_COLOR_DEPTH / 8;
+    // 16 byte aligned like the framebuffers, so copying the background uses the vector kernel.
+    void *background = heap_caps_aligned_alloc(16, background_bytes, MALLOC_CAP_SPIRAM);
+    if (!background)
+        background = heap_caps_aligned_alloc(16, background_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (background)
+        sprite.setBackgroundBuffer(background);
+    else
+        ESP_LOGW("S3Dash", "Not enough memory for a background cache, drawing view backgrounds every frame");
+#endif
+    ESP_LOGI("S3Dash", "LCD Init complete");
+#if LCD_BENCHMARK_PIXEL_KERNELS && LCD_RENDER_MODE == LCD_RENDER_FULL_FRAME
+    benchmark_pixel_kernels();
+#endif
+#if LCD_VERIFY_VIEWS && LCD_RENDER_MODE == LCD_RENDER_FULL_FRAME
+    verify_views();
+#endif
+#if CAN_BENCHMARK_DECODE
+    benchmark_can_decode();
+#endif
+
+    switch (dataSource)
+    {
+    case BLE:
+        // Above the LCD and render helper tasks so frames are decoded as they come, below Bluedroid.
+        xTaskCreatePinnedToCore(vTask_CanDecoder, "canDecoderTask", 1024 * 4, NULL, 2, &can_decoder_task_handle, CPU_CORE_0);
+        set_ble_can_signals(&can_signal_table);
+        ble_init();
+        set_ble_notify_callback(notify_cb);
+        set_ble_disconnect_callback(disconnect_cb);
+        break;
+    case MOCK:
+        // Like the decoder task, so nothing that preempts it mid update waits for the update.
+        xTaskCreatePinnedToCore(vTask_DataMock, "dataTask", 1024*2, NULL, 2, NULL, CPU_CORE_0);
+        break;
+    }
+    invert_color = false;
+    const esp_timer_create_args_t tick_timer_args = {
+        .callback = &tick_timer_cb,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "tick_timer",
+        .skip_unhandled_events = false,
+    };
+
+    esp_timer_handle_t tick_timer = NULL;
+    ESP_ERROR_CHECK(esp_timer_create(&tick_timer_args, &tick_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(tick_timer, 100000));
+#if LCD_DUAL_CORE_RENDER
+    if (!sprite.isBanded())
+    {
+        render_helper_start = xSemaphoreCreateBinary();
+        render_helper_done = xSemaphoreCreateBinary();
+        // Same priority as the LCD task, below the Bluedroid tasks, which preempt it.
+        xTaskCreatePinnedToCore(vTask_RenderHelper, "renderHelperTask", 1024 * 16, NULL, 1, &render_helper_task_handle, CPU_CORE_0);
+    }
+#endif
+    frame_profile_lock = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(vTask_LCD, "lcdTask", 1024 * 16, NULL, 1, &lcd_task_handle, CPU_CORE_1);
+}
+
+/**
+ * Load the glyph atlases of every font and text size combination the views draw with, or rasterize
+ * them when the build did not flash them, and draw text from the atlases on both the LCD and the
+ * render helper sprite.
+ */
+void build_glyph_atlases()
+{
+    bool built = loadGlyphAtlases(glyphAtlases);
+    if (!built)
+    {
+        ESP_LOGI("S3Dash", "Rasterizing glyph atlases");
+        built = true;
+        for (int i = 0; built && i < GLYPH_ATLAS_COUNT; i++)
+            built = glyphAtlases[i].build(GLYPH_ATLAS_SPECS[i].font, GLYPH_ATLAS_SPECS[i].size, GLYPH_ATLAS_SPECS[i].charset);
+    }
+    if (!built)
+    {
+        ESP_LOGW("S3Dash", "Failed to build glyph atlases, drawing text through LovyanGFX");
+        return;
+    }
+    for (int i = 0; i < sizeof(glyphAtlases) / sizeof(glyphAtlases[0]); i++)
+    {
+        sprite.addGlyphAtlas(&glyphAtlases[i]);
+        helper_sprite.addGlyphAtlas(&glyphAtlases[i]);
+    }
+}
+
+#if LCD_BENCHMARK_PIXEL_KERNELS && LCD_RENDER_MODE == LCD_RENDER_FULL_FRAME
+/**
+ * Time fn and log the cycles it took per unit, e.g. per pixel filled.
+ */
+template<typename Fn>
+void benchmark_kernel(const char *name, int units, const char *unit, Fn fn)
+{
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < LCD_BENCHMARK_ITERATIONS; i++)
+        fn();
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+    ESP_LOGI("S3Dash", "%-24s %.3f cycles/%s", name, (double)cycles / LCD_BENCHMARK_ITERATIONS / units, unit);
+}
+
+/**
+ * Compare the fill and copy kernels against their scalar fallbacks and the fills against LovyanGFX,
+ * on a full screen and on a progress bar sized span, and the seven segment renderer against the
+ * text it replaced. Leaves the framebuffer dirty.
+ */
+void benchmark_pixel_kernels()
+{
+    uint8_t *buffer = &framebuffer[0][0];
+    uint16_t *pixels = reinterpret_cast<uint16_t *>(buffer);
+    const int screen = LCD_H_RES * LCD_V_RES;
+    const int bar = 220 * 24;
+#if LCD_COLOR_DEPTH == 16
+    benchmark_kernel("fill16 screen", screen, "pixel", [&]() { PixelKernels::fill16(pixels, 0x1234, screen); });
+    benchmark_kernel("fill16Scalar screen", screen, "pixel", [&]() { PixelKernels::fill16Scalar(pixels, 0x1234, screen); });
+    benchmark_kernel("fillRect16 bar", bar, "pixel", [&]() { PixelKernels::fillRect16(pixels, LCD_H_RES, 0, 144, 220, 24, 0x1234); });
+#else
+    benchmark_kernel("fill8 screen", screen, "pixel", [&]() { PixelKernels::fill8(buffer, 0x12, screen); });
+    benchmark_kernel("fill8Scalar screen", screen, "pixel", [&]() { PixelKernels::fill8Scalar(buffer, 0x12, screen); });
+    benchmark_kernel("fillRect8 bar", bar, "pixel", [&]() { PixelKernels::fillRect8(buffer, LCD_H_RES, 0, 144, 220, 24, 0x12); });
+#endif
+    const int bytes = sizeof(framebuffer) / 2;
+    benchmark_kernel("copy half screen", bytes, "byte", [&]() { PixelKernels::copy(buffer, buffer + bytes, bytes); });
+    benchmark_kernel("copyScalar half screen", bytes, "byte", [&]() { PixelKernels::copyScalar(buffer, buffer + bytes, bytes); });
+    benchmark_kernel("copySwap16 half screen", bytes / 2, "pixel", [&]() { PixelKernels::copySwap16(pixels, pixels + bytes / 2, bytes / 2); });
+    benchmark_kernel("LovyanGFX fillScreen", screen, "pixel", [&]() { sprite.LGFX_Sprite::fillScreen(Color::COLOR_BLUE); });
+    benchmark_kernel("LovyanGFX fillRect bar", bar, "pixel", [&]() { sprite.LGFX_Sprite::fillRect(0, 144, 220, 24, Color::COLOR_BLUE); });
+    benchmark_kernel("drawRightSegmentNumber", 1, "call", [&]() { sprite.drawRightSegmentNumber(188, 220, 23, 90, Color::COLOR_WHITE); });
+    sprite.setFont(&fonts::Font7);
+    sprite.setTextSize(2);
+    benchmark_kernel("drawRightNumber Font7 x2", 1, "call", [&]() { sprite.drawRightNumber(188, 220, 23); });
+    sprite.invalidate();
+}
+#endif
+
+/**
+ * Wake up the LCD task because something it renders may have changed. Not safe to call from an ISR.
+ */
+inline void wake_lcd_task()
+{
+    if (lcd_task_handle)
+        xTaskNotifyGive(lcd_task_handle);
+}
+
+dash_data_t dash_data;
+
+// Frame the render helper works on, only valid between giving render_helper_start and taking
+// render_helper_done.
+const render_state_t *render_helper_state = NULL;
+uint32_t render_helper_cycles = 0;
+
+#if LCD_VERIFY_VIEWS && LCD_RENDER_MODE == LCD_RENDER_FULL_FRAME
+/**
+ * Count the pixels that differ between two full frames.
+ */
+int count_changed_pixels(const uint8_t *a, const uint8_t *b)
+{
+    const int pixel_bytes = LCD_COLOR_DEPTH / 8;
+    int changed = 0;
+    for (int i = 0; i < LCD_H_RES * LCD_V_RES * pixel_bytes; i += pixel_bytes)
+        changed += memcmp(a + i, b + i, pixel_bytes) != 0;
+    return changed;
+}
+
+/**
+ * Render every view over a sweep of dash data twice: through the LCD sprite, the way the LCD task
+ * does, and through a plain sprite without glyph atlases, background cache or display lists, which
+ * draws everything through LovyanGFX. Both frames have to match. Leaves the framebuffer dirty.
+ */
+void verify_views()
+{
+    static Sprite reference;
+    const size_t frame_bytes = LCD_V_RES * LCD_H_RES * LCD_COLOR_DEPTH / 8;
+    // The reference frames of the current and the previous step.
+    uint8_t *reference_frames[2];
+    for (int i = 0; i < 2; i++)
+    {
+        reference_frames[i] = static_cast<uint8_t *>(heap_caps_malloc(frame_bytes, MALLOC_CAP_SPIRAM));
+        if (!reference_frames[i])
+            reference_frames[i] = static_cast<uint8_t *>(heap_caps_malloc(frame_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    }
+    if (!reference_frames[0] || !reference_frames[1])
+    {
+        ESP_LOGW("Verify", "Not enough memory for the reference frames, skipping view verification");
+        heap_caps_free(reference_frames[0]);
+        heap_caps_free(reference_frames[1]);
+        return;
+    }
+
+    int failures = 0;
+    for (const view_case_t &view : VIEW_CASES)
+    {
+        if (view.mode.displayMode == CUSTOM_LAYOUT && !layout.isLoaded())
+            continue;
+        render_state_t state = {};
+        state.displayModeRaw = *reinterpret_cast<const uint32_t *>(&view.mode);
+        state.connected = view.connected;
+        sprite.invalidateDisplayLists();
+        if (sprite.beginBackground())
+        {
+            render_view(&sprite, state, &layout, NULL, true);
+            sprite.endBackground();
+        }
+
+        uint64_t cycles = 0;
+        uint64_t reference_cycles = 0;
+        uint64_t changed_pixels = 0;
+        uint32_t hash = 2166136261u;
+        int mismatches = 0;
+        for (int step = 0; step < LCD_VERIFY_STEPS; step++)
+        {
+            sweep_dash_data(&state, step, LCD_VERIFY_STEPS);
+            uint32_t start = esp_cpu_get_cycle_count();
+            render_frame(&sprite, state, &layout);
+            cycles += esp_cpu_get_cycle_count() - start;
+
+            uint8_t *frame = reference_frames[step & 1];
+            reference.setFrameBuffers(frame, NULL, LCD_COLOR_DEPTH);
+            start = esp_cpu_get_cycle_count();
+            reference.startWrite();
+            render_view(&reference, state, &layout, NULL);
+            reference.endWrite();
+            reference_cycles += esp_cpu_get_cycle_count() - start;
+
+            if (step > 0)
+                changed_pixels += count_changed_pixels(frame, reference_frames[~step & 1]);
+            int different = count_changed_pixels(frame, static_cast<const uint8_t *>(sprite.getBuffer()));
+            if (different && mismatches++ < 3)
+                ESP_LOGE("Verify", "%s step %d: %d pixels differ from the reference", view.name, step, different);
+            for (size_t i = 0; i < frame_bytes; i++)
+                hash = (hash ^ frame[i]) * 16777619u;
+        }
+        ESP_LOGI("Verify", "%-14s %s, %llu cycles/frame, %llu cycles/frame reference, %llu pixels changed/step, hash %08lx",
+                 view.name, mismatches ? "FAILED" : "ok", cycles / LCD_VERIFY_STEPS, reference_cycles / LCD_VERIFY_STEPS,
+                 changed_pixels / (LCD_VERIFY_STEPS - 1), hash);
+        failures += mismatches;
+    }
+    if (failures)
+        ESP_LOGE("Verify", "%d frames differ from the reference", failures);
+    heap_caps_free(reference_frames[0]);
+    heap_caps_free(reference_frames[1]);
+    sprite.invalidate();
+    sprite.invalidateDisplayLists();
+    background_stale = true;
+}
+#endif
+
+/**
+ * Rasterize the rows from LCD_SPLIT_Y down of the frame handed over by the LCD task. Both tasks
+ * issue the same draw calls, each clipped to its own rows, so damage is tracked by the LCD task
+ * alone.
+ */
+void vTask_RenderHelper(void *pvParameters)
+{
+    while (3)
+    {
+        xSemaphoreTake(render_helper_start, portMAX_DELAY);
+        uint32_t start = FrameProfiler::now();
+        helper_sprite.shareBuffer(&sprite);
+        helper_sprite.setClipRect(0, LCD_SPLIT_Y, LCD_H_RES, LCD_V_RES - LCD_SPLIT_Y);
+        helper_sprite.startWrite();
+        render_view(&helper_sprite, *render_helper_state, &layout, NULL);
+        helper_sprite.endWrite();
+        render_helper_cycles = FrameProfiler::now() - start;
+        xSemaphoreGive(render_helper_done);
+    }
+}
+
+/**
+ * Whether the render helper should take part in the next frame. It backs off while Bluedroid is busy
+ * delivering notifications on core 0.
+ */
+bool render_helper_available()
+{
+    return render_helper_task_handle
+        && esp_timer_get_time() - last_notify_us > LCD_HELPER_BT_BACKOFF_US;
+}
+
+/**
+ * Show the colors views draw the oil pressure alarm in as the alarm or the normal colors. Only has
+ * an effect with 8 bit framebuffers, see Sprite::setThemeColor.
+ */
+void show_alarm_colors(bool alarm)
+{
+    sprite.setThemeColor(Color::COLOR_ALARM_BACKGROUND, alarm ? Color::COLOR_YELLOW : Color::COLOR_BLACK);
+    sprite.setThemeColor(Color::COLOR_ALARM_VALUE, alarm ? Color::COLOR_RED : Color::COLOR_WHITE);
+}
+
+void vTask_LCD(void *pvParameters)
+{
+    uint32_t frame_count = 0;
+    uint32_t split_frames = 0;
+    uint32_t retained_frames = 0;
+    render_state_t last_rendered;
+    bool has_rendered = false;
+    bool alarm_shown = false;
+
+    // Keep the bus transaction open so DMA transfers can run past the end of a frame.
+    if (sprite.isDoubleBuffered())
+        lcd.startWrite();
+
+    while (3)
+    {
+        // Sleep until new data, a button press or an alarm blink is signalled, or until held back
+        // regions are due.
+        TickType_t timeout = LCD_IDLE_REFRESH_MS / portTICK_PERIOD_MS;
+        if (sprite.hasDeferredDamage()) {
+            // Rounded up and at least a tick, so the task sleeps until the deadline instead of
+            // spinning through frames that are not due yet.
+            const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+            int64_t until_deadline_us = regionScheduler.nextDeadline() - esp_timer_get_time();
+            timeout = std::clamp<int64_t>((until_deadline_us + tick_us - 1) / tick_us, 1, timeout);
+        }
+        ulTaskNotifyTake(pdTRUE, timeout);
+        uint32_t frame_start = FrameProfiler::now();
+        DashData::dash_data_copy(dash_data_share, dash_data);        
+        DashData::clamp(&dash_data);
+        int64_t now_us = esp_timer_get_time();
+        // The mock data source does not stamp its signals and never times out.
+        dash_data.stale = DashData::staleSignals(dash_data_share, dataSource == BLE ? can_signal_table.getStaleAfterUs() : NULL, now_us);
+        if (dataSource == BLE && is_connected && now_us - last_notify_us > DASH_LINK_TIMEOUT_MS * 1000)
+        {
+            ESP_LOGW("LCD", "No CAN data for %d ms, showing the connecting view", DASH_LINK_TIMEOUT_MS);
+            is_connected = false;
+        }
+        uint32_t stage_start = frame_profiler.record(PROFILE_SNAPSHOT, frame_start);
+        uint32_t displayModeRaw = atomic_display_mode;
+        NvsDisplayMode displayMode = *reinterpret_cast<NvsDisplayMode*>(&displayModeRaw);
+        if (nvs_mode_changed) {
+            nvs_mode_changed = false;
+            set_nvs_display_mode(displayMode);
+            frame_profiler.record(PROFILE_NVS, stage_start);
+        }
+
+        lcd_alloc_guard.begin();
+        render_state_t state;
+        state.dash_data = dash_data;
+        state.displayModeRaw = displayModeRaw;
+        // The alarm stops as soon as a frame shows it is over, the timer only drives the blinking.
+        bool alarm = is_oil_pressure_alarm(dash_data, displayMode, is_connected);
+        oil_pressure_alarm = alarm;
+        state.invertColor = alarm && invert_color;
+        state.connected = is_connected;
+        // With theme colors the alarm blinks through the color LUT: the frame stays the same, only the
+        // tiles drawn in the alarm colors are pushed again.
+        bool theme_changed = false;
+        if (sprite.hasThemeColors())
+        {
+            theme_changed = state.invertColor != alarm_shown;
+            alarm_shown = state.invertColor;
+            if (theme_changed)
+                show_alarm_colors(alarm_shown);
+            state.invertColor = false;
+        }
+        if (has_rendered && render_state_equal(state, last_rendered) && !sprite.hasDeferredDamage() && !theme_changed)
+        {
+            lcd_alloc_guard.end();
+            continue;
+        }
+        bool layout_changed = !has_rendered 
+            || state.displayModeRaw != last_rendered.displayModeRaw 
+            || state.connected != last_rendered.connected;
+        if (layout_changed)
+            regionScheduler.reset(REGION_PERIOD_SLOW_US);
+        // Connecting changes the layout without a button press.
+        if ((background_stale.exchange(false) || layout_changed) && sprite.beginBackground())
+        {
+            render_view(&sprite, state, &layout, NULL, true);
+            sprite.endBackground();
+        }
+        last_rendered = state;
+        has_rendered = true;
+
+        // Full frame rendering is a single band covering the whole screen.
+        tile_mask_t due;
+        for (int band = 0; band < sprite.getBandCount(); band++)
+        {
+            sprite.beginBand(band);
+            sprite.startWrite();
+            RegionScheduler *scheduler = layout_changed && band == 0 ? &regionScheduler : NULL;
+            uint32_t render_start = FrameProfiler::now();
+            // Retained mode only redraws what changed since the frame last rendered into this buffer,
+            // and falls back to immediate mode when the frame can not be recorded.
+            bool retained = false;
+            if (sprite.beginRecording())
+            {
+                render_view(&sprite, state, &layout, scheduler);
+                retained = sprite.endRecording();
+                scheduler = NULL;
+            }
+            if (retained)
+            {
+                frame_profiler.record(PROFILE_RENDER, render_start);
+                retained_frames++;
+            }
+            else
+            {
+                // The helper only ever splits full frames, so it never overlaps with the band clip.
+                bool split = !sprite.isBanded() && render_helper_available();
+                if (split)
+                {
+                    render_helper_state = &state;
+                    xSemaphoreGive(render_helper_start);
+                    sprite.setClipRect(0, 0, LCD_H_RES, LCD_SPLIT_Y);
+                }
+                render_view(&sprite, state, &layout, scheduler);
+                if (split)
+                {
+                    sprite.clearClipRect();
+                    xSemaphoreTake(render_helper_done, portMAX_DELAY);
+                    frame_profiler.recordCycles(PROFILE_RENDER_HELPER, render_helper_cycles);
+                    split_frames++;
+                }
+                frame_profiler.record(PROFILE_RENDER, render_start);
+            }
+            if (band == 0)
+                due = regionScheduler.due(esp_timer_get_time());
+            // Blocks until all data are written, or double buffered, until the previous transfer is written.
+            uint32_t push_start = FrameProfiler::now();
+            sprite.pushDirty(&lcd, due);
+            sprite.endWrite();
+            frame_profiler.record(PROFILE_PUSH, push_start);
+        }
+        frame_profiler.record(PROFILE_FRAME, frame_start);
+        frame_profiler.endFrame(sprite.getLastPushBytes());
+        lcd_alloc_guard.end();
+
+        if (++frame_count % LCD_STATS_INTERVAL_FRAMES == 0) {
+            xSemaphoreTake(frame_profile_lock, portMAX_DELAY);
+            frame_profiler.summarize(&frame_profile);
+            FrameProfiler::log(frame_profile);
+            xSemaphoreGive(frame_profile_lock);
+            ESP_LOGI("LCD", "last frame pushed %lu bytes in %lu rects, %lu split frames, %lu retained frames",
+                     sprite.getLastPushBytes(), sprite.getLastPushRects(), split_frames, retained_frames);
+            split_frames = 0;
+            retained_frames = 0;
+            AllocTracker::log();
+            spsc_ring_stats_t ring;
+            get_can_ring_stats(&ring);
+            ESP_LOGI("LCD", "CAN ring: %lu frames, high water mark %lu of %lu, %lu overflows", ring.pushed,
+                     ring.highWaterMark, ring.capacity, ring.overflows);
+            log_notify_stats();
+#if CAN_ARRIVAL_HISTOGRAMS
+            arrival_histograms.log(can_signal_table);
+#endif
+            if (dataSource == BLE) {
+                ble_link_stats_t link;
+                get_ble_link_stats(&link);
+                ESP_LOGI("LCD", "BLE link %s: interval %lu us, latency %u, timeout %u ms, ladder step %u, "
+                         "PHY tx %u rx %u, PDUs tx %u rx %u bytes",
+                         link.connected ? "up" : "down", link.connInterval * 1250UL, link.latency,
+                         link.timeout * 10, link.connParamsStep, link.txPhy, link.rxPhy, link.txOctets,
+                         link.rxOctets);
+            }
+            ESP_LOGI("LCD", "Dash data snapshots retried %lu times", (uint32_t)dash_data_share.readRetries);
+        }
+    }
+}
+
+/**
+ * Copy the frame profile of the last stats interval into out, from any task.
+ *
+ * @return false if no interval completed yet.
+ */
+bool get_frame_profile(frame_profile_t *out)
+{
+    if (!frame_profile_lock)
+        return false;
+    xSemaphoreTake(frame_profile_lock, portMAX_DELAY);
+    *out = frame_profile;
+    xSemaphoreGive(frame_profile_lock);
+    return out->frames > 0;
+}
+
+void vTask_DataMock(void *pvParameter)
+{
+    vTaskDelay(300);
+    srand(100);
+    bool direction_up = true;
+    is_connected = true;
+    while (1)
+    {
+        /*
+        int r2 = rand();
+        int r3 = rand();
+        int r4 = rand();
+        int r5 = rand();
+        int r6 = rand();
+        xSemaphoreTake(dash_data_lock, portMAX_DELAY);
+
+        dash_data_share.rpm = (dash_data_share.rpm + (2000000 / (dash_data_share.rpm + 1)) - 160) % 7800;
+        dash_data_share.oil_pressure0 = dash_data_share.rpm * 0.01 + 10;
+        dash_data_share.oil_temp = r2 % 250;
+        dash_data_share.engine_coolant_temp = r3 % 250;
+        dash_data_share.throttle_per = r4 % 100;
+        dash_data_share.brake_per = r5 % 100;
+        dash_data_share.steering = r6 % 1800 - 900;
+
+        xSemaphoreGive(dash_data_lock);
+        */
+        DashData::beginWrite(dash_data_share);
+        dash_data_share.rpm = 4000;
+        if (direction_up) {
+            dash_data_share.oil_pressure0 += 1;
+            dash_data_share.oil_pressure1 += 1;
+        }
+        else {
+            dash_data_share.oil_pressure0 -= 1;
+            dash_data_share.oil_pressure1 -= 1;
+        }
+        if (dash_data_share.oil_pressure0 > 60)
+            direction_up = false;
+        if (dash_data_share.oil_pressure0 < 10)
+            direction_up = true;
+        DashData::endWrite(dash_data_share);
+        wake_lcd_task();
+        vTaskDelay(80);
+    }
+}
+
+/**
+ * Decode a CAN message from its 8 byte payload into dash_data_share, stamped with now_us.
+ *
+ * @return the index of the message in can_signal_table, or -1 if the table has no signal in it.
+ */
+inline int decode_can_message(uint32_t can_id, const uint8_t *payload, uint32_t now_us)
+{
+    // Only used with the built in table, which numbers the messages the same way.
+    if (can_decode_generated)
+        return CanDbc::decode(can_id, payload, now_us, &dash_data_share);
+    const can_message_t *message = can_signal_table.find(can_id);
+    if (!message)
+        return -1;
+    can_signal_table.decode(message, payload, now_us);
+    return can_signal_table.messageIndex(message);
+}
+
+#if CAN_BENCHMARK_DECODE
+/**
+ * Decode the same pseudo random payloads, spread over the messages of the signal table, through the
+ * table and through the generated functions. Logs the time per message of both and checks they
+ * decode the same values, which only holds for the built in table. Leaves dash_data_share zeroed.
+ */
+void benchmark_can_decode()
+{
+    const int message_count = can_signal_table.getMessageCount();
+    static uint8_t payloads[CAN_BENCHMARK_ITERATIONS][8];
+    uint32_t seed = 1;
+    for (int i = 0; i < CAN_BENCHMARK_ITERATIONS; i++)
+    {
+        for (int j = 0; j < 8; j++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            payloads[i][j] = seed >> 24;
+        }
+    }
+
+    int mismatches = 0;
+    for (int i = 0; i < CAN_BENCHMARK_ITERATIONS; i++)
+    {
+        const can_message_t &message = can_signal_table.getMessage(i % message_count);
+        dash_data_t table_data = {}, generated_data = {};
+        can_signal_table.decode(&message, payloads[i], 0);
+        DashData::dash_data_copy(dash_data_share, table_data);
+        CanDbc::decode(message.canId, payloads[i], 0, &dash_data_share);
+        DashData::dash_data_copy(dash_data_share, generated_data);
+        mismatches += memcmp(&table_data, &generated_data, sizeof(dash_data_t)) != 0;
+    }
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < CAN_BENCHMARK_ITERATIONS; i++)
+    {
+        const can_message_t *message = can_signal_table.find(can_signal_table.getMessage(i % message_count).canId);
+        can_signal_table.decode(message, payloads[i], 0);
+    }
+    uint32_t table_cycles = esp_cpu_get_cycle_count() - start;
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < CAN_BENCHMARK_ITERATIONS; i++)
+        CanDbc::decode(can_signal_table.getMessage(i % message_count).canId, payloads[i], 0, &dash_data_share);
+    uint32_t generated_cycles = esp_cpu_get_cycle_count() - start;
+
+    const double ns_per_cycle = 1000.0 / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+    ESP_LOGI("S3Dash", "CAN decode: table %.1f ns/message, generated %.1f ns/message, %d mismatches",
+             (double)table_cycles / CAN_BENCHMARK_ITERATIONS * ns_per_cycle,
+             (double)generated_cycles / CAN_BENCHMARK_ITERATIONS * ns_per_cycle, mismatches);
+    for (int i = 0; i < DASH_SIGNAL_COUNT; i++)
+        DashData::signalField(&dash_data_share, static_cast<dash_signal_t>(i))->store(0);
+}
+#endif
+
+/**
+ * Queue the frames of a notification for the decoder task. Runs on the Bluedroid task, so does as
+ * little as it can.
+ */
+void IRAM_ATTR notify_cb(uint8_t *data, size_t len)
+{
+    size_t frame_count = std::min<size_t>(len / CAN_FRAME_BYTES, CAN_MAX_FRAMES_PER_NOTIFICATION);
+    if (len != frame_count * CAN_FRAME_BYTES)
+        notify_partial_count.store(notify_partial_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (frame_count == 0)
+        return;
+
+    notify_alloc_guard.begin();
+    int64_t now_us = esp_timer_get_time();
+    last_notify_us = now_us;
+    is_connected = true;
+    for (size_t i = 0; i < frame_count; i++)
+    {
+        received_frame_t received;
+        memcpy(&received.frame, data + i * CAN_FRAME_BYTES, CAN_FRAME_BYTES);
+        received.receivedUs = now_us;
+        can_frame_ring.push(received);
+    }
+    std::atomic<uint32_t> &notifications = notify_frame_counts[frame_count];
+    notifications.store(notifications.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    xTaskNotifyGive(can_decoder_task_handle);
+    notify_alloc_guard.end();
+}
+
+/**
+ * Decode the frames queued by notify_cb in batches into dash_data_share, and wake up the LCD task once
+ * per batch.
+ */
+void vTask_CanDecoder(void *pvParameters)
+{
+    received_frame_t frames[CAN_DECODE_BATCH];
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint32_t count;
+        while ((count = can_frame_ring.pop(frames, CAN_DECODE_BATCH)) > 0)
+        {
+            decoder_alloc_guard.begin();
+            DashData::beginWrite(dash_data_share);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                [[maybe_unused]] int index = decode_can_message(frames[i].frame.canId, frames[i].frame.payload, frames[i].receivedUs);
+#if CAN_ARRIVAL_HISTOGRAMS
+                if (index >= 0)
+                    arrival_histograms.record(index, frames[i].receivedUs);
+#endif
+            }
+            DashData::endWrite(dash_data_share);
+            wake_lcd_task();
+            decoder_alloc_guard.end();
+        }
+    }
+}
+
+/**
+ * Show the connecting view as soon as the CAN bridge disconnects. Runs on the Bluedroid task.
+ */
+void disconnect_cb()
+{
+    is_connected = false;
+    wake_lcd_task();
+}
+
+/**
+ * Log how many frames notifications carried, to see how well the CAN bridge batches them.
+ */
+void log_notify_stats()
+{
+    char histogram[CAN_MAX_FRAMES_PER_NOTIFICATION * 16];
+    int length = 0;
+    uint32_t notifications = 0;
+    uint32_t frames = 0;
+    for (int i = 1; i <= CAN_MAX_FRAMES_PER_NOTIFICATION; i++)
+    {
+        uint32_t count = notify_frame_counts[i];
+        notifications += count;
+        frames += count * i;
+        if (count && length < (int)sizeof(histogram))
+            length += snprintf(histogram + length, sizeof(histogram) - length, " %d:%lu", i, count);
+    }
+    histogram[std::min(length, (int)sizeof(histogram) - 1)] = 0;
+    ESP_LOGI("LCD", "Notifications: %lu carrying %lu frames, %.2f frames each, %lu with a partial frame, frames:count%s",
+             notifications, frames, notifications ? (double)frames / notifications : 0.0,
+             (uint32_t)notify_partial_count, histogram);
+}
+
+/**
+ * Copy the statistics of the ring between notify_cb and the decoder task into out, from any task.
+ */
+void get_can_ring_stats(spsc_ring_stats_t *out)
+{
+    can_frame_ring.stats(out);
+}
+
+void IRAM_ATTR gpio_interrupt_handler(void *args)
+{
+    uint32_t displayModeRaw = atomic_display_mode;
+    NvsDisplayMode displayMode = *reinterpret_cast<NvsDisplayMode*>(&displayModeRaw);
+    uint16_t pinNumber = (int)args;
+    {
+        if (pinNumber == GPIO_NUM_14)
+        {
+            displayMode.displayMode++;
+            if (displayMode.displayMode > last_display_mode())
+                displayMode.displayMode = DASH_MOUNT;
+        }
+
+        if (pinNumber == GPIO_NUM_0)
+        {
+            displayMode.oilpressureMode++;
+            if (displayMode.oilpressureMode > OILP_1)
+                displayMode.oilpressureMode = OILP_0;
+        }
+    }
+    atomic_display_mode = *reinterpret_cast<uint32_t *>(&displayMode);
+    nvs_mode_changed = true;
+    background_stale = true;
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    if (lcd_task_handle)
+        vTaskNotifyGiveFromISR(lcd_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * Whether the oil pressure shown in displayMode is low at high revs. No alarm on values the dash no
+ * longer receives.
+ */
+bool is_oil_pressure_alarm(const dash_data_t &data, NvsDisplayMode displayMode, bool connected)
+{
+    if (!connected || data.rpm < 3500 || DashData::isStale(&data, DASH_SIGNAL_RPM))
+        return false;
+    if (displayMode.oilpressureMode == OILP_0)
+        return data.oil_pressure0 < 35 && !DashData::isStale(&data, DASH_SIGNAL_OIL_PRESSURE0);
+    if (displayMode.oilpressureMode == OILP_1)
+        return data.oil_pressure1 < 35 && !DashData::isStale(&data, DASH_SIGNAL_OIL_PRESSURE1);
+    return false;
+}
+
+/**
+ * Blink the oil pressure alarm the LCD task found. Runs on the esp_timer task, on core 0 above the
+ * writers of the shared dash data, so it must not read it.
+ */
+static void tick_timer_cb(void *arg)
+{
+    if (oil_pressure_alarm) {
+        invert_color = !invert_color;
+        wake_lcd_task();
+        return;
+    }
+    if (invert_color) {
+        invert_color = false;
+        wake_lcd_task();
+    }
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "alloc_tracker.h"
+
+#include <atomic>
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "AllocTracker";
+
+typedef struct {
+    std::atomic<TaskHandle_t> task;
+    std::atomic<uint32_t> allocations;
+    std::atomic<uint32_t> frees;
+} task_allocations_t;
+
+// Tasks claim a slot on their first allocation. The last slot counts allocations made before the
+// scheduler started and by tasks that found no free slot.
+static task_allocations_t tasks[ALLOC_TRACKER_MAX_TASKS + 1];
+
+static IRAM_ATTR task_allocations_t *find_task(TaskHandle_t task)
+{
+    if (!task)
+        return &tasks[ALLOC_TRACKER_MAX_TASKS];
+    for (int i = 0; i < ALLOC_TRACKER_MAX_TASKS; i++) {
+        TaskHandle_t owner = tasks[i].task.load(std::memory_order_relaxed);
+        // On failure owner is updated to the task that claimed the slot first.
+        if (!owner && tasks[i].task.compare_exchange_strong(owner, task))
+            return &tasks[i];
+        if (owner == task)
+            return &tasks[i];
+    }
+    return &tasks[ALLOC_TRACKER_MAX_TASKS];
+}
+
+static inline IRAM_ATTR TaskHandle_t current_task()
+{
+    return xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED ? NULL : xTaskGetCurrentTaskHandle();
+}
+
+uint32_t AllocTracker::taskAllocations()
+{
+#if ALLOC_TRACKER_ENABLED
+    return find_task(current_task())->allocations.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+void AllocTracker::log()
+{
+#if ALLOC_TRACKER_ENABLED
+    for (int i = 0; i <= ALLOC_TRACKER_MAX_TASKS; i++) {
+        TaskHandle_t task = tasks[i].task;
+        if (!task && i < ALLOC_TRACKER_MAX_TASKS)
+            continue;
+        ESP_LOGI(TAG, "%-16s %8lu allocations %8lu frees", task ? pcTaskGetName(task) : "other",
+                 tasks[i].allocations.load(), tasks[i].frees.load());
+    }
+#endif
+}
+
+#if ALLOC_TRACKER_ENABLED
+// The heap calls the hooks on every allocation, also while the flash cache is disabled, so they and
+// everything they call live in IRAM.
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    find_task(current_task())->allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" IRAM_ATTR void esp_heap_trace_free_hook(void *ptr)
+{
+    if (ptr)
+        find_task(current_task())->frees.fetch_add(1, std::memory_order_relaxed);
+}
+#endif
@@ -0,0 +1,74 @@
+#ifndef S3DASH_ALLOC_TRACKER_H
+#define S3DASH_ALLOC_TRACKER_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+// Allocation tracking is a debug build mode: enable CONFIG_HEAP_USE_HOOKS in menuconfig, which makes
+// the heap call esp_heap_trace_alloc_hook and esp_heap_trace_free_hook on every allocation.
+#ifdef CONFIG_HEAP_USE_HOOKS
+#define ALLOC_TRACKER_ENABLED 1
+#else
+#define ALLOC_TRACKER_ENABLED 0
+#endif
+// Tasks counted separately, allocations of any further task are counted together.
+#define ALLOC_TRACKER_MAX_TASKS 16
+// Runs of a guarded section allowed to allocate, e.g. for lazy initialization in libraries.
+#define ALLOC_GUARD_WARMUP_CALLS 100
+
+namespace AllocTracker
+{
+    /**
+     * Number of heap allocations the calling task made so far, 0 when tracking is disabled.
+     */
+    uint32_t taskAllocations();
+
+    /**
+     * Log the allocations and frees of every task.
+     */
+    void log();
+}
+
+/**
+ * Asserts that a section of code run over and over, like rendering a frame or decoding a
+ * notification, does not allocate once past its first ALLOC_GUARD_WARMUP_CALLS runs. Allocations are
+ * counted per task, so other tasks preempting the section are not blamed on it. Compiles to nothing
+ * unless allocation tracking is enabled.
+ */
+class AllocGuard
+{
+private:
+    const char *name;
+    uint32_t calls = 0;
+    uint32_t start = 0;
+
+public:
+    AllocGuard(const char *name) : name(name) {}
+
+    inline void begin()
+    {
+#if ALLOC_TRACKER_ENABLED
+        start = AllocTracker::taskAllocations();
+#endif
+    }
+
+    inline void end()
+    {
+#if ALLOC_TRACKER_ENABLED
+        uint32_t allocations = AllocTracker::taskAllocations() - start;
+        if (calls < ALLOC_GUARD_WARMUP_CALLS) {
+            calls++;
+            return;
+        }
+        if (allocations) {
+            ESP_LOGE("AllocTracker", "%s made %lu heap allocations", name, allocations);
+            assert(allocations == 0);
+        }
+#endif
+    }
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef S3DASH_ARRIVAL_HISTOGRAM_H
+#define S3DASH_ARRIVAL_HISTOGRAM_H
+
+#include <atomic>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "can_signals.h"
+#include "esp_log.h"
+
+// Buckets of power of two milliseconds: under 1 ms, 1 to 2 ms, 2 to 4 ms, and so on, the last one
+// holding everything from 2^(ARRIVAL_HISTOGRAM_BUCKETS - 2) ms up.
+#define ARRIVAL_HISTOGRAM_BUCKETS 12
+
+/**
+ * Histograms of the time between two frames of the same CAN message, per message of a signal table,
+ * as received by notify_cb. Shows the latency the connection interval and the CAN bridge add on top of
+ * the interval the bridge was asked to forward a message at.
+ *
+ * Recorded by a single task, read from any task.
+ */
+class ArrivalHistograms
+{
+private:
+    std::atomic<uint32_t> counts[CAN_SIGNALS_MAX][ARRIVAL_HISTOGRAM_BUCKETS] = {};
+    uint32_t lastUs[CAN_SIGNALS_MAX];
+    bool seen[CAN_SIGNALS_MAX] = {};
+
+    static inline int bucket(uint32_t deltaUs)
+    {
+        uint32_t ms = deltaUs / 1000;
+        if (ms == 0)
+            return 0;
+        int bucket = 32 - __builtin_clz(ms);
+        return bucket < ARRIVAL_HISTOGRAM_BUCKETS ? bucket : ARRIVAL_HISTOGRAM_BUCKETS - 1;
+    }
+
+public:
+    /**
+     * Record that the message at index of the signal table arrived at receivedUs.
+     */
+    inline void record(int index, uint32_t receivedUs)
+    {
+        if (seen[index]) {
+            std::atomic<uint32_t> &count = counts[index][bucket(receivedUs - lastUs[index])];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        lastUs[index] = receivedUs;
+        seen[index] = true;
+    }
+
+    /**
+     * Frames of the message at index that arrived within the time range of bucket after the previous one.
+     */
+    inline uint32_t getCount(int index, int bucket) const
+    {
+        return counts[index][bucket].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Log one line per message of table, with the filter interval and the count of every bucket.
+     */
+    void log(const CanSignalTable &table) const
+    {
+        static const char *TAG = "Arrival";
+        char line[ARRIVAL_HISTOGRAM_BUCKETS * 12];
+        ESP_LOGI(TAG, "Frame inter-arrival times per CAN ID, buckets <1 <2 <4 ... ms");
+        for (int i = 0; i < table.getMessageCount(); i++) {
+            int length = 0;
+            for (int b = 0; b < ARRIVAL_HISTOGRAM_BUCKETS && length < (int)sizeof(line); b++)
+                length += snprintf(line + length, sizeof(line) - length, " %" PRIu32,
+                                   counts[i][b].load(std::memory_order_relaxed));
+            const can_message_t &message = table.getMessage(i);
+            ESP_LOGI(TAG, "0x%03" PRIx32 " every %u ms:%s", message.canId, message.intervalMs, line);
+        }
+    }
+};
+
+#endif
@@ -1,4 +1,7 @@
 #include "ble.h"
+#include <algorithm>
+
+#include "conn_params_ladder.h"
 
 #define GATTC_TAG "GATTC_DEMO"
 #define REMOTE_SERVICE_UUID 0x1FF8
@@ -7,12 +10,21 @@
 #define PROFILE_NUM 1
 #define PROFILE_A_APP_ID 0
 #define INVALID_HANDLE 0
+// Characteristics and descriptors looked at during discovery. The CAN service has two
+// characteristics with one descriptor each.
+#define MAX_CHAR_ELEMS 4
+#define MAX_DESCR_ELEMS 4
+
+// Until the controller reports otherwise, links run on the 1M PHY with 27 byte PDUs.
+#define BLE_PHY_DEFAULT 1
+#define BLE_DATA_LENGTH_DEFAULT 27
 
 static const char remote_device_name[] = "ECAN_XXXX";
 static bool connect = false;
 static bool get_server = false;
-static esp_gattc_char_elem_t *char_elem_result = NULL;
-static esp_gattc_descr_elem_t *descr_elem_result = NULL;
+// Static, so discovery does not allocate.
+static esp_gattc_char_elem_t char_elem_result[MAX_CHAR_ELEMS];
+static esp_gattc_descr_elem_t descr_elem_result[MAX_DESCR_ELEMS];
 
 /* Declare static functions */
 static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
@@ -20,6 +32,12 @@ static void esp_gattc_cb(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp
 static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param);
 
 void (*notify_cb)(uint8_t *data, size_t len) = NULL;
+void (*disconnect_cb)() = NULL;
+static const CanSignalTable *can_signals = NULL;
+static ConnParamsLadder conn_params_ladder;
+// Written on the Bluedroid task, see get_ble_link_stats.
+static ble_link_stats_t link_stats = {};
+static portMUX_TYPE link_stats_lock = portMUX_INITIALIZER_UNLOCKED;
 
 static esp_bt_uuid_t remote_filter_service_uuid = {
     .len = ESP_UUID_LEN_16,
@@ -79,6 +97,79 @@ static struct gattc_profile_inst gl_profile_tab = {
     .remote_bda = {0, 0, 0, 0, 0, 0},
 };
 
+/**
+ * Ask for a step of the connection parameter ladder on the current connection.
+ */
+static void request_conn_params(const conn_params_step_t &params)
+{
+    esp_ble_conn_update_params_t update = {};
+    memcpy(update.bda, gl_profile_tab.remote_bda, sizeof(esp_bd_addr_t));
+    update.min_int = params.minInterval;
+    update.max_int = params.maxInterval;
+    update.latency = 0;
+    update.timeout = params.timeout;
+    ESP_LOGI(GATTC_TAG, "Requesting connection interval %d to %d us", params.minInterval * 1250, params.maxInterval * 1250);
+    esp_err_t ret = esp_ble_gap_update_conn_params(&update);
+    if (ret)
+    {
+        ESP_LOGE(GATTC_TAG, "update connection params error, error code = %x", ret);
+    }
+}
+
+static void update_link_stats(bool connected, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    taskENTER_CRITICAL(&link_stats_lock);
+    link_stats.connected = connected;
+    link_stats.connInterval = interval;
+    link_stats.latency = latency;
+    link_stats.timeout = timeout;
+    link_stats.connParamsStep = conn_params_ladder.getStep();
+    taskEXIT_CRITICAL(&link_stats_lock);
+}
+
+static void update_link_phy(uint8_t txPhy, uint8_t rxPhy)
+{
+    taskENTER_CRITICAL(&link_stats_lock);
+    link_stats.txPhy = txPhy;
+    link_stats.rxPhy = rxPhy;
+    taskEXIT_CRITICAL(&link_stats_lock);
+}
+
+static void update_link_data_length(uint16_t txOctets, uint16_t rxOctets)
+{
+    taskENTER_CRITICAL(&link_stats_lock);
+    link_stats.txOctets = txOctets;
+    link_stats.rxOctets = rxOctets;
+    taskEXIT_CRITICAL(&link_stats_lock);
+}
+
+/**
+ * Ask for the 2M PHY and the longest PDUs on the current connection. Both are negotiated with the CAN
+ * bridge, which keeps the 1M PHY or 27 byte PDUs if it does not support them, and the outcome comes
+ * back as GAP events.
+ */
+static void request_fast_link()
+{
+    update_link_phy(BLE_PHY_DEFAULT, BLE_PHY_DEFAULT);
+    update_link_data_length(BLE_DATA_LENGTH_DEFAULT, BLE_DATA_LENGTH_DEFAULT);
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    // No "no preference" bits: both directions prefer 2M.
+    esp_err_t phy_ret = esp_ble_gap_set_prefer_phy(gl_profile_tab.remote_bda, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+                                                   ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+    if (phy_ret)
+    {
+        ESP_LOGE(GATTC_TAG, "set prefer PHY error, error code = %x", phy_ret);
+    }
+#else
+    ESP_LOGI(GATTC_TAG, "BLE 5.0 features disabled, staying on the 1M PHY");
+#endif
+    esp_err_t length_ret = esp_ble_gap_set_pkt_data_len(gl_profile_tab.remote_bda, BLE_DATA_LENGTH);
+    if (length_ret)
+    {
+        ESP_LOGE(GATTC_TAG, "set packet data length error, error code = %x", length_ret);
+    }
+}
+
 static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t *param)
 {
     esp_ble_gattc_cb_param_t *p_data = (esp_ble_gattc_cb_param_t *)param;
@@ -108,6 +199,9 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         {
             ESP_LOGE(GATTC_TAG, "config MTU error, error code = %x", mtu_ret);
         }
+        request_conn_params(conn_params_ladder.restart());
+        request_fast_link();
+        update_link_stats(true, p_data->connect.conn_params.interval, p_data->connect.conn_params.latency, p_data->connect.conn_params.timeout);
         break;
     }
     case ESP_GATTC_OPEN_EVT:
@@ -191,124 +285,63 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
 
             if (count > 0)
             {
-                char_elem_result = (esp_gattc_char_elem_t *)malloc(sizeof(esp_gattc_char_elem_t) * count);
-                if (!char_elem_result)
+                count = std::min<uint16_t>(count, MAX_CHAR_ELEMS);
+                // Setup Filter
+                status = esp_ble_gattc_get_char_by_uuid(gattc_if,
+                                                        p_data->search_cmpl.conn_id,
+                                                        gl_profile_tab.service_start_handle,
+                                                        gl_profile_tab.service_end_handle,
+                                                        remote_filter_char_uuid,
+                                                        char_elem_result,
+                                                        &count);
+                if (status != ESP_GATT_OK)
                 {
-                    ESP_LOGE(GATTC_TAG, "gattc no mem");
+                    ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_char_by_uuid error");
                 }
-                else
+                if (count > 0)
                 {
-                    // Setup Filter
-                    status = esp_ble_gattc_get_char_by_uuid(gattc_if,
-                                                            p_data->search_cmpl.conn_id,
-                                                            gl_profile_tab.service_start_handle,
-                                                            gl_profile_tab.service_end_handle,
-                                                            remote_filter_char_uuid,
-                                                            char_elem_result,
-                                                            &count);
-                    if (status != ESP_GATT_OK)
+                    uint8_t send_buf[8];
+                    memset(send_buf, 0, 8);
+                    gl_profile_tab.char_filter_handle = char_elem_result[0].char_handle;
+                    // Clear the filters of the bridge, then forward every message of the signal table.
+                    esp_ble_gattc_write_char(gattc_if,
+                                             p_data->search_cmpl.conn_id,
+                                             gl_profile_tab.char_filter_handle,
+                                             1,
+                                             send_buf,
+                                             ESP_GATT_WRITE_TYPE_NO_RSP,
+                                             ESP_GATT_AUTH_REQ_NONE);
+                    for (int i = 0; can_signals && i < can_signals->getMessageCount(); i++)
                     {
-                        ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_char_by_uuid error");
-                    }
-                    if (count > 0)
-                    {
-                        uint8_t send_buf[8];
-                        memset(send_buf, 0, 8);
-                        gl_profile_tab.char_filter_handle = char_elem_result[0].char_handle;
+                        can_signals->filterCommand(i, send_buf);
                         esp_ble_gattc_write_char(gattc_if,
                                                  p_data->search_cmpl.conn_id,
                                                  gl_profile_tab.char_filter_handle,
-                                                 1,
-                                                 send_buf,
-                                                 ESP_GATT_WRITE_TYPE_NO_RSP,
-                                                 ESP_GATT_AUTH_REQ_NONE);
-                        memset(send_buf, 0, 8);
-                        send_buf[0] = 2;
-                        send_buf[1] = 0;
-                        send_buf[2] = 50;
-                        send_buf[6] = 0x40;
-                        esp_ble_gattc_write_char(gattc_if,
-                                                 p_data->search_cmpl.conn_id,
-                                                 gl_profile_tab.char_filter_handle,
-                                                 7,
-                                                 send_buf,
-                                                 ESP_GATT_WRITE_TYPE_NO_RSP,
-                                                 ESP_GATT_AUTH_REQ_NONE);
-                        memset(send_buf, 0, 8);
-                        send_buf[0] = 2;
-                        send_buf[1] = 0;
-                        send_buf[2] = 50;
-                        send_buf[5] = 0x01;
-                        send_buf[6] = 0x38;
-                        esp_ble_gattc_write_char(gattc_if,
-                                                 p_data->search_cmpl.conn_id,
-                                                 gl_profile_tab.char_filter_handle,
-                                                 7,
-                                                 send_buf,
-                                                 ESP_GATT_WRITE_TYPE_NO_RSP,
-                                                 ESP_GATT_AUTH_REQ_NONE);
-                        memset(send_buf, 0, 8);
-                        send_buf[0] = 2;
-                        send_buf[1] = 0;
-                        send_buf[2] = 50;
-                        send_buf[5] = 0x01;
-                        send_buf[6] = 0x39;
-                        esp_ble_gattc_write_char(gattc_if,
-                                                 p_data->search_cmpl.conn_id,
-                                                 gl_profile_tab.char_filter_handle,
-                                                 7,
-                                                 send_buf,
-                                                 ESP_GATT_WRITE_TYPE_NO_RSP,
-                                                 ESP_GATT_AUTH_REQ_NONE);
-                        memset(send_buf, 0, 8);
-                        send_buf[0] = 2;
-                        send_buf[1] = 0;
-                        send_buf[2] = 200;
-                        send_buf[5] = 0x03;
-                        send_buf[6] = 0x45;
-                        esp_ble_gattc_write_char(gattc_if,
-                                                 p_data->search_cmpl.conn_id,
-                                                 gl_profile_tab.char_filter_handle,
-                                                 7,
-                                                 send_buf,
-                                                 ESP_GATT_WRITE_TYPE_NO_RSP,
-                                                 ESP_GATT_AUTH_REQ_NONE);
-                        memset(send_buf, 0, 8);
-                        send_buf[0] = 2;
-                        send_buf[1] = 0;
-                        send_buf[2] = 50;
-                        send_buf[5] = 0x06;
-                        send_buf[6] = 0x62;
-                        esp_ble_gattc_write_char(gattc_if,
-                                                 p_data->search_cmpl.conn_id,
-                                                 gl_profile_tab.char_filter_handle,
-                                                 7,
+                                                 CAN_FILTER_COMMAND_BYTES,
                                                  send_buf,
                                                  ESP_GATT_WRITE_TYPE_NO_RSP,
                                                  ESP_GATT_AUTH_REQ_NONE);
                     }
+                }
 
-                    status = esp_ble_gattc_get_char_by_uuid(gattc_if,
-                                                            p_data->search_cmpl.conn_id,
-                                                            gl_profile_tab.service_start_handle,
-                                                            gl_profile_tab.service_end_handle,
-                                                            remote_main_char_uuid,
-                                                            char_elem_result,
-                                                            &count);
-                    if (status != ESP_GATT_OK)
-                    {
-                        ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_char_by_uuid error");
-                    }
+                status = esp_ble_gattc_get_char_by_uuid(gattc_if,
+                                                        p_data->search_cmpl.conn_id,
+                                                        gl_profile_tab.service_start_handle,
+                                                        gl_profile_tab.service_end_handle,
+                                                        remote_main_char_uuid,
+                                                        char_elem_result,
+                                                        &count);
+                if (status != ESP_GATT_OK)
+                {
+                    ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_char_by_uuid error");
+                }
 
-                    /*  Every service have only one char in our 'ESP_GATTS_DEMO' demo, so we used first 'char_elem_result' */
-                    if (count > 0 && (char_elem_result[0].properties & ESP_GATT_CHAR_PROP_BIT_NOTIFY))
-                    {
-                        gl_profile_tab.char_handle = char_elem_result[0].char_handle;
-                        esp_ble_gattc_register_for_notify(gattc_if, gl_profile_tab.remote_bda, char_elem_result[0].char_handle);
-                    }
+                /*  Every service have only one char in our 'ESP_GATTS_DEMO' demo, so we used first 'char_elem_result' */
+                if (count > 0 && (char_elem_result[0].properties & ESP_GATT_CHAR_PROP_BIT_NOTIFY))
+                {
+                    gl_profile_tab.char_handle = char_elem_result[0].char_handle;
+                    esp_ble_gattc_register_for_notify(gattc_if, gl_profile_tab.remote_bda, char_elem_result[0].char_handle);
                 }
-                /* free char_elem_result */
-                free(char_elem_result);
             }
             else
             {
@@ -341,46 +374,36 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
             }
             if (count > 0)
             {
-                descr_elem_result = (esp_gattc_descr_elem_t *)malloc(sizeof(esp_gattc_descr_elem_t) * count);
-                if (!descr_elem_result)
+                count = std::min<uint16_t>(count, MAX_DESCR_ELEMS);
+                ret_status = esp_ble_gattc_get_descr_by_char_handle(gattc_if,
+                                                                    gl_profile_tab.conn_id,
+                                                                    p_data->reg_for_notify.handle,
+                                                                    notify_descr_uuid,
+                                                                    descr_elem_result,
+                                                                    &count);
+                if (ret_status != ESP_GATT_OK)
                 {
-                    ESP_LOGE(GATTC_TAG, "malloc error, gattc no mem");
+                    ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_descr_by_char_handle error");
                 }
-                else
+                /* Every char has only one descriptor in our 'ESP_GATTS_DEMO' demo, so we used first 'descr_elem_result' */
+                if (count > 0 && descr_elem_result[0].uuid.len == ESP_UUID_LEN_16 && descr_elem_result[0].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG)
                 {
-                    ret_status = esp_ble_gattc_get_descr_by_char_handle(gattc_if,
-                                                                        gl_profile_tab.conn_id,
-                                                                        p_data->reg_for_notify.handle,
-                                                                        notify_descr_uuid,
-                                                                        descr_elem_result,
-                                                                        &count);
-                    if (ret_status != ESP_GATT_OK)
-                    {
-                        ESP_LOGE(GATTC_TAG, "esp_ble_gattc_get_descr_by_char_handle error");
-                    }
-                    /* Every char has only one descriptor in our 'ESP_GATTS_DEMO' demo, so we used first 'descr_elem_result' */
-                    if (count > 0 && descr_elem_result[0].uuid.len == ESP_UUID_LEN_16 && descr_elem_result[0].uuid.uuid.uuid16 == ESP_GATT_UUID_CHAR_CLIENT_CONFIG)
-                    {
-                        esp_err_t err = esp_ble_gattc_write_char_descr(gattc_if,
-                                                                       gl_profile_tab.conn_id,
-                                                                       descr_elem_result[0].handle,
-                                                                       sizeof(notify_en),
-                                                                       (uint8_t *)&notify_en,
-                                                                       ESP_GATT_WRITE_TYPE_RSP,
-                                                                       ESP_GATT_AUTH_REQ_NONE);
-                        if (err != ESP_OK)
-                        {
-                            ESP_LOGE(GATTC_TAG, "esp_ble_gattc_write_char_descr error");
-                        }
-                    }
-
-                    if (ret_status != ESP_GATT_OK)
+                    esp_err_t err = esp_ble_gattc_write_char_descr(gattc_if,
+                                                                   gl_profile_tab.conn_id,
+                                                                   descr_elem_result[0].handle,
+                                                                   sizeof(notify_en),
+                                                                   (uint8_t *)&notify_en,
+                                                                   ESP_GATT_WRITE_TYPE_RSP,
+                                                                   ESP_GATT_AUTH_REQ_NONE);
+                    if (err != ESP_OK)
                     {
                         ESP_LOGE(GATTC_TAG, "esp_ble_gattc_write_char_descr error");
                     }
+                }
 
-                    /* free descr_elem_result */
-                    free(descr_elem_result);
+                if (ret_status != ESP_GATT_OK)
+                {
+                    ESP_LOGE(GATTC_TAG, "esp_ble_gattc_write_char_descr error");
                 }
             }
             else
@@ -437,6 +460,11 @@ static void gattc_profile_event_handler(esp_gattc_cb_event_t event, esp_gatt_if_
         connect = false;
         get_server = false;
         ESP_LOGI(GATTC_TAG, "ESP_GATTC_DISCONNECT_EVT, reason = %d", p_data->disconnect.reason);
+        update_link_stats(false, 0, 0, 0);
+        if (disconnect_cb)
+        {
+            disconnect_cb();
+        }
         esp_ble_gap_start_scanning(30);
         break;
     }
@@ -553,8 +581,48 @@ static void esp_gap_cb(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *par
                  param->update_conn_params.conn_int,
                  param->update_conn_params.latency,
                  param->update_conn_params.timeout);
+        if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS)
+        {
+            const conn_params_step_t *next = connect ? conn_params_ladder.rejected() : nullptr;
+            if (next)
+            {
+                request_conn_params(*next);
+            }
+            else
+            {
+                ESP_LOGW(GATTC_TAG, "No connection parameters of the ladder accepted, keeping the current ones");
+            }
+            break;
+        }
+        update_link_stats(true, param->update_conn_params.conn_int, param->update_conn_params.latency, param->update_conn_params.timeout);
+        break;
+    }
+    case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+    {
+        if (param->pkt_data_length_cmpl.status != ESP_BT_STATUS_SUCCESS)
+        {
+            ESP_LOGW(GATTC_TAG, "data length extension failed, status = %d, keeping %d byte PDUs",
+                     param->pkt_data_length_cmpl.status, BLE_DATA_LENGTH_DEFAULT);
+            break;
+        }
+        ESP_LOGI(GATTC_TAG, "data length tx %d, rx %d bytes", param->pkt_data_length_cmpl.params.tx_len,
+                 param->pkt_data_length_cmpl.params.rx_len);
+        update_link_data_length(param->pkt_data_length_cmpl.params.tx_len, param->pkt_data_length_cmpl.params.rx_len);
+        break;
+    }
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+    case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+    {
+        if (param->phy_update.status != ESP_BT_STATUS_SUCCESS)
+        {
+            ESP_LOGW(GATTC_TAG, "PHY update failed, status = %d, staying on the 1M PHY", param->phy_update.status);
+            break;
+        }
+        ESP_LOGI(GATTC_TAG, "PHY tx %d, rx %d (1: 1M, 2: 2M)", param->phy_update.tx_phy, param->phy_update.rx_phy);
+        update_link_phy(param->phy_update.tx_phy, param->phy_update.rx_phy);
         break;
     }
+#endif
     default:
         break;
     }
@@ -649,7 +717,7 @@ void ble_init(void)
     {
         ESP_LOGE(GATTC_TAG, "%s gattc app register failed, error code = %x", __func__, ret);
     }
-    esp_err_t local_mtu_ret = esp_ble_gatt_set_local_mtu(128);
+    esp_err_t local_mtu_ret = esp_ble_gatt_set_local_mtu(BLE_LOCAL_MTU);
     if (local_mtu_ret)
     {
         ESP_LOGE(GATTC_TAG, "set local  MTU failed, error code = %x", local_mtu_ret);
@@ -660,3 +728,20 @@ void set_ble_notify_callback(void (*notify_func)(uint8_t *data, size_t len))
 {
     notify_cb = notify_func;
 }
+
+void set_ble_disconnect_callback(void (*disconnect_func)())
+{
+    disconnect_cb = disconnect_func;
+}
+
+void set_ble_can_signals(const CanSignalTable *table)
+{
+    can_signals = table;
+}
+
+void get_ble_link_stats(ble_link_stats_t *out)
+{
+    taskENTER_CRITICAL(&link_stats_lock);
+    *out = link_stats;
+    taskEXIT_CRITICAL(&link_stats_lock);
+}
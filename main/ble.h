@@ -21,8 +21,50 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 
+#include "can_signals.h"
+
+// ATT MTU requested from the CAN bridge. Notifications carry up to BLE_LOCAL_MTU - 3 bytes, and with
+// the L2CAP header a full one fills a link layer PDU of BLE_DATA_LENGTH bytes.
+#define BLE_LOCAL_MTU 247
+// Link layer payload requested with data length extension, the most the specification allows. Without
+// it PDUs carry 27 bytes and long notifications are split over several of them.
+#define BLE_DATA_LENGTH 251
+#define BLE_NOTIFY_MAX_BYTES (BLE_LOCAL_MTU - 3)
+
+typedef struct {
+    bool connected;
+    // Connection interval in units of 1.25 ms, peripheral latency in connection events and supervision
+    // timeout in units of 10 ms, as last reported by the controller.
+    uint16_t connInterval;
+    uint16_t latency;
+    uint16_t timeout;
+    // Step of the connection parameter ladder last requested.
+    uint8_t connParamsStep;
+    // PHY of each direction, ESP_BLE_GAP_PHY_1M or ESP_BLE_GAP_PHY_2M.
+    uint8_t txPhy;
+    uint8_t rxPhy;
+    // Largest link layer payload of each direction, 27 bytes without data length extension.
+    uint16_t txOctets;
+    uint16_t rxOctets;
+} ble_link_stats_t;
+
 void ble_init();
 
 void set_ble_notify_callback(void (*notify_func)(uint8_t *data, size_t len));
 
+/**
+ * Set the function called when the CAN bridge disconnects, from the Bluedroid task.
+ */
+void set_ble_disconnect_callback(void (*disconnect_func)());
+
+/**
+ * Set the signal table the CAN bridge filters are set up from on connection.
+ */
+void set_ble_can_signals(const CanSignalTable *table);
+
+/**
+ * Copy the parameters of the link to the CAN bridge into out, from any task.
+ */
+void get_ble_link_stats(ble_link_stats_t *out);
+
 #endif
@@ -0,0 +1,99 @@
+#ifndef S3DASH_CAN_DECODE_H
+#define S3DASH_CAN_DECODE_H
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Branchless CAN signal decode kernels. A payload is loaded once as a 64 bit word, and every signal
+ * is then a shift and a mask of it, or of its byte swapped copy for big endian signals.
+ *
+ * The templates are for signals whose position and scale are known at compile time, as emitted by
+ * tools/dbc_codegen.py, and compile down to constant shifts and multiplies. CanSignalTable uses the
+ * functions underneath with shifts and masks computed when the table is set.
+ */
+namespace CanDecode
+{
+    /**
+     * Load an 8 byte payload as one little endian word, bit n of the word being bit n % 8 of byte
+     * n / 8 as numbered in DBC files.
+     */
+    inline uint64_t load(const uint8_t *payload)
+    {
+        uint64_t bits;
+        memcpy(&bits, payload, sizeof(bits));
+        return bits;
+    }
+
+    /**
+     * Byte swap a payload loaded with load, so big endian signals are contiguous in it with byte 0 as
+     * the most significant byte.
+     */
+    constexpr uint64_t swap(uint64_t bits)
+    {
+        return __builtin_bswap64(bits);
+    }
+
+    /**
+     * Position of the least significant bit of a big endian signal in the swapped word, given its most
+     * significant bit as numbered in DBC files. Negative if the signal runs past the end of the payload.
+     */
+    constexpr int bigEndianShift(unsigned start, unsigned length)
+    {
+        return static_cast<int>((7 - start / 8) * 8 + start % 8 + 1) - static_cast<int>(length);
+    }
+
+    /**
+     * The length bits of word from bit shift up, length being 1 to 32.
+     */
+    constexpr uint64_t field(uint64_t word, unsigned shift, unsigned length)
+    {
+        return (word >> shift) & ((static_cast<uint64_t>(1) << length) - 1);
+    }
+
+    /**
+     * Sign extend a field whose sign bit is signBit, or leave it alone if signBit is 0.
+     */
+    constexpr int64_t signExtend(uint64_t raw, uint64_t signBit)
+    {
+        return static_cast<int64_t>((raw ^ signBit) - signBit);
+    }
+
+    constexpr uint64_t signBit(unsigned length, bool isSigned)
+    {
+        return isSigned ? static_cast<uint64_t>(1) << (length - 1) : 0;
+    }
+
+    /**
+     * Extract a signal from a payload loaded with load. Start is the least significant bit of little
+     * endian signals and the most significant bit of big endian (Motorola) signals, as in DBC files.
+     */
+    template<unsigned Start, unsigned Length, bool BigEndian, bool Signed>
+    constexpr int64_t extract(uint64_t bits)
+    {
+        static_assert(Length >= 1 && Length <= 32, "signals must fit in an int");
+        uint64_t raw;
+        if constexpr (BigEndian) {
+            static_assert(Start < 64 && bigEndianShift(Start, Length) >= 0, "signal runs past the end of the payload");
+            raw = field(swap(bits), bigEndianShift(Start, Length), Length);
+        } else {
+            static_assert(Start + Length <= 64, "signal runs past the end of the payload");
+            raw = field(bits, Start, Length);
+        }
+        return signExtend(raw, signBit(Length, Signed));
+    }
+
+    /**
+     * raw * Num / Den + Offset, truncated toward zero like the runtime signal table.
+     */
+    template<int32_t Num, int32_t Den, int32_t Offset>
+    constexpr int scale(int64_t raw)
+    {
+        static_assert(Den > 0, "denominator must be positive");
+        if constexpr (Num == Den)
+            return static_cast<int>(raw + Offset);
+        return static_cast<int>(raw * Num / Den + Offset);
+    }
+}
+
+#endif
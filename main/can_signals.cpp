@@ -0,0 +1,139 @@
+#include "can_signals.h"
+
+#include <algorithm>
+#include <inttypes.h>
+#include <string.h>
+
+#include "can_dbc.h"
+#include "can_decode.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+static const char *TAG = "CanSignals";
+
+bool CanSignalTable::validate(const can_signal_t &signal)
+{
+    if (signal.length == 0 || signal.length > 32 || signal.startBit >= 64)
+        return false;
+    if (signal.signal >= DASH_SIGNAL_COUNT || signal.scaleDen <= 0)
+        return false;
+    if (signal.flags & CAN_SIGNAL_BIG_ENDIAN)
+        return CanDecode::bigEndianShift(signal.startBit, signal.length) >= 0;
+    return signal.startBit + signal.length <= 64;
+}
+
+bool CanSignalTable::buildHash()
+{
+    // Odd multipliers from a fixed sequence, so the same table always hashes the same way.
+    uint32_t multiplier = 0x9E3779B1u;
+    for (int attempt = 0; attempt < CAN_SIGNALS_HASH_ATTEMPTS; attempt++) {
+        memset(slots, -1, sizeof(slots));
+        bool collision = false;
+        for (int i = 0; i < messageCount && !collision; i++) {
+            int8_t &slot = slots[hash(messages[i].canId, multiplier)];
+            collision = slot >= 0;
+            slot = i;
+        }
+        if (!collision) {
+            hashMultiplier = multiplier;
+            return true;
+        }
+        multiplier = multiplier * 1664525u + 1013904223u;
+        multiplier |= 1;
+    }
+    return false;
+}
+
+bool CanSignalTable::setSignals(const can_signal_t *signals, int count, dash_data_atomic_t *dash_data)
+{
+    if (count <= 0 || count > CAN_SIGNALS_MAX)
+        return false;
+    for (int i = 0; i < count; i++) {
+        if (!validate(signals[i])) {
+            ESP_LOGE(TAG, "Invalid signal %d of CAN ID 0x%" PRIx32, i, signals[i].canId);
+            return false;
+        }
+    }
+
+    memcpy(this->signals, signals, count * sizeof(can_signal_t));
+    std::stable_sort(this->signals, this->signals + count, [](const can_signal_t &a, const can_signal_t &b) { return a.canId < b.canId; });
+    signalCount = count;
+    messageCount = 0;
+    for (int i = 0; i < count; i++) {
+        const can_signal_t &signal = this->signals[i];
+        bool bigEndian = signal.flags & CAN_SIGNAL_BIG_ENDIAN;
+        extractors[i].mask = (static_cast<uint64_t>(1) << signal.length) - 1;
+        extractors[i].signBit = CanDecode::signBit(signal.length, signal.flags & CAN_SIGNAL_SIGNED);
+        extractors[i].shift = bigEndian ? CanDecode::bigEndianShift(signal.startBit, signal.length) : signal.startBit;
+        extractors[i].bigEndian = bigEndian;
+        fields[i] = DashData::signalField(dash_data, static_cast<dash_signal_t>(signal.signal));
+        timestamps[i] = &dash_data->updatedUs[signal.signal];
+        if (messageCount == 0 || messages[messageCount - 1].canId != signal.canId)
+            messages[messageCount++] = { signal.canId, static_cast<uint8_t>(i), 0, signal.intervalMs };
+        can_message_t &message = messages[messageCount - 1];
+        message.signalCount++;
+        message.intervalMs = std::min(message.intervalMs, signal.intervalMs);
+    }
+    memset(staleAfterUs, 0, sizeof(staleAfterUs));
+    for (int i = 0; i < count; i++) {
+        const can_signal_t &signal = this->signals[i];
+        uint32_t staleAfter = std::max(signal.intervalMs * CAN_SIGNAL_STALE_INTERVALS, CAN_SIGNAL_STALE_MIN_MS) * 1000;
+        uint32_t &threshold = staleAfterUs[signal.signal];
+        threshold = threshold ? std::min(threshold, staleAfter) : staleAfter;
+    }
+    if (!buildHash()) {
+        ESP_LOGE(TAG, "No perfect hash for %d CAN IDs", messageCount);
+        clear();
+        return false;
+    }
+    return true;
+}
+
+bool CanSignalTable::load(dash_data_atomic_t *dash_data)
+{
+    can_signal_t stored[CAN_SIGNALS_MAX];
+    size_t size = sizeof(stored);
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(CAN_SIGNALS_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(handle, CAN_SIGNALS_NVS_KEY, stored, &size);
+        nvs_close(handle);
+    }
+    if (err == ESP_OK && size % sizeof(can_signal_t) == 0
+        && setSignals(stored, size / sizeof(can_signal_t), dash_data)) {
+        ESP_LOGI(TAG, "Loaded %d signals in %d messages from NVS", signalCount, messageCount);
+        return true;
+    }
+    if (err != ESP_ERR_NVS_NOT_FOUND)
+        ESP_LOGW(TAG, "No valid signal table in NVS, using the built in one");
+    // The signals of s3dash.dbc, the car the dash was built for.
+    setSignals(CanDbc::SIGNALS, sizeof(CanDbc::SIGNALS) / sizeof(CanDbc::SIGNALS[0]), dash_data);
+    return false;
+}
+
+void CanSignalTable::decode(const can_message_t *message, const uint8_t *payload, uint32_t nowUs) const
+{
+    const uint64_t bits = CanDecode::load(payload);
+    const uint64_t words[2] = { bits, CanDecode::swap(bits) };
+    for (int i = message->firstSignal; i < message->firstSignal + message->signalCount; i++) {
+        const can_signal_t &signal = signals[i];
+        const can_extractor_t &extractor = extractors[i];
+        uint64_t raw = (words[extractor.bigEndian] >> extractor.shift) & extractor.mask;
+        int64_t value = CanDecode::signExtend(raw, extractor.signBit) * signal.scaleNum / signal.scaleDen + signal.offset;
+        fields[i]->store(static_cast<int>(value), std::memory_order_relaxed);
+        timestamps[i]->store(nowUs, std::memory_order_relaxed);
+    }
+}
+
+void CanSignalTable::filterCommand(int index, uint8_t *out) const
+{
+    // Add filter command: the interval and the CAN ID, both big endian.
+    const can_message_t &message = messages[index];
+    out[0] = 2;
+    out[1] = message.intervalMs >> 8;
+    out[2] = message.intervalMs;
+    out[3] = message.canId >> 24;
+    out[4] = message.canId >> 16;
+    out[5] = message.canId >> 8;
+    out[6] = message.canId;
+}
@@ -0,0 +1,199 @@
+#ifndef S3DASH_CAN_SIGNALS_H
+#define S3DASH_CAN_SIGNALS_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+#include "dash_data.h"
+
+// The signal table can be replaced by a blob of can_signal_t in NVS, see CanSignalTable::load.
+#define CAN_SIGNALS_NVS_NAMESPACE "storage"
+#define CAN_SIGNALS_NVS_KEY "can_signals"
+#define CAN_SIGNALS_MAX 32
+// Slots of the CAN ID hash, a power of two well above CAN_SIGNALS_MAX so a collision free
+// multiplier is quickly found.
+#define CAN_SIGNALS_HASH_BITS 7
+#define CAN_SIGNALS_HASH_SLOTS (1 << CAN_SIGNALS_HASH_BITS)
+#define CAN_SIGNALS_HASH_ATTEMPTS 1024
+
+// A signal is stale when no message carried it for CAN_SIGNAL_STALE_INTERVALS times its interval, and
+// at least CAN_SIGNAL_STALE_MIN_MS.
+#define CAN_SIGNAL_STALE_INTERVALS 5
+#define CAN_SIGNAL_STALE_MIN_MS 250
+
+// Signal flags.
+#define CAN_SIGNAL_BIG_ENDIAN 0x01
+#define CAN_SIGNAL_SIGNED 0x02
+
+// Bytes of a filter command written to the filter characteristic of the CAN bridge.
+#define CAN_FILTER_COMMAND_BYTES 7
+// Bytes of a frame notified by the CAN bridge.
+#define CAN_FRAME_BYTES 12
+
+// A CAN frame as notified by the CAN bridge: the CAN ID, little endian, then the payload.
+typedef struct {
+    uint32_t canId;
+    uint8_t payload[8];
+} can_frame_t;
+
+static_assert(sizeof(can_frame_t) == CAN_FRAME_BYTES, "can frame layout is the notification layout");
+
+/**
+ * A signal as stored in NVS, little endian. The decoded value is raw * scaleNum / scaleDen + offset,
+ * computed in integers and truncated toward zero.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t canId;
+    // Bit of the least significant bit for little endian signals, and of the most significant bit
+    // for big endian (Motorola) signals, numbered as in DBC files.
+    uint8_t startBit;
+    uint8_t length;
+    uint8_t flags;
+    // A dash_signal_t.
+    uint8_t signal;
+    int32_t scaleNum;
+    int32_t scaleDen;
+    int32_t offset;
+    // Interval the bridge forwards the message at. The shortest interval of a message's signals wins.
+    uint16_t intervalMs;
+    uint16_t reserved;
+} can_signal_t;
+
+static_assert(sizeof(can_signal_t) == 24, "can signal layout is stored in NVS");
+
+// How to pull a signal out of a payload, see CanDecode.
+typedef struct {
+    uint64_t mask;
+    // Sign bit of signed signals, 0 for unsigned ones.
+    uint64_t signBit;
+    // Position of the least significant bit in the payload word, byte swapped for big endian signals.
+    uint8_t shift;
+    bool bigEndian;
+} can_extractor_t;
+
+typedef struct {
+    uint32_t canId;
+    uint8_t firstSignal;
+    uint8_t signalCount;
+    uint16_t intervalMs;
+} can_message_t;
+
+/**
+ * Decodes CAN messages into the shared dash data, driven by a table of signals.
+ *
+ * Signals are sorted by CAN ID and grouped into messages. Messages are found through a perfect hash
+ * of their ID: a multiplier is searched for when the table is set, so every message gets its own
+ * slot and a lookup is one multiplication and one compare.
+ */
+class CanSignalTable
+{
+private:
+    can_signal_t signals[CAN_SIGNALS_MAX];
+    can_extractor_t extractors[CAN_SIGNALS_MAX];
+    std::atomic<int> *fields[CAN_SIGNALS_MAX];
+    std::atomic<uint32_t> *timestamps[CAN_SIGNALS_MAX];
+    // Indexed by dash_signal_t, 0 for signals not in the table.
+    uint32_t staleAfterUs[DASH_SIGNAL_COUNT];
+    can_message_t messages[CAN_SIGNALS_MAX];
+    int8_t slots[CAN_SIGNALS_HASH_SLOTS];
+    uint32_t hashMultiplier = 0;
+    int signalCount = 0;
+    int messageCount = 0;
+
+    static inline uint32_t hash(uint32_t canId, uint32_t multiplier)
+    {
+        return (canId * multiplier) >> (32 - CAN_SIGNALS_HASH_BITS);
+    }
+
+    bool buildHash();
+
+public:
+    CanSignalTable()
+    {
+        clear();
+    }
+
+    /**
+     * Drop every signal, so no message is decoded.
+     */
+    inline void clear()
+    {
+        signalCount = 0;
+        messageCount = 0;
+        hashMultiplier = 0;
+        memset(slots, -1, sizeof(slots));
+        memset(staleAfterUs, 0, sizeof(staleAfterUs));
+    }
+
+    /**
+     * Check a signal: it has to fit in an 8 byte payload and in an int, and name a known dash signal.
+     */
+    static bool validate(const can_signal_t &signal);
+
+    /**
+     * Replace the table, resolving signals to fields of dash_data.
+     *
+     * @return false if a signal is invalid or the table too large, in which case it is unchanged, or
+     * if no perfect hash was found, in which case it is empty.
+     */
+    bool setSignals(const can_signal_t *signals, int count, dash_data_atomic_t *dash_data);
+
+    /**
+     * Load the table from NVS, or the built in table generated from s3dash.dbc when NVS holds none or
+     * an invalid one.
+     *
+     * @return true if the table was loaded from NVS.
+     */
+    bool load(dash_data_atomic_t *dash_data);
+
+    inline int getMessageCount() const
+    {
+        return messageCount;
+    }
+
+    inline const can_message_t &getMessage(int index) const
+    {
+        return messages[index];
+    }
+
+    /**
+     * Index of a message returned by find.
+     */
+    inline int messageIndex(const can_message_t *message) const
+    {
+        return message - messages;
+    }
+
+    /**
+     * Return the message with the given ID, or null if the table has no signal in it.
+     */
+    inline const can_message_t *find(uint32_t canId) const
+    {
+        int index = slots[hash(canId, hashMultiplier)];
+        if (index < 0 || messages[index].canId != canId)
+            return nullptr;
+        return &messages[index];
+    }
+
+    /**
+     * Staleness thresholds of the signals, for DashData::staleSignals.
+     */
+    inline const uint32_t *getStaleAfterUs() const
+    {
+        return staleAfterUs;
+    }
+
+    /**
+     * Decode every signal of message from its 8 byte payload into the dash data, stamped with nowUs,
+     * between DashData::beginWrite and DashData::endWrite.
+     */
+    void decode(const can_message_t *message, const uint8_t *payload, uint32_t nowUs) const;
+
+    /**
+     * Write the command that makes the CAN bridge forward the message at index.
+     */
+    void filterCommand(int index, uint8_t *out) const;
+};
+
+#endif
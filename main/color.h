@@ -13,6 +13,26 @@ namespace Color
     const uint16_t COLOR_ORANGE = 0xfc60;
     const uint16_t COLOR_BLUE = 0x061f;
     const uint16_t COLOR_BLACK = 0x0000;
+    // Values of signals the dash stopped receiving.
+    const uint16_t COLOR_STALE = COLOR_GRAY_DARK;
+    // Drawn instead of black and white where the oil pressure alarm blinks, with 8 bit framebuffers.
+    // Nothing else draws their RGB332 values, so the color LUT can show them in the alarm colors
+    // without redrawing anything.
+    const uint16_t COLOR_ALARM_BACKGROUND = 0x0100;
+    const uint16_t COLOR_ALARM_VALUE = 0xFEFF;
+
+    // Colors that keep their exact value in 8 bit framebuffers.
+    const int PALETTE_SIZE = 8;
+    const uint16_t PALETTE[PALETTE_SIZE] = {
+        COLOR_BLACK,
+        COLOR_WHITE,
+        COLOR_RED,
+        COLOR_GRAY_LIGHT,
+        COLOR_GRAY_DARK,
+        COLOR_YELLOW,
+        COLOR_ORANGE,
+        COLOR_BLUE,
+    };
 }
 
 #endif
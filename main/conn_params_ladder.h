@@ -0,0 +1,67 @@
+#ifndef S3DASH_CONN_PARAMS_LADDER_H
+#define S3DASH_CONN_PARAMS_LADDER_H
+
+#include <stdint.h>
+
+// Connection parameters requested from the CAN bridge after connecting, in units of 1.25 ms for the
+// intervals and 10 ms for the supervision timeout, without peripheral latency so every connection event
+// can carry notifications. Notifications wait for the next connection event, so the interval is the
+// largest part of the latency of the dash.
+typedef struct {
+    uint16_t minInterval;
+    uint16_t maxInterval;
+    uint16_t timeout;
+} conn_params_step_t;
+
+static const conn_params_step_t CONN_PARAMS_LADDER[] = {
+    { 6, 6, 200 },    // 7.5 ms
+    { 6, 12, 200 },   // 7.5 to 15 ms
+    { 12, 24, 300 },  // 15 to 30 ms
+    { 24, 40, 400 },  // 30 to 50 ms
+};
+#define CONN_PARAMS_STEPS (int)(sizeof(CONN_PARAMS_LADDER) / sizeof(CONN_PARAMS_LADDER[0]))
+
+/**
+ * Walks down CONN_PARAMS_LADDER on a connection: the first step is requested after connecting, and
+ * when the controller reports that the bridge rejected a step, the next one. Once the last step was
+ * rejected the connection keeps the parameters it has.
+ */
+class ConnParamsLadder
+{
+private:
+    int step = 0;
+
+public:
+    /**
+     * Start over on a new connection.
+     *
+     * @return the parameters to request first.
+     */
+    inline const conn_params_step_t &restart()
+    {
+        step = 0;
+        return CONN_PARAMS_LADDER[0];
+    }
+
+    /**
+     * The parameters requested last were rejected.
+     *
+     * @return the parameters to request next, or null if there are none left.
+     */
+    inline const conn_params_step_t *rejected()
+    {
+        if (step + 1 >= CONN_PARAMS_STEPS)
+            return nullptr;
+        return &CONN_PARAMS_LADDER[++step];
+    }
+
+    /**
+     * Index of the step requested last.
+     */
+    inline int getStep() const
+    {
+        return step;
+    }
+};
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef S3DASH_DAMAGE_H
+#define S3DASH_DAMAGE_H
+
+#include <algorithm>
+#include <bitset>
+#include <stdint.h>
+
+#include "lcd_geometry.h"
+
+#define DAMAGE_TILE_W 32
+#define DAMAGE_TILE_H 10
+#define DAMAGE_TILE_COLS (LCD_H_RES / DAMAGE_TILE_W)
+#define DAMAGE_TILE_ROWS (LCD_V_RES / DAMAGE_TILE_H)
+#define DAMAGE_TILE_COUNT (DAMAGE_TILE_COLS * DAMAGE_TILE_ROWS)
+#define DAMAGE_MAX_RECTS DAMAGE_TILE_COUNT
+#define DAMAGE_MAX_BUFFERS 2
+
+typedef struct {
+    int x;
+    int y;
+    int w;
+    int h;
+} rect_t;
+
+typedef std::bitset<DAMAGE_TILE_COUNT> tile_mask_t;
+
+/**
+ * Return the tiles overlapping the given rectangle. The rectangle is clipped to the screen.
+ */
+inline tile_mask_t damageTilesForRect(int x, int y, int w, int h)
+{
+    tile_mask_t tiles;
+    int x0 = std::max(x, 0);
+    int y0 = std::max(y, 0);
+    int x1 = std::min(x + w, LCD_H_RES);
+    int y1 = std::min(y + h, LCD_V_RES);
+    if (x0 >= x1 || y0 >= y1)
+        return tiles;
+    for (int row = y0 / DAMAGE_TILE_H; row <= (y1 - 1) / DAMAGE_TILE_H; row++) {
+        for (int col = x0 / DAMAGE_TILE_W; col <= (x1 - 1) / DAMAGE_TILE_W; col++) {
+            tiles.set(row * DAMAGE_TILE_COLS + col);
+        }
+    }
+    return tiles;
+}
+
+/**
+ * Return the tiles of an 8 bit full frame buffer holding at least one pixel of the given value.
+ */
+inline tile_mask_t damageTilesWithValue(const uint8_t *buffer, uint8_t value)
+{
+    tile_mask_t tiles;
+    for (int y = 0; y < LCD_V_RES; y++) {
+        const uint8_t *line = buffer + y * LCD_H_RES;
+        for (int x = 0; x < LCD_H_RES; x++) {
+            if (line[x] == value) {
+                int tile = y / DAMAGE_TILE_H * DAMAGE_TILE_COLS + x / DAMAGE_TILE_W;
+                tiles.set(tile);
+                // Skip to the next tile of the row.
+                x = (x / DAMAGE_TILE_W + 1) * DAMAGE_TILE_W - 1;
+            }
+        }
+    }
+    return tiles;
+}
+
+/**
+ * Tracks which parts of the framebuffer may differ from what is currently on the panel.
+ *
+ * The screen is split into a grid of tiles. Draw calls mark the tiles they touch as stale, and
+ * on push only the stale tiles are hashed and compared with the hash of what was last sent to the
+ * panel. Tiles whose content did not actually change (e.g. a label redrawn in the same place) are
+ * dropped, and the remaining ones are merged into as few rectangles as possible.
+ *
+ * With more than one framebuffer, staleness is tracked per buffer: pushing one buffer changes the
+ * panel, which makes the same tiles stale in every other buffer.
+ */
+class DamageTracker
+{
+private:
+    // Tiles where each framebuffer may differ from the panel.
+    tile_mask_t stale[DAMAGE_MAX_BUFFERS];
+    // Framebuffer that draw calls are currently going to.
+    int current = 0;
+    // Stale tiles a collect held back, whichever buffer they were drawn into. Only a collect that
+    // allows them clears them.
+    tile_mask_t deferred;
+    // Tiles to push even if their content did not change, see force.
+    tile_mask_t forced;
+    // Tiles where the panel shows anything other than a blank (black) tile.
+    tile_mask_t panelNonBlank;
+    uint32_t panelHash[DAMAGE_TILE_COUNT];
+    uint32_t blankHash;
+    int bitsPerPixel = 16;
+
+    inline uint32_t hashTile(const uint8_t *buffer, int rowBytes, int col, int row) const
+    {
+        // FNV-1a over the tile, a 32 bit word at a time.
+        uint32_t hash = 2166136261u;
+        int tileRowWords = DAMAGE_TILE_W * bitsPerPixel / 32;
+        const uint8_t *line = buffer + row * DAMAGE_TILE_H * rowBytes + col * tileRowWords * 4;
+        for (int y = 0; y < DAMAGE_TILE_H; y++, line += rowBytes) {
+            const uint32_t *words = reinterpret_cast<const uint32_t *>(line);
+            for (int i = 0; i < tileRowWords; i++) {
+                hash = (hash ^ words[i]) * 16777619u;
+            }
+        }
+        return hash;
+    }
+
+public:
+    DamageTracker()
+    {
+        setBitsPerPixel(16);
+    }
+
+    /**
+     * Set the pixel size of the tracked framebuffers, either 8 or 16. Everything known about the
+     * panel is forgotten.
+     */
+    inline void setBitsPerPixel(int bpp)
+    {
+        static const uint32_t blank[DAMAGE_TILE_W * DAMAGE_TILE_H / 2] = {};
+        bitsPerPixel = bpp;
+        blankHash = hashTile(reinterpret_cast<const uint8_t *>(blank), DAMAGE_TILE_W * bpp / 8, 0, 0);
+        invalidate();
+    }
+
+    /**
+     * Forget everything known about the panel, forcing the next push to send the whole frame.
+     */
+    inline void invalidate()
+    {
+        for (int i = 0; i < DAMAGE_MAX_BUFFERS; i++)
+            stale[i].set();
+        deferred.reset();
+        forced.reset();
+        panelNonBlank.set();
+        for (int i = 0; i < DAMAGE_TILE_COUNT; i++)
+            panelHash[i] = ~blankHash;
+    }
+
+    /**
+     * Mark the tiles overlapping the given rectangle as stale. The rectangle is clipped to the screen.
+     */
+    inline void touch(int x, int y, int w, int h)
+    {
+        stale[current] |= damageTilesForRect(x, y, w, h);
+    }
+
+    /**
+     * Push the given tiles the next time they are allowed although their pixels did not change, e.g.
+     * because the colors they are shown in did.
+     */
+    inline void force(const tile_mask_t &tiles)
+    {
+        for (int i = 0; i < DAMAGE_MAX_BUFFERS; i++)
+            stale[i] |= tiles;
+        forced |= tiles;
+    }
+
+    /**
+     * Record that the whole framebuffer was filled with a single color. Clearing to black only
+     * changes tiles that are not already black on the panel.
+     */
+    inline void clear(bool toBlack)
+    {
+        if (toBlack)
+            stale[current] |= panelNonBlank;
+        else
+            stale[current].set();
+    }
+
+    /**
+     * Record that the whole framebuffer was replaced by an image with the given tile hashes, as
+     * computed by hashFrame. Only tiles where the panel differs from the image become stale.
+     */
+    inline void restore(const uint32_t *hashes)
+    {
+        for (int i = 0; i < DAMAGE_TILE_COUNT; i++) {
+            if (panelHash[i] != hashes[i])
+                stale[current].set(i);
+        }
+    }
+
+    /**
+     * Hash every tile of a full frame image in the tracked pixel format.
+     */
+    inline void hashFrame(const void *buffer, uint32_t *hashes) const
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(buffer);
+        int rowBytes = LCD_H_RES * bitsPerPixel / 8;
+        for (int row = 0; row < DAMAGE_TILE_ROWS; row++) {
+            for (int col = 0; col < DAMAGE_TILE_COLS; col++)
+                hashes[row * DAMAGE_TILE_COLS + col] = hashTile(bytes, rowBytes, col, row);
+        }
+    }
+
+    /**
+     * Select which framebuffer subsequent touch, clear and collect calls refer to.
+     */
+    inline void select(int buffer)
+    {
+        current = buffer;
+    }
+
+    /**
+     * Whether a previous collect held back stale tiles, in any framebuffer, that no collect has
+     * allowed since.
+     */
+    inline bool hasDeferred() const
+    {
+        return deferred.any();
+    }
+
+    /**
+     * Compare every stale tile of the framebuffer against the panel and return the rectangles that
+     * need to be pushed. Adjacent changed tiles are merged into horizontal runs, and identical runs
+     * on consecutive tile rows are merged vertically. Afterwards the panel is assumed to match the
+     * framebuffer.
+     *
+     * Only tiles in allowed are considered; stale tiles outside of it are deferred to a later call.
+     *
+     * @return the number of rectangles written to out.
+     */
+    inline int collect(const void *buffer, rect_t *out, const tile_mask_t &allowed)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(buffer);
+        int rowBytes = LCD_H_RES * bitsPerPixel / 8;
+        int count = 0;
+        for (int row = 0; row < DAMAGE_TILE_ROWS; row++) {
+            int runStart = -1;
+            for (int col = 0; col <= DAMAGE_TILE_COLS; col++) {
+                bool changed = false;
+                if (col < DAMAGE_TILE_COLS) {
+                    int tile = row * DAMAGE_TILE_COLS + col;
+                    if (stale[current].test(tile) && allowed.test(tile)) {
+                        uint32_t hash = hashTile(bytes, rowBytes, col, row);
+                        changed = hash != panelHash[tile] || forced.test(tile);
+                        forced.reset(tile);
+                        if (changed) {
+                            for (int i = 0; i < DAMAGE_MAX_BUFFERS; i++)
+                                stale[i].set(tile);
+                        }
+                        panelHash[tile] = hash;
+                        panelNonBlank.set(tile, hash != blankHash);
+                    }
+                }
+                if (changed && runStart < 0) {
+                    runStart = col;
+                } else if (!changed && runStart >= 0) {
+                    rect_t run = {runStart * DAMAGE_TILE_W, row * DAMAGE_TILE_H, (col - runStart) * DAMAGE_TILE_W, DAMAGE_TILE_H};
+                    int i = 0;
+                    while (i < count && !(out[i].x == run.x && out[i].w == run.w && out[i].y + out[i].h == run.y))
+                        i++;
+                    if (i < count)
+                        out[i].h += DAMAGE_TILE_H;
+                    else
+                        out[count++] = run;
+                    runStart = -1;
+                }
+            }
+        }
+        deferred = (deferred | stale[current]) & ~allowed;
+        stale[current] &= ~allowed;
+        return count;
+    }
+};
+
+#endif
@@ -3,6 +3,21 @@
 
 #include <algorithm>
 #include <atomic>
+#include <stdint.h>
+
+// Fields of dash_data_t, in order. View layouts and the CAN signal table refer to them by index.
+typedef enum : uint8_t {
+    DASH_SIGNAL_RPM,
+    DASH_SIGNAL_OIL_PRESSURE0,
+    DASH_SIGNAL_OIL_PRESSURE1,
+    DASH_SIGNAL_OIL_TEMP,
+    DASH_SIGNAL_ENGINE_COOLANT_TEMP,
+    DASH_SIGNAL_THROTTLE,
+    DASH_SIGNAL_BRAKE,
+    DASH_SIGNAL_STEERING,
+    DASH_SIGNAL_COUNT,
+    DASH_SIGNAL_NONE = 0xFF,
+} dash_signal_t;
 
 typedef struct {
     int rpm;
@@ -13,8 +28,17 @@ typedef struct {
     int throttle_per;
     int brake_per;
     int steering;
+    // Bit 1 << dash_signal_t of each signal not updated within its staleness threshold.
+    uint32_t stale;
 } dash_data_t;
 
+/**
+ * The dash data shared between the task decoding CAN frames and the tasks rendering them, published
+ * through a sequence lock: the single writer brackets its updates with DashData::beginWrite and
+ * DashData::endWrite, readers take consistent snapshots with DashData::dash_data_copy. Fields are
+ * atomics accessed relaxed, which compile to plain loads and stores, so the retried torn reads are
+ * not data races.
+ */
 typedef struct {
     std::atomic<int> rpm;
     std::atomic<int> oil_pressure0;
@@ -24,6 +48,12 @@ typedef struct {
     std::atomic<int> throttle_per;
     std::atomic<int> brake_per;
     std::atomic<int> steering;
+    // Low 32 bits of esp_timer_get_time when each signal was last updated.
+    std::atomic<uint32_t> updatedUs[DASH_SIGNAL_COUNT];
+    // Odd while the writer is updating the fields.
+    std::atomic<uint32_t> sequence;
+    // Snapshots retried because they overlapped an update.
+    std::atomic<uint32_t> readRetries;
 } dash_data_atomic_t;
 
 namespace DashData { 
@@ -45,49 +75,102 @@ namespace DashData {
         dash_data->steering = std::clamp(dash_data->steering, -900, 900);
     }
 
-    inline void dash_data_copy(const dash_data_atomic_t &src, dash_data_t &dst) {
-        dst.rpm = src.rpm;
-        dst.oil_pressure0 = src.oil_pressure0;
-        dst.oil_pressure1 = src.oil_pressure1;
-        dst.oil_temp = src.oil_temp;
-        dst.engine_coolant_temp = src.engine_coolant_temp;
-        dst.throttle_per = src.throttle_per;
-        dst.brake_per = src.brake_per;
-        dst.steering = src.steering;
+    /**
+     * Start updating the shared dash data. Only one task may write it.
+     */
+    inline void beginWrite(dash_data_atomic_t &shared)
+    {
+        shared.sequence.store(shared.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
     }
 
-    RpmLevel calcRpmLevel(int rpm);
-}
+    /**
+     * Publish the updates since beginWrite to readers.
+     */
+    inline void endWrite(dash_data_atomic_t &shared)
+    {
+        shared.sequence.store(shared.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * Record that signal was updated at nowUs, between beginWrite and endWrite.
+     */
+    inline void touch(dash_data_atomic_t &shared, dash_signal_t signal, uint32_t nowUs)
+    {
+        shared.updatedUs[signal].store(nowUs, std::memory_order_relaxed);
+    }
 
-inline uint32_t bitsToUIntLe(uint8_t *payload, uint32_t bitOffset, uint32_t bitLength) {
-    uint32_t result = 0;
-    if (bitOffset >= 64 || bitLength >32 || bitOffset + bitLength > 64)
-        return 0;
-    uint32_t startByte = bitOffset/8;
-    uint32_t endByte = (bitOffset+bitLength - 1) / 8;
-    uint8_t mask = 0;
-    int shift = 0;
-    for (int i = startByte; i <= endByte; i++ ) {
-        if (i == startByte) {
-            mask = (1U << (8 - bitOffset % 8)) - 1;
-            result |= (payload[i] >> (bitOffset % 8)) & mask;
-            shift += (8 - bitOffset % 8);
-            continue;
+    /**
+     * Bitmask of the signals last updated longer than staleAfterUs[signal] before nowUs, for
+     * dash_data_t::stale. A threshold of 0 means never stale, as does a null staleAfterUs. Timestamps
+     * are compared as wrapping 32 bit differences, so a signal stale for a multiple of 71 minutes
+     * looks fresh for the length of its threshold.
+     */
+    inline uint32_t staleSignals(const dash_data_atomic_t &shared, const uint32_t *staleAfterUs, uint32_t nowUs)
+    {
+        uint32_t stale = 0;
+        if (!staleAfterUs)
+            return stale;
+        for (int i = 0; i < DASH_SIGNAL_COUNT; i++) {
+            uint32_t age = nowUs - shared.updatedUs[i].load(std::memory_order_relaxed);
+            if (staleAfterUs[i] && age > staleAfterUs[i])
+                stale |= 1u << i;
+        }
+        return stale;
+    }
+
+    inline bool isStale(const dash_data_t *dash_data, dash_signal_t signal)
+    {
+        return dash_data->stale & (1u << signal);
+    }
+
+    /**
+     * Copy a consistent snapshot of the shared dash data, retrying while it overlaps an update. Leaves
+     * stale alone.
+     *
+     * Retries until the writer finishes, so it must not be called on the writer's core from a task
+     * that can preempt the writer: the writer would never run again to end the update.
+     */
+    inline void dash_data_copy(dash_data_atomic_t &src, dash_data_t &dst) {
+        uint32_t retries = 0;
+        while (true) {
+            uint32_t sequence = src.sequence.load(std::memory_order_acquire);
+            dst.rpm = src.rpm.load(std::memory_order_relaxed);
+            dst.oil_pressure0 = src.oil_pressure0.load(std::memory_order_relaxed);
+            dst.oil_pressure1 = src.oil_pressure1.load(std::memory_order_relaxed);
+            dst.oil_temp = src.oil_temp.load(std::memory_order_relaxed);
+            dst.engine_coolant_temp = src.engine_coolant_temp.load(std::memory_order_relaxed);
+            dst.throttle_per = src.throttle_per.load(std::memory_order_relaxed);
+            dst.brake_per = src.brake_per.load(std::memory_order_relaxed);
+            dst.steering = src.steering.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence % 2 == 0 && src.sequence.load(std::memory_order_relaxed) == sequence)
+                break;
+            retries++;
         }
-        if (i == endByte) {
-            uint8_t bitsToRead = (bitOffset + bitLength) % 8;
-            if (bitsToRead == 0) {
-                result |= static_cast<uint32_t>(payload[i])<<shift;
-            } else {
-                mask = (1U << bitsToRead) - 1;
-                result |= static_cast<uint32_t>(payload[i] & mask) <<shift;
-            }
-            continue;
+        if (retries)
+            src.readRetries.fetch_add(retries, std::memory_order_relaxed);
+    }
+
+    /**
+     * Return the field of the shared dash data holding the given signal, or null for unknown signals.
+     */
+    inline std::atomic<int> *signalField(dash_data_atomic_t *dash_data, dash_signal_t signal)
+    {
+        switch (signal) {
+        case DASH_SIGNAL_RPM: return &dash_data->rpm;
+        case DASH_SIGNAL_OIL_PRESSURE0: return &dash_data->oil_pressure0;
+        case DASH_SIGNAL_OIL_PRESSURE1: return &dash_data->oil_pressure1;
+        case DASH_SIGNAL_OIL_TEMP: return &dash_data->oil_temp;
+        case DASH_SIGNAL_ENGINE_COOLANT_TEMP: return &dash_data->engine_coolant_temp;
+        case DASH_SIGNAL_THROTTLE: return &dash_data->throttle_per;
+        case DASH_SIGNAL_BRAKE: return &dash_data->brake_per;
+        case DASH_SIGNAL_STEERING: return &dash_data->steering;
+        default: return nullptr;
         }
-        result |= static_cast<uint32_t>(payload[i])<<shift;
-        shift += 8;
     }
-    return result;
+
+    RpmLevel calcRpmLevel(int rpm);
 }
 
 #endif
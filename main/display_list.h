@@ -0,0 +1,149 @@
+#ifndef S3DASH_DISPLAY_LIST_H
+#define S3DASH_DISPLAY_LIST_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <LovyanGFX.h>
+#include "damage.h"
+
+#define DISPLAY_LIST_MAX_COMMANDS 64
+#define DISPLAY_LIST_TEXT_BYTES 512
+
+typedef enum : uint8_t {
+    DISPLAY_FILL_RECT,
+    DISPLAY_TEXT,
+    DISPLAY_SEGMENT_NUMBER,
+} display_command_type_t;
+
+/**
+ * A recorded draw call with every input that affects its pixels. Commands are compared byte by
+ * byte, so they are always zero initialized.
+ */
+typedef struct {
+    display_command_type_t type;
+    // Text: 0 left, 1 right, 2 center aligned, as for Sprite::drawAlignedString.
+    uint8_t align;
+    uint8_t datum;
+    // RGB565 color of fills and seven segment numbers.
+    uint16_t color;
+    // Fill: rectangle. Text: anchor in x and y. Seven segment number: right edge in x, top in y and
+    // digit height in h.
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+    int32_t value;
+    const lgfx::IFont *font;
+    float sizeX;
+    float sizeY;
+    uint32_t foreRgb888;
+    uint32_t backRgb888;
+    uint16_t textLength;
+    // Pixels the command may write.
+    rect_t bounds;
+} display_command_t;
+
+/**
+ * Draw calls of one frame, recorded into fixed size arenas.
+ */
+class DisplayList
+{
+private:
+    display_command_t commands[DISPLAY_LIST_MAX_COMMANDS];
+    uint16_t textOffsets[DISPLAY_LIST_MAX_COMMANDS];
+    char text[DISPLAY_LIST_TEXT_BYTES];
+    int count = 0;
+    int textUsed = 0;
+    bool overflowed = false;
+
+public:
+    inline void clear()
+    {
+        count = 0;
+        textUsed = 0;
+        overflowed = false;
+    }
+
+    /**
+     * Append a zero initialized command, with string as its text when not null.
+     *
+     * @return the command, or null if the arenas are full, after which the list is incomplete.
+     */
+    inline display_command_t *add(const char *string = nullptr)
+    {
+        size_t length = string ? strlen(string) : 0;
+        if (count >= DISPLAY_LIST_MAX_COMMANDS || textUsed + length > DISPLAY_LIST_TEXT_BYTES) {
+            overflowed = true;
+            return nullptr;
+        }
+        display_command_t *command = &commands[count];
+        memset(command, 0, sizeof(display_command_t));
+        command->textLength = length;
+        textOffsets[count] = textUsed;
+        memcpy(text + textUsed, string, length);
+        textUsed += length;
+        count++;
+        return command;
+    }
+
+    inline bool hasOverflowed() const
+    {
+        return overflowed;
+    }
+
+    inline int size() const
+    {
+        return count;
+    }
+
+    inline const display_command_t &get(int index) const
+    {
+        return commands[index];
+    }
+
+    /**
+     * Copy the text of a command into out, which must hold DISPLAY_LIST_TEXT_BYTES + 1 bytes.
+     */
+    inline void getText(int index, char *out) const
+    {
+        memcpy(out, text + textOffsets[index], commands[index].textLength);
+        out[commands[index].textLength] = 0;
+    }
+
+    /**
+     * Whether the command at index draws exactly the same pixels as the one at the same index of
+     * other.
+     */
+    inline bool sameCommand(int index, const DisplayList &other) const
+    {
+        const display_command_t &a = commands[index];
+        const display_command_t &b = other.commands[index];
+        return memcmp(&a, &b, sizeof(display_command_t)) == 0
+            && memcmp(text + textOffsets[index], other.text + other.textOffsets[index], a.textLength) == 0;
+    }
+
+    /**
+     * Return the tiles where this list draws differently from previous: the old and new bounds of
+     * every command that differs.
+     */
+    inline tile_mask_t diff(const DisplayList &previous) const
+    {
+        tile_mask_t tiles;
+        for (int i = 0; i < std::max(count, previous.count); i++) {
+            if (i < count && i < previous.count && sameCommand(i, previous))
+                continue;
+            if (i < count) {
+                const rect_t &r = commands[i].bounds;
+                tiles |= damageTilesForRect(r.x, r.y, r.w, r.h);
+            }
+            if (i < previous.count) {
+                const rect_t &r = previous.commands[i].bounds;
+                tiles |= damageTilesForRect(r.x, r.y, r.w, r.h);
+            }
+        }
+        return tiles;
+    }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef S3DASH_FRAME_HANDOFF_H
+#define S3DASH_FRAME_HANDOFF_H
+
+#include <algorithm>
+#include <stdint.h>
+
+#include "damage.h"
+
+// Pixels expanded from an 8 bit framebuffer per transfer chunk.
+#define FRAME_EXPAND_CHUNK_PIXELS (LCD_H_RES * 4)
+
+/**
+ * Hands rendered framebuffers over to the panel bus.
+ *
+ * With one buffer every push blocks until the bus wrote it. With two, push starts the transfer of
+ * the back buffer and makes the other one the back buffer: the next frame is rendered while the
+ * previous one is streamed. Before anything is sent, push waits for the transfer still running,
+ * which reads the buffer that is about to become the back buffer again.
+ *
+ * The bus is anything with the part of the LovyanGFX device interface used here: waitDMA,
+ * setClipRect, clearClipRect, pushImage and pushImageDMA, taking Pixel pixels. Sprite pushes to the
+ * panel through it, the host tests to a fake bus that checks the handoff.
+ */
+class FrameHandoff
+{
+private:
+    uint8_t *frameBuffers[2] = {nullptr, nullptr};
+    int backBuffer = 0;
+    // 16 for RGB565 framebuffers, 8 for RGB332 framebuffers expanded through a color LUT.
+    int bitsPerPixel = 16;
+    // Height of a band in band mode, 0 when the buffers hold full frames.
+    int bandHeight = 0;
+    uint16_t expandBuffers[2][FRAME_EXPAND_CHUNK_PIXELS];
+    int expandBuffer = 0;
+    rect_t damageRects[DAMAGE_MAX_RECTS];
+    uint32_t lastPushBytes = 0;
+    uint32_t lastPushRects = 0;
+
+    /**
+     * Expand rows of an 8 bit framebuffer into 16 bit pixels through colorLut.
+     */
+    inline void expandRows(const uint8_t *buffer, const uint16_t *colorLut, int x, int y, int w, int rows, uint16_t *out) const
+    {
+        int rowBytes = LCD_H_RES;
+        for (int row = 0; row < rows; row++) {
+            const uint8_t *line = buffer + (y + row) * rowBytes + x;
+            for (int i = 0; i < w; i++)
+                *out++ = colorLut[line[i]];
+        }
+    }
+
+public:
+    /**
+     * Attach the buffers to hand over, second being null for single buffering. With a band height,
+     * they hold bands of that many rows instead of full frames.
+     */
+    inline void attach(void *first, void *second, int bpp, int height = 0)
+    {
+        frameBuffers[0] = static_cast<uint8_t *>(first);
+        frameBuffers[1] = static_cast<uint8_t *>(second);
+        backBuffer = 0;
+        bitsPerPixel = bpp;
+        bandHeight = height;
+    }
+
+    /**
+     * Buffer to render the next frame or band into, and its index.
+     */
+    inline uint8_t *getBackBuffer() const
+    {
+        return frameBuffers[backBuffer];
+    }
+
+    inline int getBackIndex() const
+    {
+        return backBuffer;
+    }
+
+    inline bool isDoubleBuffered() const
+    {
+        return frameBuffers[1] != nullptr;
+    }
+
+    inline bool isBanded() const
+    {
+        return bandHeight > 0;
+    }
+
+    inline int getBandHeight() const
+    {
+        return bandHeight;
+    }
+
+    inline int getBitsPerPixel() const
+    {
+        return bitsPerPixel;
+    }
+
+    /**
+     * Push the tiles of buffer that damage reports as changed, among allowed, then hand the back
+     * buffer over. buffer is the back buffer as drawn into, i.e. shifted up by the band offset in
+     * band mode. colorLut maps 8 bit pixels to Pixel values and is unused for 16 bit buffers.
+     *
+     * In full frame mode damage is switched to the new back buffer.
+     */
+    template<typename Pixel, typename Bus>
+    inline void push(Bus *bus, const uint8_t *buffer, DamageTracker &damage, const tile_mask_t &allowed, const uint16_t *colorLut)
+    {
+        // 16 bit pixels are stored in the order the bus sends them.
+        const Pixel *pixels = reinterpret_cast<const Pixel *>(buffer);
+        int count = damage.collect(buffer, damageRects, allowed);
+        uint32_t bytes = 0;
+        if (isDoubleBuffered())
+            bus->waitDMA();
+        for (int i = 0; i < count; i++) {
+            const rect_t &r = damageRects[i];
+            if (bitsPerPixel == 16) {
+                // Each rectangle is sent as its own window by clipping the destination.
+                bus->setClipRect(r.x, r.y, r.w, r.h);
+                if (isDoubleBuffered())
+                    bus->pushImageDMA(0, 0, LCD_H_RES, LCD_V_RES, pixels);
+                else
+                    bus->pushImage(0, 0, LCD_H_RES, LCD_V_RES, pixels);
+            } else {
+                // Expand a chunk of rows while the previous chunk is still being transferred. A
+                // chunk buffer is only rewritten after the transfer following it was started, which
+                // waits for the one before.
+                int rowsPerChunk = FRAME_EXPAND_CHUNK_PIXELS / r.w;
+                for (int y = r.y; y < r.y + r.h; y += rowsPerChunk) {
+                    int rows = std::min(rowsPerChunk, r.y + r.h - y);
+                    uint16_t *chunk = expandBuffers[expandBuffer];
+                    expandBuffer ^= 1;
+                    expandRows(buffer, colorLut, r.x, y, r.w, rows, chunk);
+                    const Pixel *expanded = reinterpret_cast<const Pixel *>(chunk);
+                    if (isDoubleBuffered())
+                        bus->pushImageDMA(r.x, y, r.w, rows, expanded);
+                    else
+                        bus->pushImage(r.x, y, r.w, rows, expanded);
+                }
+            }
+            bytes += r.w * r.h * sizeof(uint16_t);
+        }
+        bus->clearClipRect();
+        lastPushBytes += bytes;
+        lastPushRects += count;
+
+        if (isDoubleBuffered()) {
+            backBuffer ^= 1;
+            // Band buffers do not keep their content between bands, so damage stays on buffer 0.
+            if (!isBanded())
+                damage.select(backBuffer);
+        }
+    }
+
+    /**
+     * Start counting the bytes and rectangles of a new frame.
+     */
+    inline void resetStats()
+    {
+        lastPushBytes = 0;
+        lastPushRects = 0;
+    }
+
+    inline uint32_t getLastPushBytes() const
+    {
+        return lastPushBytes;
+    }
+
+    inline uint32_t getLastPushRects() const
+    {
+        return lastPushRects;
+    }
+};
+
+#endif
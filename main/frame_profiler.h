@@ -0,0 +1,158 @@
+#ifndef S3DASH_FRAME_PROFILER_H
+#define S3DASH_FRAME_PROFILER_H
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+// Samples each stage keeps, the statistics cover the last FRAME_PROFILER_WINDOW samples.
+#define FRAME_PROFILER_WINDOW 256
+
+typedef enum {
+    // Copying the shared dash data and clamping it.
+    PROFILE_SNAPSHOT,
+    // Rendering on the LCD task, including waiting for the render helper. Per band in band mode.
+    PROFILE_RENDER,
+    // Rendering on the render helper, only for split frames.
+    PROFILE_RENDER_HELPER,
+    // Pushing dirty tiles to the panel. Per band in band mode.
+    PROFILE_PUSH,
+    // Persisting the display mode, only for frames following a button press.
+    PROFILE_NVS,
+    // Everything from waking up to the end of the push.
+    PROFILE_FRAME,
+    PROFILE_STAGE_COUNT,
+} profile_stage_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t avg;
+    uint32_t p99;
+    uint32_t max;
+} profile_stats_t;
+
+typedef struct {
+    // In CPU cycles.
+    profile_stats_t stages[PROFILE_STAGE_COUNT];
+    // Bytes pushed over the parallel bus per frame.
+    profile_stats_t busBytes;
+    uint64_t busBytesTotal;
+    uint32_t frames;
+} frame_profile_t;
+
+/**
+ * Rolling window of the last FRAME_PROFILER_WINDOW samples of a value.
+ */
+class ProfileWindow
+{
+private:
+    uint32_t samples[FRAME_PROFILER_WINDOW];
+    int next = 0;
+    int count = 0;
+
+public:
+    inline void add(uint32_t sample)
+    {
+        samples[next] = sample;
+        next = (next + 1) % FRAME_PROFILER_WINDOW;
+        count = std::min(count + 1, FRAME_PROFILER_WINDOW);
+    }
+
+    /**
+     * Compute the statistics of the window, using scratch to sort a copy of it.
+     */
+    inline void stats(profile_stats_t *out, uint32_t *scratch) const
+    {
+        memset(out, 0, sizeof(profile_stats_t));
+        if (count == 0)
+            return;
+        uint64_t sum = 0;
+        for (int i = 0; i < count; i++)
+            sum += samples[i];
+        memcpy(scratch, samples, count * sizeof(uint32_t));
+        std::sort(scratch, scratch + count);
+        out->count = count;
+        out->min = scratch[0];
+        out->avg = sum / count;
+        out->p99 = scratch[(count * 99 - 1) / 100];
+        out->max = scratch[count - 1];
+    }
+};
+
+/**
+ * Cycle counts of the stages of the frames rendered by the LCD task, and the bytes they pushed.
+ *
+ * Stages are timed with the cycle counter of the core they run on. Spans stay well below the 17 s
+ * the 32 bit counter takes to wrap at 240 MHz, so the unsigned difference is exact.
+ */
+class FrameProfiler
+{
+private:
+    ProfileWindow stages[PROFILE_STAGE_COUNT];
+    ProfileWindow busBytes;
+    uint64_t busBytesTotal = 0;
+    uint32_t frames = 0;
+    uint32_t scratch[FRAME_PROFILER_WINDOW];
+
+public:
+    static inline uint32_t now()
+    {
+        return esp_cpu_get_cycle_count();
+    }
+
+    /**
+     * Record a stage that started at the given cycle count and ends now.
+     *
+     * @return now, so consecutive stages can be chained.
+     */
+    inline uint32_t record(profile_stage_t stage, uint32_t startCycles)
+    {
+        uint32_t end = now();
+        stages[stage].add(end - startCycles);
+        return end;
+    }
+
+    inline void recordCycles(profile_stage_t stage, uint32_t cycles)
+    {
+        stages[stage].add(cycles);
+    }
+
+    inline void endFrame(uint32_t pushedBytes)
+    {
+        busBytes.add(pushedBytes);
+        busBytesTotal += pushedBytes;
+        frames++;
+    }
+
+    inline void summarize(frame_profile_t *out)
+    {
+        for (int i = 0; i < PROFILE_STAGE_COUNT; i++)
+            stages[i].stats(&out->stages[i], scratch);
+        busBytes.stats(&out->busBytes, scratch);
+        out->busBytesTotal = busBytesTotal;
+        out->frames = frames;
+    }
+
+    static void log(const frame_profile_t &profile)
+    {
+        static const char *TAG = "Profile";
+        static const char *NAMES[PROFILE_STAGE_COUNT] = { "snapshot", "render", "render helper", "push", "nvs", "frame" };
+        const uint32_t cyclesPerUs = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+        ESP_LOGI(TAG, "%-14s %5s %8s %8s %8s %8s (us)", "stage", "n", "min", "avg", "p99", "max");
+        for (int i = 0; i < PROFILE_STAGE_COUNT; i++) {
+            const profile_stats_t &s = profile.stages[i];
+            ESP_LOGI(TAG, "%-14s %5lu %8lu %8lu %8lu %8lu", NAMES[i], s.count, s.min / cyclesPerUs,
+                     s.avg / cyclesPerUs, s.p99 / cyclesPerUs, s.max / cyclesPerUs);
+        }
+        const profile_stats_t &b = profile.busBytes;
+        ESP_LOGI(TAG, "%-14s %5lu %8lu %8lu %8lu %8lu (bytes/frame), %llu bytes over %lu frames", "bus", b.count,
+                 b.min, b.avg, b.p99, b.max, profile.busBytesTotal, profile.frames);
+    }
+};
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef S3DASH_GLYPH_ATLAS_H
+#define S3DASH_GLYPH_ATLAS_H
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#include <LovyanGFX.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+// Characters an atlas can hold: space to underscore, which covers digits, upper case letters and
+// the punctuation used in labels.
+#define GLYPH_ATLAS_FIRST_CHAR ' '
+#define GLYPH_ATLAS_CHAR_COUNT 64
+// Room around a glyph for pixels drawn outside of its advance width and line height.
+#define GLYPH_ATLAS_PAD 4
+
+/**
+ * Horizontal run of set pixels, relative to the position the glyph is drawn at.
+ */
+typedef struct {
+    int8_t dx;
+    int8_t dy;
+    uint8_t w;
+} glyph_span_t;
+
+typedef struct {
+    uint16_t firstSpan;
+    uint16_t spanCount;
+    uint8_t advance;
+    bool present;
+} glyph_t;
+
+// Both are stored as is in the glyph atlas partition, see glyph_atlas_store.h.
+static_assert(sizeof(glyph_span_t) == 3, "glyph spans are stored in the glyph atlas partition");
+static_assert(sizeof(glyph_t) == 6, "glyphs are stored in the glyph atlas partition");
+
+/**
+ * Pre-rendered glyphs of one font at one text size.
+ *
+ * Every glyph is rasterized once by LovyanGFX, including any scaling, and stored as run length
+ * encoded spans of set pixels. Drawing a glyph is then a handful of solid span fills, with no font
+ * decoding or scaling. Only fonts without anti-aliasing can be stored, which holds for the GFX and
+ * RLE fonts the views use.
+ *
+ * The firmware maps the atlases tools/glyph_atlas_builder rasterized at build time, and
+ * rasterizes them itself when the partition does not hold them.
+ */
+class GlyphAtlas
+{
+private:
+    const lgfx::IFont *font = nullptr;
+    float size = 0;
+    glyph_t glyphs[GLYPH_ATLAS_CHAR_COUNT] = {};
+    const glyph_span_t *spans = nullptr;
+    int spanCount = 0;
+    // Spans built at boot are allocated by the atlas, spans loaded from flash stay mapped.
+    bool ownsSpans = false;
+
+    void releaseSpans()
+    {
+        if (ownsSpans)
+            heap_caps_free(const_cast<glyph_span_t *>(spans));
+        spans = nullptr;
+        spanCount = 0;
+        ownsSpans = false;
+    }
+
+    /**
+     * Advance of c in font at the given text size, from the font's glyph table. LovyanGFX moves
+     * on by the same amount after each character of a string. The width a single character
+     * string is drawn with can be larger, for glyphs reaching past their advance.
+     */
+    static int glyphAdvance(const lgfx::IFont *font, float size, char c)
+    {
+        lgfx::FontMetrics metrics;
+        font->getDefaultMetric(&metrics);
+        font->updateFontMetric(&metrics, static_cast<uint8_t>(c));
+        return static_cast<int>(metrics.x_advance * size);
+    }
+
+    /**
+     * Rasterize c into capture and append its spans to out, or only count them when out is null.
+     *
+     * @return the number of spans.
+     */
+    static int captureGlyph(LGFX_Sprite *capture, char c, glyph_span_t *out)
+    {
+        char string[2] = {c, 0};
+        capture->fillScreen(0);
+        capture->drawString(string, GLYPH_ATLAS_PAD, GLYPH_ATLAS_PAD);
+        int count = 0;
+        for (int y = 0; y < capture->height(); y++) {
+            int runStart = -1;
+            for (int x = 0; x <= capture->width(); x++) {
+                bool set = x < capture->width() && capture->readPixel(x, y) != 0;
+                if (set && runStart < 0) {
+                    runStart = x;
+                } else if (!set && runStart >= 0) {
+                    if (out) {
+                        out[count].dx = runStart - GLYPH_ATLAS_PAD;
+                        out[count].dy = y - GLYPH_ATLAS_PAD;
+                        out[count].w = x - runStart;
+                    }
+                    count++;
+                    runStart = -1;
+                }
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Check the advances against the width LovyanGFX draws a few strings with: the charset itself
+     * and the kind of labels and values the views draw, where the atlas holds them.
+     */
+    bool checkAdvances(LGFX_Sprite *capture, const char *charset) const
+    {
+        static const char *TAG = "GlyphAtlas";
+        const char *samples[] = {charset, "0123456789", "-88", "RPM 7500", "OIL 4.2 BAR"};
+        for (const char *sample : samples) {
+            int width;
+            if (!measure(sample, &width))
+                continue;
+            int drawn = capture->drawString(sample, GLYPH_ATLAS_PAD, GLYPH_ATLAS_PAD);
+            if (width != drawn) {
+                ESP_LOGE(TAG, "Atlas advances of \"%s\" add up to %d, LovyanGFX draws it %d wide", sample, width, drawn);
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    /**
+     * Rasterize the characters of charset, or all characters an atlas can hold when charset is null,
+     * in the given font and text size. Characters outside of the atlas range are ignored.
+     */
+    bool build(const lgfx::IFont *font, float size, const char *charset)
+    {
+        static const char *TAG = "GlyphAtlas";
+        char all[GLYPH_ATLAS_CHAR_COUNT + 1];
+        if (!charset) {
+            for (int i = 0; i < GLYPH_ATLAS_CHAR_COUNT; i++)
+                all[i] = GLYPH_ATLAS_FIRST_CHAR + i;
+            all[GLYPH_ATLAS_CHAR_COUNT] = 0;
+            charset = all;
+        }
+
+        LGFX_Sprite capture;
+        capture.setColorDepth(8);
+        capture.setFont(font);
+        capture.setTextSize(size);
+        capture.setTextColor(0xFFFFu);
+        int maxAdvance = 0;
+        for (const char *c = charset; *c; c++) {
+            char string[2] = {*c, 0};
+            maxAdvance = std::max<int>(maxAdvance, capture.textWidth(string));
+        }
+        if (!capture.createSprite(maxAdvance + 2 * GLYPH_ATLAS_PAD, capture.fontHeight() + 2 * GLYPH_ATLAS_PAD)) {
+            ESP_LOGE(TAG, "Failed to allocate capture sprite");
+            return false;
+        }
+
+        // Count first, so the spans fit in a single allocation.
+        int total = 0;
+        for (const char *c = charset; *c; c++) {
+            if (*c >= GLYPH_ATLAS_FIRST_CHAR && *c < GLYPH_ATLAS_FIRST_CHAR + GLYPH_ATLAS_CHAR_COUNT)
+                total += captureGlyph(&capture, *c, nullptr);
+        }
+        glyph_span_t *buffer = static_cast<glyph_span_t *>(heap_caps_malloc(total * sizeof(glyph_span_t), MALLOC_CAP_8BIT));
+        if (!buffer) {
+            ESP_LOGE(TAG, "Failed to allocate %d glyph spans", total);
+            capture.deleteSprite();
+            return false;
+        }
+
+        releaseSpans();
+        spans = buffer;
+        ownsSpans = true;
+        memset(glyphs, 0, sizeof(glyphs));
+        for (const char *c = charset; *c; c++) {
+            if (*c < GLYPH_ATLAS_FIRST_CHAR || *c >= GLYPH_ATLAS_FIRST_CHAR + GLYPH_ATLAS_CHAR_COUNT)
+                continue;
+            glyph_t &glyph = glyphs[*c - GLYPH_ATLAS_FIRST_CHAR];
+            glyph.firstSpan = spanCount;
+            glyph.spanCount = captureGlyph(&capture, *c, buffer + spanCount);
+            glyph.advance = glyphAdvance(font, size, *c);
+            glyph.present = true;
+            spanCount += glyph.spanCount;
+        }
+        bool checked = checkAdvances(&capture, charset);
+        capture.deleteSprite();
+        if (!checked) {
+            releaseSpans();
+            return false;
+        }
+        this->font = font;
+        this->size = size;
+        ESP_LOGI(TAG, "Built atlas of %d spans, %d bytes", spanCount, (int)(spanCount * sizeof(glyph_span_t)));
+        return true;
+    }
+
+    /**
+     * Use glyphs rasterized before, e.g. mapped from flash. The glyphs are copied, spans are only
+     * pointed at and must stay valid as long as the atlas is used.
+     */
+    void adopt(const lgfx::IFont *font, float size, const glyph_t *glyphs, const glyph_span_t *spans, int spanCount)
+    {
+        releaseSpans();
+        memcpy(this->glyphs, glyphs, sizeof(this->glyphs));
+        this->spans = spans;
+        this->spanCount = spanCount;
+        this->font = font;
+        this->size = size;
+    }
+
+    /**
+     * All glyphs, indexed from GLYPH_ATLAS_FIRST_CHAR, and all spans, to store the atlas.
+     */
+    inline const glyph_t *getGlyphs() const
+    {
+        return glyphs;
+    }
+
+    inline const glyph_span_t *getAllSpans() const
+    {
+        return spans;
+    }
+
+    inline int getSpanCount() const
+    {
+        return spanCount;
+    }
+
+    inline bool matches(const lgfx::IFont *font, float size) const
+    {
+        return spans && this->font == font && this->size == size;
+    }
+
+    /**
+     * Return the glyph of c, or null if the atlas does not hold it.
+     */
+    inline const glyph_t *find(char c) const
+    {
+        if (c < GLYPH_ATLAS_FIRST_CHAR || c >= GLYPH_ATLAS_FIRST_CHAR + GLYPH_ATLAS_CHAR_COUNT)
+            return nullptr;
+        const glyph_t *glyph = &glyphs[c - GLYPH_ATLAS_FIRST_CHAR];
+        return glyph->present ? glyph : nullptr;
+    }
+
+    /**
+     * Sum up the advances of every character of string.
+     *
+     * @return false if the atlas does not hold every character.
+     */
+    inline bool measure(const char *string, int *width) const
+    {
+        int sum = 0;
+        for (const char *c = string; *c; c++) {
+            const glyph_t *glyph = find(*c);
+            if (!glyph)
+                return false;
+            sum += glyph->advance;
+        }
+        *width = sum;
+        return true;
+    }
+
+    inline const glyph_span_t *getSpans(const glyph_t *glyph) const
+    {
+        return spans + glyph->firstSpan;
+    }
+};
+
+#endif
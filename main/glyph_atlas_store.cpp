@@ -0,0 +1,74 @@
+#include "glyph_atlas_store.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+static const char *TAG = "GlyphAtlas";
+
+bool loadGlyphAtlases(GlyphAtlas atlases[GLYPH_ATLAS_COUNT])
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        static_cast<esp_partition_subtype_t>(GLYPH_ATLAS_PARTITION_SUBTYPE), GLYPH_ATLAS_PARTITION_NAME);
+    if (!partition) {
+        ESP_LOGI(TAG, "No glyph atlas partition");
+        return false;
+    }
+
+    // Mapped for the lifetime of the app: the atlases draw straight from the mapped spans, which
+    // saves the RAM and the boot time of copying them.
+    const void *mapped;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map the glyph atlas partition: %s", esp_err_to_name(err));
+        return false;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(mapped);
+
+    glyph_atlas_blob_header_t header;
+    memcpy(&header, bytes, sizeof(header));
+    if (header.magic != GLYPH_ATLAS_MAGIC) {
+        ESP_LOGI(TAG, "No glyph atlases flashed");
+        esp_partition_munmap(handle);
+        return false;
+    }
+    if (header.version != GLYPH_ATLAS_VERSION || header.atlasCount != GLYPH_ATLAS_COUNT || header.specHash != glyphAtlasSpecHash()) {
+        ESP_LOGW(TAG, "Flashed glyph atlases were built for other fonts");
+        esp_partition_munmap(handle);
+        return false;
+    }
+
+    // Validate every atlas before the first one is adopted, so a broken partition leaves all of
+    // them to be built at boot. The glyph tables are copied out, as they are not aligned in flash.
+    glyph_atlas_blob_atlas_t blobs[GLYPH_ATLAS_COUNT];
+    size_t spanOffsets[GLYPH_ATLAS_COUNT];
+    size_t offset = sizeof(header);
+    for (int i = 0; i < GLYPH_ATLAS_COUNT; i++) {
+        glyph_atlas_blob_atlas_t &blob = blobs[i];
+        bool valid = offset + sizeof(blob) <= partition->size;
+        if (valid) {
+            memcpy(&blob, bytes + offset, sizeof(blob));
+            offset += sizeof(blob);
+            valid = blob.spanCount > 0 && offset + blob.spanCount * sizeof(glyph_span_t) <= partition->size;
+        }
+        for (const glyph_t &glyph : blob.glyphs)
+            valid = valid && (!glyph.present || glyph.firstSpan + glyph.spanCount <= blob.spanCount);
+        if (!valid) {
+            ESP_LOGE(TAG, "Invalid glyph atlas %d", i);
+            esp_partition_munmap(handle);
+            return false;
+        }
+        spanOffsets[i] = offset;
+        offset += blob.spanCount * sizeof(glyph_span_t);
+    }
+
+    for (int i = 0; i < GLYPH_ATLAS_COUNT; i++) {
+        const glyph_atlas_spec_t &spec = GLYPH_ATLAS_SPECS[i];
+        const glyph_span_t *spans = reinterpret_cast<const glyph_span_t *>(bytes + spanOffsets[i]);
+        atlases[i].adopt(spec.font, spec.size, blobs[i].glyphs, spans, blobs[i].spanCount);
+    }
+    ESP_LOGI(TAG, "Mapped %d glyph atlases, %d bytes", GLYPH_ATLAS_COUNT, (int)offset);
+    return true;
+}
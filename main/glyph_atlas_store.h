@@ -0,0 +1,91 @@
+#ifndef S3DASH_GLYPH_ATLAS_STORE_H
+#define S3DASH_GLYPH_ATLAS_STORE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <LovyanGFX.h>
+#include "glyph_atlas.h"
+
+// Glyph atlases rasterized by tools/glyph_atlas_builder at build time live in their own data
+// partition, see partitions.csv. Builds with S3DASH_GLYPH_ATLAS_BUILDER flash them along with the app.
+#define GLYPH_ATLAS_PARTITION_NAME "glyphs"
+#define GLYPH_ATLAS_PARTITION_SUBTYPE 0x41
+#define GLYPH_ATLAS_PARTITION_SIZE 0x10000
+#define GLYPH_ATLAS_MAGIC 0x41473353 // "S3GA"
+#define GLYPH_ATLAS_VERSION 1
+#define GLYPH_ATLAS_COUNT 4
+
+/**
+ * A font and text size combination the views draw with.
+ */
+typedef struct {
+    // Name of the font, hashed instead of the font pointer.
+    const char *name;
+    const lgfx::IFont *font;
+    float size;
+    // Characters to rasterize, null for all characters an atlas can hold.
+    const char *charset;
+} glyph_atlas_spec_t;
+
+// Seven segment fonts only have digits.
+static const glyph_atlas_spec_t GLYPH_ATLAS_SPECS[GLYPH_ATLAS_COUNT] = {
+    {"DejaVu18", &fonts::DejaVu18, 1, nullptr},
+    {"DejaVu12", &fonts::DejaVu12, 1, nullptr},
+    {"Font7", &fonts::Font7, .55, "-0123456789"},
+    {"Font7", &fonts::Font7, .5, "-0123456789"},
+};
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t atlasCount;
+    // glyphAtlasSpecHash of the firmware the atlases were built for.
+    uint32_t specHash;
+} glyph_atlas_blob_header_t;
+
+/**
+ * An atlas as stored after the header, followed by its spanCount spans. Atlases follow each other
+ * in the order of GLYPH_ATLAS_SPECS.
+ */
+typedef struct {
+    uint16_t spanCount;
+    glyph_t glyphs[GLYPH_ATLAS_CHAR_COUNT];
+} glyph_atlas_blob_atlas_t;
+
+static_assert(sizeof(glyph_atlas_blob_header_t) == 12, "glyph atlas blobs must not depend on the compiler");
+static_assert(sizeof(glyph_atlas_blob_atlas_t) == 2 + 6 * GLYPH_ATLAS_CHAR_COUNT, "glyph atlas blobs must not depend on the compiler");
+
+/**
+ * FNV-1a hash of the atlas specs and the LovyanGFX version, so atlases built for other fonts, text
+ * sizes or rasterization are not loaded.
+ */
+inline uint32_t glyphAtlasSpecHash()
+{
+    uint32_t hash = 2166136261u;
+    auto mix = [&hash](const void *data, size_t length) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < length; i++)
+            hash = (hash ^ bytes[i]) * 16777619u;
+    };
+    const uint8_t version[3] = {LGFX_VERSION_MAJOR, LGFX_VERSION_MINOR, LGFX_VERSION_PATCH};
+    mix(version, sizeof(version));
+    for (const glyph_atlas_spec_t &spec : GLYPH_ATLAS_SPECS) {
+        uint16_t size = static_cast<uint16_t>(spec.size * 100 + .5f);
+        mix(spec.name, strlen(spec.name) + 1);
+        mix(&size, sizeof(size));
+        mix(spec.charset ? spec.charset : "", spec.charset ? strlen(spec.charset) + 1 : 1);
+    }
+    return hash;
+}
+
+/**
+ * Map the glyph atlas partition and point the atlases of GLYPH_ATLAS_SPECS at their spans in it. The
+ * partition stays mapped when they were loaded.
+ *
+ * @return false if the partition does not hold atlases built for this firmware, or they could not
+ *         be read.
+ */
+bool loadGlyphAtlases(GlyphAtlas atlases[GLYPH_ATLAS_COUNT]);
+
+#endif
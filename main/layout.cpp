@@ -0,0 +1,110 @@
+#include "layout.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "lcd_geometry.h"
+
+static const char *TAG = "Layout";
+
+static const int16_t SIGNAL_OFFSETS[DASH_SIGNAL_COUNT] = {
+    offsetof(dash_data_t, rpm),
+    offsetof(dash_data_t, oil_pressure0),
+    offsetof(dash_data_t, oil_pressure1),
+    offsetof(dash_data_t, oil_temp),
+    offsetof(dash_data_t, engine_coolant_temp),
+    offsetof(dash_data_t, throttle_per),
+    offsetof(dash_data_t, brake_per),
+    offsetof(dash_data_t, steering),
+};
+
+static const lgfx::IFont *FONTS[LAYOUT_FONT_COUNT] = {
+    &fonts::DejaVu18,
+    &fonts::DejaVu12,
+    &fonts::Font7,
+};
+
+bool Layout::compileWidget(const layout_blob_widget_t &blob, layout_widget_t *out)
+{
+    if (blob.type >= LAYOUT_WIDGET_TYPE_COUNT)
+        return false;
+    if (blob.signal >= DASH_SIGNAL_COUNT && (blob.signal != DASH_SIGNAL_NONE || blob.type != LAYOUT_LABEL))
+        return false;
+    if (blob.font >= LAYOUT_FONT_COUNT || (blob.flags & LAYOUT_FLAG_ALIGN_MASK) > 2)
+        return false;
+    if (blob.x < 0 || blob.y < 0 || blob.w < 0 || blob.h < 0 || blob.x + blob.w > LCD_H_RES || blob.y + blob.h > LCD_V_RES)
+        return false;
+    if (memchr(blob.text, 0, LAYOUT_TEXT_BYTES) == NULL)
+        return false;
+    if (blob.type == LAYOUT_BAR && blob.param <= 0)
+        return false;
+
+    out->type = static_cast<layout_widget_type_t>(blob.type);
+    out->align = blob.flags & LAYOUT_FLAG_ALIGN_MASK;
+    out->vertical = blob.flags & LAYOUT_FLAG_VERTICAL;
+    out->color = blob.color;
+    out->trackColor = blob.trackColor;
+    out->x = blob.x;
+    out->y = blob.y;
+    out->w = blob.w;
+    out->h = blob.h;
+    out->signalOffset = blob.signal < DASH_SIGNAL_COUNT ? SIGNAL_OFFSETS[blob.signal] : -1;
+    out->signal = blob.signal < DASH_SIGNAL_COUNT ? static_cast<dash_signal_t>(blob.signal) : DASH_SIGNAL_NONE;
+    out->font = FONTS[blob.font];
+    out->textSize = blob.textSize / 100.0f;
+    out->param = blob.param;
+    out->periodUs = blob.refreshHz ? 1000000 / blob.refreshHz : 0;
+    memcpy(out->text, blob.text, LAYOUT_TEXT_BYTES);
+    out->text[LAYOUT_TEXT_BYTES] = 0;
+    return true;
+}
+
+bool Layout::load()
+{
+    count = 0;
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        static_cast<esp_partition_subtype_t>(LAYOUT_PARTITION_SUBTYPE), LAYOUT_PARTITION_NAME);
+    if (!partition) {
+        ESP_LOGI(TAG, "No layout partition");
+        return false;
+    }
+
+    // A layout that can not be read is skipped like an invalid one, leaving the built in views.
+    layout_blob_header_t header;
+    esp_err_t err = esp_partition_read(partition, 0, &header, sizeof(header));
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read layout header: %s", esp_err_to_name(err));
+        return false;
+    }
+    if (header.magic != LAYOUT_MAGIC) {
+        ESP_LOGI(TAG, "No layout flashed");
+        return false;
+    }
+    if (header.version != LAYOUT_VERSION) {
+        ESP_LOGE(TAG, "Unsupported layout version %u", header.version);
+        return false;
+    }
+    if (header.widgetCount == 0 || header.widgetCount > LAYOUT_MAX_WIDGETS
+        || sizeof(header) + header.widgetCount * sizeof(layout_blob_widget_t) > partition->size) {
+        ESP_LOGE(TAG, "Invalid layout widget count %u, must be 1 to %d", header.widgetCount, LAYOUT_MAX_WIDGETS);
+        return false;
+    }
+
+    for (int i = 0; i < header.widgetCount; i++) {
+        layout_blob_widget_t blob;
+        err = esp_partition_read(partition, sizeof(header) + i * sizeof(blob), &blob, sizeof(blob));
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read layout widget %d: %s", i, esp_err_to_name(err));
+            return false;
+        }
+        if (!compileWidget(blob, &widgets[i])) {
+            ESP_LOGE(TAG, "Invalid layout widget %d", i);
+            return false;
+        }
+    }
+    count = header.widgetCount;
+    ESP_LOGI(TAG, "Loaded layout with %d widgets", count);
+    return true;
+}
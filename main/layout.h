@@ -0,0 +1,151 @@
+#ifndef S3DASH_LAYOUT_H
+#define S3DASH_LAYOUT_H
+
+#include <stdint.h>
+
+#include <LovyanGFX.h>
+#include "dash_data.h"
+
+// Layout blobs live in their own data partition, see partitions.csv. tools/layout_tool.py builds
+// and validates them.
+#define LAYOUT_PARTITION_NAME "layout"
+#define LAYOUT_PARTITION_SUBTYPE 0x40
+#define LAYOUT_MAGIC 0x4C443353 // "S3DL"
+#define LAYOUT_VERSION 1
+#define LAYOUT_MAX_WIDGETS 32
+#define LAYOUT_TEXT_BYTES 16
+
+typedef enum : uint8_t {
+    LAYOUT_LABEL,
+    LAYOUT_NUMBER,
+    LAYOUT_SEGMENT_NUMBER,
+    LAYOUT_BAR,
+    LAYOUT_SHIFT_LIGHT,
+    LAYOUT_WIDGET_TYPE_COUNT,
+} layout_widget_type_t;
+
+typedef enum : uint8_t {
+    LAYOUT_FONT_DEJAVU18,
+    LAYOUT_FONT_DEJAVU12,
+    LAYOUT_FONT_FONT7,
+    LAYOUT_FONT_COUNT,
+} layout_font_t;
+
+// Widget flags: text alignment in the two low bits (0 left, 1 right, 2 center), and the fill
+// direction of bars.
+#define LAYOUT_FLAG_ALIGN_MASK 0x03
+#define LAYOUT_FLAG_VERTICAL 0x04
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t widgetCount;
+} layout_blob_header_t;
+
+/**
+ * A widget as stored in a layout blob, little endian.
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t type;
+    // A dash_signal_t, DASH_SIGNAL_NONE for labels.
+    uint8_t signal;
+    uint8_t font;
+    uint8_t flags;
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+    // Text size in hundredths.
+    uint16_t textSize;
+    uint16_t color;
+    // Color of the empty part of bars.
+    uint16_t trackColor;
+    // Refresh rate of the widget's area, 0 to refresh it with the background.
+    uint16_t refreshHz;
+    // Bars: value of a full bar. Shift lights: RPM level the light turns on at.
+    int32_t param;
+    char text[LAYOUT_TEXT_BYTES];
+} layout_blob_widget_t;
+
+static_assert(sizeof(layout_blob_widget_t) == 40, "layout blob widget must match tools/layout_tool.py");
+
+/**
+ * A widget compiled for rendering: fonts resolved, the signal turned into an offset into dash_data_t.
+ */
+typedef struct {
+    layout_widget_type_t type;
+    uint8_t align;
+    bool vertical;
+    uint16_t color;
+    uint16_t trackColor;
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+    // Byte offset of the bound signal in dash_data_t, or -1.
+    int16_t signalOffset;
+    // The bound signal, or DASH_SIGNAL_NONE.
+    dash_signal_t signal;
+    const lgfx::IFont *font;
+    float textSize;
+    int32_t param;
+    int64_t periodUs;
+    char text[LAYOUT_TEXT_BYTES + 1];
+} layout_widget_t;
+
+/**
+ * A view layout loaded from flash and compiled into a flat widget array.
+ */
+class Layout
+{
+private:
+    layout_widget_t widgets[LAYOUT_MAX_WIDGETS];
+    int count = 0;
+
+public:
+    /**
+     * Validate and compile a single blob widget.
+     *
+     * @return false if the widget is invalid.
+     */
+    static bool compileWidget(const layout_blob_widget_t &blob, layout_widget_t *out);
+
+    /**
+     * Load and compile the layout blob from the layout partition.
+     *
+     * @return false if there is no valid layout, in which case the layout is empty.
+     */
+    bool load();
+
+    inline bool isLoaded() const
+    {
+        return count > 0;
+    }
+
+    inline int size() const
+    {
+        return count;
+    }
+
+    inline const layout_widget_t *getWidgets() const
+    {
+        return widgets;
+    }
+
+    /**
+     * Value of the signal a widget is bound to, 0 for unbound widgets.
+     */
+    static inline int signalValue(const layout_widget_t &widget, const dash_data_t *dash_data)
+    {
+        if (widget.signalOffset < 0)
+            return 0;
+        return *reinterpret_cast<const int *>(reinterpret_cast<const uint8_t *>(dash_data) + widget.signalOffset);
+    }
+
+    static inline bool signalStale(const layout_widget_t &widget, const dash_data_t *dash_data)
+    {
+        return widget.signal != DASH_SIGNAL_NONE && DashData::isStale(dash_data, widget.signal);
+    }
+};
+
+#endif
@@ -2,10 +2,7 @@
 #define S3DASH_LCD_H
 
 #include <LovyanGFX.h>
-
-#define LCD_H_RES 320
-#define LCD_V_RES 170
-#define UI_SAFE_ZONE_MARGIN 2
+#include "lcd_geometry.h"
 
 class LGFX : public lgfx::LGFX_Device
 {
@@ -0,0 +1,10 @@
+#ifndef S3DASH_LCD_GEOMETRY_H
+#define S3DASH_LCD_GEOMETRY_H
+
+// Screen size in the rotation the dash is drawn in. Kept apart from lcd.h so that code that only
+// needs the size does not depend on the panel driver.
+#define LCD_H_RES 320
+#define LCD_V_RES 170
+#define UI_SAFE_ZONE_MARGIN 2
+
+#endif
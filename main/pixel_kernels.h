@@ -0,0 +1,227 @@
+#ifndef S3DASH_PIXEL_KERNELS_H
+#define S3DASH_PIXEL_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+// Use the 128 bit PIE vector loads and stores of the ESP32-S3 for the bulk of each fill and copy.
+// Other targets and host builds use the scalar kernels, which produce the exact same bytes.
+#ifndef PIXEL_KERNELS_USE_PIE
+#if CONFIG_IDF_TARGET_ESP32S3
+#define PIXEL_KERNELS_USE_PIE 1
+#else
+#define PIXEL_KERNELS_USE_PIE 0
+#endif
+#endif
+
+/**
+ * Solid fills and copies of raw framebuffer memory. Pixel values are passed in framebuffer format,
+ * i.e. byte swapped RGB565 for 16 bit buffers and RGB332 for 8 bit buffers.
+ *
+ * The PIE kernels clobber q0. The ESP-IDF port does not give a guarantee that can be turned on in
+ * sdkconfig for the PIE registers the way it does for the FPU, so the kernels do not rely on them
+ * surviving a context switch: only the LCD task (core 1) and the render helper (core 0) call them,
+ * build_glyph_atlases and the benchmarks run before either is created, and nothing else in the
+ * firmware or in the ISRs uses PIE instructions. A task switched out in the middle of a kernel finds
+ * q0 as it left it. Keep it that way when calling a kernel from anywhere else.
+ */
+namespace PixelKernels
+{
+    inline void fill16Scalar(uint16_t *dst, uint16_t value, size_t count)
+    {
+        // Two pixels per store once dst is word aligned.
+        if (count && (reinterpret_cast<uintptr_t>(dst) & 2)) {
+            *dst++ = value;
+            count--;
+        }
+        uint32_t pair = value | static_cast<uint32_t>(value) << 16;
+        uint32_t *words = reinterpret_cast<uint32_t *>(dst);
+        for (size_t i = 0; i < count / 2; i++)
+            words[i] = pair;
+        if (count & 1)
+            dst[count - 1] = value;
+    }
+
+    inline void fill8Scalar(uint8_t *dst, uint8_t value, size_t count)
+    {
+        memset(dst, value, count);
+    }
+
+    inline void copyScalar(uint8_t *dst, const uint8_t *src, size_t bytes)
+    {
+        memcpy(dst, src, bytes);
+    }
+
+    /**
+     * Copy count 16 bit pixels, swapping the bytes of each, e.g. between framebuffer format and
+     * native RGB565. dst and src must not overlap.
+     */
+    inline void copySwap16Scalar(uint16_t *dst, const uint16_t *src, size_t count)
+    {
+        // Two pixels per load and store when both are word aligned.
+        if (count && (reinterpret_cast<uintptr_t>(dst) & 2) == (reinterpret_cast<uintptr_t>(src) & 2)) {
+            if (reinterpret_cast<uintptr_t>(dst) & 2) {
+                *dst++ = static_cast<uint16_t>(*src << 8 | *src >> 8);
+                src++;
+                count--;
+            }
+            uint32_t *words = reinterpret_cast<uint32_t *>(dst);
+            const uint32_t *pairs = reinterpret_cast<const uint32_t *>(src);
+            for (size_t i = 0; i < count / 2; i++) {
+                uint32_t pair = pairs[i];
+                words[i] = (pair & 0x00FF00FF) << 8 | (pair >> 8 & 0x00FF00FF);
+            }
+            dst += count & ~1;
+            src += count & ~1;
+            count &= 1;
+        }
+        for (size_t i = 0; i < count; i++)
+            dst[i] = static_cast<uint16_t>(src[i] << 8 | src[i] >> 8);
+    }
+
+#if PIXEL_KERNELS_USE_PIE
+    /**
+     * Store blocks times 16 bytes of the repeating pattern at dst, which must be 16 byte aligned.
+     * Clobbers q0.
+     */
+    inline void fillBlocksPie(void *dst, uint16_t pattern, size_t blocks)
+    {
+        asm volatile(
+            "ee.vldbc.16 q0, %[pattern]\n"
+            "loopnez %[blocks], 1f\n"
+            "ee.vst.128.ip q0, %[dst], 16\n"
+            "1:\n"
+            : [dst] "+r"(dst), [blocks] "+r"(blocks)
+            : [pattern] "r"(&pattern)
+            : "memory");
+    }
+
+    /**
+     * Copy blocks times 16 bytes from src to dst, which must both be 16 byte aligned. Clobbers q0.
+     */
+    inline void copyBlocksPie(void *dst, const void *src, size_t blocks)
+    {
+        asm volatile(
+            "loopnez %[blocks], 1f\n"
+            "ee.vld.128.ip q0, %[src], 16\n"
+            "ee.vst.128.ip q0, %[dst], 16\n"
+            "1:\n"
+            : [dst] "+r"(dst), [src] "+r"(src), [blocks] "+r"(blocks)
+            :
+            : "memory");
+    }
+
+    inline void fill16(uint16_t *dst, uint16_t value, size_t count)
+    {
+        // Scalar head up to the next 16 byte boundary. Framebuffers are at least 2 byte aligned.
+        size_t head = ((16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15) / 2;
+        if (count < head + 8) {
+            fill16Scalar(dst, value, count);
+            return;
+        }
+        fill16Scalar(dst, value, head);
+        dst += head;
+        count -= head;
+        fillBlocksPie(dst, value, count / 8);
+        fill16Scalar(dst + (count & ~7), value, count & 7);
+    }
+
+    inline void fill8(uint8_t *dst, uint8_t value, size_t count)
+    {
+        size_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+        if (count < head + 16) {
+            fill8Scalar(dst, value, count);
+            return;
+        }
+        fill8Scalar(dst, value, head);
+        dst += head;
+        count -= head;
+        fillBlocksPie(dst, value | value << 8, count / 16);
+        fill8Scalar(dst + (count & ~15), value, count & 15);
+    }
+
+    inline void copy(uint8_t *dst, const uint8_t *src, size_t bytes)
+    {
+        // The vector loads ignore the low address bits, so src and dst have to reach a 16 byte
+        // boundary together. Background and framebuffer rows at the same offset always do.
+        size_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+        if (((reinterpret_cast<uintptr_t>(dst) ^ reinterpret_cast<uintptr_t>(src)) & 15) || bytes < head + 16) {
+            copyScalar(dst, src, bytes);
+            return;
+        }
+        copyScalar(dst, src, head);
+        dst += head;
+        src += head;
+        bytes -= head;
+        copyBlocksPie(dst, src, bytes / 16);
+        copyScalar(dst + (bytes & ~15), src + (bytes & ~15), bytes & 15);
+    }
+#else
+    inline void fill16(uint16_t *dst, uint16_t value, size_t count)
+    {
+        fill16Scalar(dst, value, count);
+    }
+
+    inline void fill8(uint8_t *dst, uint8_t value, size_t count)
+    {
+        fill8Scalar(dst, value, count);
+    }
+
+    inline void copy(uint8_t *dst, const uint8_t *src, size_t bytes)
+    {
+        copyScalar(dst, src, bytes);
+    }
+#endif
+
+    // PIE has no byte shuffle cheaper than the two word operations per pixel pair of the scalar
+    // kernel, so all targets use it.
+    inline void copySwap16(uint16_t *dst, const uint16_t *src, size_t count)
+    {
+        copySwap16Scalar(dst, src, count);
+    }
+
+    /**
+     * Fill a rectangle of a framebuffer with rows of stride pixels. The rectangle must lie within the
+     * buffer. Full width rectangles are filled as a single span.
+     */
+    inline void fillRect16(uint16_t *buffer, int stride, int x, int y, int w, int h, uint16_t value)
+    {
+        uint16_t *line = buffer + y * stride + x;
+        if (w == stride) {
+            fill16(line, value, static_cast<size_t>(w) * h);
+            return;
+        }
+        for (int row = 0; row < h; row++, line += stride)
+            fill16(line, value, w);
+    }
+
+    inline void fillRect8(uint8_t *buffer, int stride, int x, int y, int w, int h, uint8_t value)
+    {
+        uint8_t *line = buffer + y * stride + x;
+        if (w == stride) {
+            fill8(line, value, static_cast<size_t>(w) * h);
+            return;
+        }
+        for (int row = 0; row < h; row++, line += stride)
+            fill8(line, value, w);
+    }
+
+    /**
+     * Copy a rectangle of bytesPerRow bytes per row between two buffers with rows of stride bytes,
+     * starting at offset in both. Full width rectangles are copied as a single span.
+     */
+    inline void copyRect(uint8_t *dst, const uint8_t *src, int stride, int offset, int bytesPerRow, int h)
+    {
+        if (bytesPerRow == stride) {
+            copy(dst + offset, src + offset, static_cast<size_t>(stride) * h);
+            return;
+        }
+        for (int row = 0; row < h; row++, offset += stride)
+            copy(dst + offset, src + offset, bytesPerRow);
+    }
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef S3DASH_REGION_SCHEDULER_H
+#define S3DASH_REGION_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "damage.h"
+
+#define REGION_SCHEDULER_MAX_REGIONS 8
+
+// Shift lights and pedal bars.
+#define REGION_PERIOD_FAST_US (1000000 / 125)
+// Hero values.
+#define REGION_PERIOD_MEDIUM_US (1000000 / 50)
+// Temperatures, steering, labels and everything not covered by a region.
+#define REGION_PERIOD_SLOW_US (1000000 / 10)
+
+/**
+ * Decides which parts of the screen get pushed on a given frame.
+ *
+ * Views register screen regions with the period they need to be refreshed at. A tile belongs to
+ * the first registered region that covers it, and tiles not covered by any region belong to the
+ * background. On every frame only the regions whose deadline has passed are pushed, so time
+ * critical regions get most of the bus bandwidth while slow moving values wait their turn.
+ */
+class RegionScheduler
+{
+private:
+    typedef struct {
+        tile_mask_t tiles;
+        int64_t periodUs;
+        int64_t deadlineUs;
+    } region_t;
+
+    // Index 0 is the background.
+    region_t regions[REGION_SCHEDULER_MAX_REGIONS + 1];
+    int count = 0;
+
+public:
+    RegionScheduler()
+    {
+        reset(REGION_PERIOD_SLOW_US);
+    }
+
+    /**
+     * Drop all regions. The whole screen becomes background, refreshed at the given period, and is
+     * due immediately.
+     */
+    inline void reset(int64_t backgroundPeriodUs)
+    {
+        regions[0].tiles.set();
+        regions[0].periodUs = backgroundPeriodUs;
+        regions[0].deadlineUs = 0;
+        count = 1;
+    }
+
+    /**
+     * Register a region refreshed at the given period. Tiles already claimed by an earlier region
+     * stay with that region, so faster regions should be added first.
+     */
+    inline void add(int x, int y, int w, int h, int64_t periodUs)
+    {
+        if (count > REGION_SCHEDULER_MAX_REGIONS)
+            return;
+        tile_mask_t tiles = damageTilesForRect(x, y, w, h) & regions[0].tiles;
+        regions[0].tiles &= ~tiles;
+        regions[count].tiles = tiles;
+        regions[count].periodUs = periodUs;
+        regions[count].deadlineUs = 0;
+        count++;
+    }
+
+    /**
+     * Return the tiles of every region whose deadline has passed, and move those deadlines one
+     * period past now.
+     */
+    inline tile_mask_t due(int64_t nowUs)
+    {
+        tile_mask_t tiles;
+        for (int i = 0; i < count; i++) {
+            if (nowUs >= regions[i].deadlineUs) {
+                tiles |= regions[i].tiles;
+                regions[i].deadlineUs = nowUs + regions[i].periodUs;
+            }
+        }
+        return tiles;
+    }
+
+    /**
+     * Return the earliest deadline of all regions.
+     */
+    inline int64_t nextDeadline() const
+    {
+        int64_t deadline = regions[0].deadlineUs;
+        for (int i = 1; i < count; i++)
+            deadline = std::min(deadline, regions[i].deadlineUs);
+        return deadline;
+    }
+};
+
+#endif
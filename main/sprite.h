@@ -3,10 +3,399 @@
 
 #include <LovyanGFX.h>
 #include "color.h"
+#include "damage.h"
+#include "display_list.h"
+#include "frame_handoff.h"
+#include "glyph_atlas.h"
+#include "pixel_kernels.h"
+
+#define SPRITE_MAX_GLYPH_ATLASES 8
+// Digits of the longest int, plus the minus sign.
+#define SPRITE_SEGMENT_MAX_GLYPHS 11
+// Characters formatNumber writes at most, including the terminating null.
+#define SPRITE_NUMBER_BYTES (SPRITE_SEGMENT_MAX_GLYPHS + 1)
 
 class Sprite: public LGFX_Sprite
 {
+private:
+    DamageTracker damage;
+    FrameHandoff handoff;
+    // 16 for RGB565 framebuffers, 8 for RGB332 framebuffers expanded through colorLut at push time.
+    int bitsPerPixel = 16;
+    // RGB565 color shown for each RGB332 value, stored byte swapped in panel order.
+    uint16_t colorLut[256];
+    int bandY = 0;
+    tile_mask_t bandTiles = tile_mask_t().set();
+    const GlyphAtlas *glyphAtlases[SPRITE_MAX_GLYPH_ATLASES];
+    int glyphAtlasCount = 0;
+    // Full frame image of the static parts of the current view, copied in at the start of a frame.
+    uint8_t *background = nullptr;
+    bool backgroundValid = false;
+    bool capturingBackground = false;
+    void *capturedBuffer = nullptr;
+    uint32_t backgroundHashes[DAMAGE_TILE_COUNT];
+    // Retained mode: the list being recorded, and the list last rendered into each framebuffer.
+    DisplayList *recordingList = nullptr;
+    DisplayList *renderedLists[2] = {nullptr, nullptr};
+    bool renderedListValid[2] = {false, false};
+    bool recording = false;
+    // Set when a draw call that can not be recorded was made while recording.
+    bool recordingFailed = false;
+
+    inline bool tracksDamage() const
+    {
+        // In band mode the whole band is already marked by beginBand, and the background is not
+        // on the panel until it is restored.
+        return !isBanded() && !capturingBackground;
+    }
+
+    inline void touch(int x, int y, int w, int h)
+    {
+        if (tracksDamage())
+            damage.touch(x, y, w, h);
+    }
+
+    inline void touchText(int left, int y, size_t width)
+    {
+        // Glyphs can overhang their advance width by a pixel on either side.
+        touch(left - 1, y, width + 2, this->fontHeight());
+    }
+
+    inline int getRowBytes() const
+    {
+        return LCD_H_RES * bitsPerPixel / 8;
+    }
+
+    static inline uint8_t toRgb332(uint16_t rgb565)
+    {
+        // Same truncation LovyanGFX applies when drawing into an 8 bit sprite.
+        return ((rgb565 >> 8) & 0xE0) | ((rgb565 >> 6) & 0x1C) | ((rgb565 >> 3) & 0x03);
+    }
+
+    static inline uint16_t swapBytes(uint16_t value)
+    {
+        return (value >> 8) | (value << 8);
+    }
+
+    /**
+     * Fill a rectangle of the framebuffer straight through the pixel kernels, clipped to the clip
+     * rect. Damage is not recorded.
+     */
+    inline void fillSolid(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t rgb565)
+    {
+        if (w < 0) {
+            x += w;
+            w = -w;
+        }
+        if (h < 0) {
+            y += h;
+            h = -h;
+        }
+        int32_t clipX, clipY, clipW, clipH;
+        this->getClipRect(&clipX, &clipY, &clipW, &clipH);
+        int32_t x0 = std::max(x, clipX);
+        int32_t y0 = std::max(y, clipY);
+        int32_t x1 = std::min(x + w, clipX + clipW);
+        int32_t y1 = std::min(y + h, clipY + clipH);
+        void *buffer = this->getBuffer();
+        if (x0 >= x1 || y0 >= y1 || !buffer)
+            return;
+        if (bitsPerPixel == 16)
+            PixelKernels::fillRect16(static_cast<uint16_t *>(buffer), LCD_H_RES, x0, y0, x1 - x0, y1 - y0, swapBytes(rgb565));
+        else
+            PixelKernels::fillRect8(static_cast<uint8_t *>(buffer), LCD_H_RES, x0, y0, x1 - x0, y1 - y0, toRgb332(rgb565));
+    }
+
+    /**
+     * Return the atlas holding the current font and text size, or null if there is none or the text
+     * style can not be drawn from an atlas.
+     */
+    inline const GlyphAtlas *findGlyphAtlas() const
+    {
+        const lgfx::TextStyle &style = this->getTextStyle();
+        // Atlases only hold the set pixels, so text with a background and datums other than top
+        // aligned go through LovyanGFX.
+        if (style.fore_rgb888 != style.back_rgb888 || style.size_x != style.size_y || (style.datum & ~3) != 0)
+            return nullptr;
+        for (int i = 0; i < glyphAtlasCount; i++) {
+            if (glyphAtlases[i]->matches(this->getFont(), style.size_x))
+                return glyphAtlases[i];
+        }
+        return nullptr;
+    }
+
+    /**
+     * Draw string from an atlas with its top left corner at x, y, in the current text color and
+     * clipped to the clip rect. Damage is not recorded.
+     */
+    inline void drawAtlasString(const GlyphAtlas *atlas, const char *string, int32_t x, int32_t y)
+    {
+        void *buffer = this->getBuffer();
+        if (!buffer)
+            return;
+        uint32_t rgb888 = this->getTextStyle().fore_rgb888;
+        uint16_t rgb565 = lgfx::color565(rgb888 >> 16, rgb888 >> 8, rgb888);
+        int32_t clipX, clipY, clipW, clipH;
+        this->getClipRect(&clipX, &clipY, &clipW, &clipH);
+        for (const char *c = string; *c; c++) {
+            const glyph_t *glyph = atlas->find(*c);
+            const glyph_span_t *spans = atlas->getSpans(glyph);
+            for (int i = 0; i < glyph->spanCount; i++) {
+                int32_t sy = y + spans[i].dy;
+                int32_t x0 = std::max(x + spans[i].dx, clipX);
+                int32_t x1 = std::min(x + spans[i].dx + spans[i].w, clipX + clipW);
+                if (sy < clipY || sy >= clipY + clipH || x0 >= x1)
+                    continue;
+                if (bitsPerPixel == 16)
+                    PixelKernels::fill16(static_cast<uint16_t *>(buffer) + sy * LCD_H_RES + x0, swapBytes(rgb565), x1 - x0);
+                else
+                    PixelKernels::fill8(static_cast<uint8_t *>(buffer) + sy * LCD_H_RES + x0, toRgb332(rgb565), x1 - x0);
+            }
+            x += glyph->advance;
+        }
+    }
+
+    /**
+     * Draw string aligned to x by the given fraction of its width (0 left, 2 center, 1 right) from a
+     * glyph atlas if one holds it, or through LovyanGFX otherwise.
+     *
+     * @return the width of the string.
+     */
+    inline size_t drawAlignedString(const char *string, int32_t x, int32_t y, int alignDivisor)
+    {
+        const GlyphAtlas *atlas = findGlyphAtlas();
+        int width;
+        if (!atlas || !atlas->measure(string, &width)) {
+            switch (alignDivisor) {
+            case 0:
+                return LGFX_Sprite::drawString(string, x, y);
+            case 1:
+                return LGFX_Sprite::drawRightString(string, x, y);
+            default:
+                return LGFX_Sprite::drawCenterString(string, x, y);
+            }
+        }
+        drawAtlasString(atlas, string, alignDivisor ? x - width / alignDivisor : x, y);
+        return width;
+    }
+
+    /**
+     * Width the given string would be drawn with in the current text style.
+     */
+    inline int measureString(const char *string)
+    {
+        const GlyphAtlas *atlas = findGlyphAtlas();
+        int width;
+        if (atlas && atlas->measure(string, &width))
+            return width;
+        return this->textWidth(string);
+    }
+
+    inline void recordFill(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color)
+    {
+        display_command_t *command = recordingList->add();
+        if (!command)
+            return;
+        command->type = DISPLAY_FILL_RECT;
+        command->color = color;
+        command->x = x;
+        command->y = y;
+        command->w = w;
+        command->h = h;
+        command->bounds = {std::min(x, x + w), std::min(y, y + h), std::abs(w), std::abs(h)};
+    }
+
+    /**
+     * Record a string drawn aligned as for drawAlignedString, in the current text style.
+     *
+     * @return the width of the string.
+     */
+    inline size_t recordText(const char *string, int32_t x, int32_t y, int alignDivisor)
+    {
+        int width = measureString(string);
+        display_command_t *command = recordingList->add(string);
+        if (!command)
+            return width;
+        const lgfx::TextStyle &style = this->getTextStyle();
+        command->type = DISPLAY_TEXT;
+        command->align = alignDivisor;
+        command->datum = style.datum;
+        command->x = x;
+        command->y = y;
+        command->font = this->getFont();
+        command->sizeX = style.size_x;
+        command->sizeY = style.size_y;
+        command->foreRgb888 = style.fore_rgb888;
+        command->backRgb888 = style.back_rgb888;
+        // Same area touchText marks.
+        int left = alignDivisor ? x - width / alignDivisor : x;
+        command->bounds = {left - 1, y, width + 2, this->fontHeight()};
+        return width;
+    }
+
+    /**
+     * Redraw the commands of the recorded list that intersect the clip rect, over the background.
+     */
+    inline void replay(const rect_t &clip)
+    {
+        this->setClipRect(clip.x, clip.y, clip.w, clip.h);
+        if (!copyBackground())
+            fillSolid(clip.x, clip.y, clip.w, clip.h, 0);
+        char text[DISPLAY_LIST_TEXT_BYTES + 1];
+        for (int i = 0; i < recordingList->size(); i++) {
+            const display_command_t &command = recordingList->get(i);
+            const rect_t &b = command.bounds;
+            if (b.x >= clip.x + clip.w || b.x + b.w <= clip.x || b.y >= clip.y + clip.h || b.y + b.h <= clip.y)
+                continue;
+            switch (command.type) {
+            case DISPLAY_FILL_RECT:
+                fillSolid(command.x, command.y, command.w, command.h, command.color);
+                break;
+            case DISPLAY_TEXT:
+                recordingList->getText(i, text);
+                this->setFont(command.font);
+                this->setTextSize(command.sizeX, command.sizeY);
+                this->setTextColor(command.foreRgb888, command.backRgb888);
+                this->setTextDatum(static_cast<lgfx::textdatum_t>(command.datum));
+                drawAlignedString(text, command.x, command.y, command.align);
+                break;
+            case DISPLAY_SEGMENT_NUMBER:
+                drawRightSegmentNumber(command.value, command.x, command.y, command.h, command.color);
+                break;
+            }
+        }
+        this->clearClipRect();
+    }
+
+    /**
+     * Copy the background over the clip rect.
+     *
+     * @return false if there is no background.
+     */
+    inline bool copyBackground()
+    {
+        uint8_t *buffer = static_cast<uint8_t *>(this->getBuffer());
+        if (!backgroundValid || !buffer)
+            return false;
+        int32_t clipX, clipY, clipW, clipH;
+        this->getClipRect(&clipX, &clipY, &clipW, &clipH);
+        int rowBytes = getRowBytes();
+        int offset = clipY * rowBytes + clipX * bitsPerPixel / 8;
+        PixelKernels::copyRect(buffer, background, rowBytes, offset, clipW * bitsPerPixel / 8, clipH);
+        return true;
+    }
+
 public:
+    Sprite()
+    {
+        resetColorLut();
+    }
+
+    using LGFX_Sprite::fillRect;
+    using LGFX_Sprite::fillScreen;
+    using LGFX_Sprite::drawString;
+    using LGFX_Sprite::drawRightString;
+    using LGFX_Sprite::drawCenterString;
+
+    inline void fillScreen()
+    {
+        if (recording) {
+            recordingFailed = true;
+            return;
+        }
+        LGFX_Sprite::fillScreen();
+        if (tracksDamage())
+            damage.clear(false);
+    }
+
+    template<typename T>
+    inline void fillScreen(const T& color)
+    {
+        if (recording) {
+            // Only black, which is zero in every color format, can be recorded.
+            if (color == 0)
+                recordFill(0, 0, LCD_H_RES, LCD_V_RES, 0);
+            else
+                recordingFailed = true;
+            return;
+        }
+        if (color == 0)
+            fillSolid(0, 0, LCD_H_RES, LCD_V_RES, 0);
+        else
+            LGFX_Sprite::fillScreen(color);
+        if (tracksDamage())
+            damage.clear(color == 0);
+    }
+
+    inline void fillScreen(uint16_t color)
+    {
+        if (recording) {
+            recordFill(0, 0, LCD_H_RES, LCD_V_RES, color);
+            return;
+        }
+        fillSolid(0, 0, LCD_H_RES, LCD_V_RES, color);
+        if (tracksDamage())
+            damage.clear(color == 0);
+    }
+
+    inline void fillRect(int32_t x, int32_t y, int32_t w, int32_t h)
+    {
+        if (recording) {
+            recordingFailed = true;
+            return;
+        }
+        LGFX_Sprite::fillRect(x, y, w, h);
+        touch(x, y, w, h);
+    }
+
+    template<typename T>
+    inline void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, const T& color)
+    {
+        if (recording) {
+            recordingFailed = true;
+            return;
+        }
+        LGFX_Sprite::fillRect(x, y, w, h, color);
+        touch(x, y, w, h);
+    }
+
+    inline void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t color)
+    {
+        if (recording) {
+            recordFill(x, y, w, h, color);
+            return;
+        }
+        fillSolid(x, y, w, h, color);
+        touch(x, y, w, h);
+    }
+
+    inline size_t drawString(const char *string, int32_t x, int32_t y)
+    {
+        if (recording)
+            return recordText(string, x, y, 0);
+        size_t width = drawAlignedString(string, x, y, 0);
+        touchText(x, y, width);
+        return width;
+    }
+
+    inline size_t drawRightString(const char *string, int32_t x, int32_t y)
+    {
+        if (recording)
+            return recordText(string, x, y, 1);
+        size_t width = drawAlignedString(string, x, y, 1);
+        touchText(x - width, y, width);
+        return width;
+    }
+
+    inline size_t drawCenterString(const char *string, int32_t x, int32_t y)
+    {
+        if (recording)
+            return recordText(string, x, y, 2);
+        size_t width = drawAlignedString(string, x, y, 2);
+        touchText(x - width / 2, y, width);
+        return width;
+    }
+
     inline void progressBarFromBottom(int x, int y, int width, int height, double percent, uint16_t color)
     {
         int computed_height = percent * height;
@@ -19,9 +408,436 @@ public:
         this->fillRect(x, y, width * percent, height, color);
     }
 
+    /**
+     * Write value in decimal into out, which must hold SPRITE_NUMBER_BYTES characters. Unlike
+     * std::to_string or snprintf it never allocates.
+     *
+     * @return out.
+     */
+    static inline char *formatNumber(int value, char *out)
+    {
+        char *end = out + SPRITE_NUMBER_BYTES - 1;
+        char *c = end;
+        *c = 0;
+        unsigned int remaining = value < 0 ? 0u - static_cast<unsigned int>(value) : value;
+        do {
+            *--c = '0' + remaining % 10;
+            remaining /= 10;
+        } while (remaining);
+        if (value < 0)
+            *--c = '-';
+        memmove(out, c, end - c + 1);
+        return out;
+    }
+
     inline void drawRightNumber(int value, int x, int y)
     {
-        this->drawRightString(std::to_string(value).c_str(), x, y);
+        char text[SPRITE_NUMBER_BYTES];
+        this->drawRightString(formatNumber(value, text), x, y);
+    }
+
+    /**
+     * Width of a seven segment digit of the given height, and the distance between two digits.
+     */
+    static inline int segmentDigitWidth(int height)
+    {
+        return height / 2;
+    }
+
+    static inline int segmentAdvance(int height)
+    {
+        return segmentDigitWidth(height) + 2 * std::max(1, height / 10);
+    }
+
+    /**
+     * Draw value right aligned to right as seven segment digits of the given pixel height, each
+     * segment a solid rectangle. The box of every glyph drawn, rightmost first, is written to boxes
+     * when it is not null; it must hold SPRITE_SEGMENT_MAX_GLYPHS entries.
+     *
+     * @return the number of glyphs drawn.
+     */
+    inline int drawRightSegmentNumber(int value, int32_t right, int32_t y, int height, uint16_t color, rect_t *boxes = nullptr)
+    {
+        // Bits a to g: top, upper right, lower right, bottom, lower left, upper left, middle.
+        static const uint8_t DIGIT_SEGMENTS[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+        static const uint8_t MINUS_SEGMENTS = 0x40;
+        int w = segmentDigitWidth(height);
+        int t = std::max(1, height / 10);
+        // Middle segment rows, and the height of the vertical segments above and below it.
+        int middleTop = height / 2 - t / 2;
+        int upper = middleTop - t;
+        int lower = height - t - (middleTop + t);
+
+        display_command_t *command = nullptr;
+        if (recording && (command = recordingList->add())) {
+            command->type = DISPLAY_SEGMENT_NUMBER;
+            command->color = color;
+            command->x = right;
+            command->y = y;
+            command->h = height;
+            command->value = value;
+        }
+
+        unsigned int remaining = value < 0 ? 0u - static_cast<unsigned int>(value) : value;
+        bool minus = value < 0;
+        int32_t x = right - w;
+        int glyphs = 0;
+        do {
+            uint8_t segments;
+            if (remaining || glyphs == 0) {
+                segments = DIGIT_SEGMENTS[remaining % 10];
+                remaining /= 10;
+            } else {
+                segments = MINUS_SEGMENTS;
+                minus = false;
+            }
+            if (!recording) {
+                if (segments & 0x01) fillSolid(x + t, y, w - 2 * t, t, color);
+                if (segments & 0x02) fillSolid(x + w - t, y + t, t, upper, color);
+                if (segments & 0x04) fillSolid(x + w - t, y + middleTop + t, t, lower, color);
+                if (segments & 0x08) fillSolid(x + t, y + height - t, w - 2 * t, t, color);
+                if (segments & 0x10) fillSolid(x, y + middleTop + t, t, lower, color);
+                if (segments & 0x20) fillSolid(x, y + t, t, upper, color);
+                if (segments & 0x40) fillSolid(x + t, y + middleTop, w - 2 * t, t, color);
+                touch(x, y, w, height);
+            }
+            if (boxes)
+                boxes[glyphs] = {x, y, w, height};
+            glyphs++;
+            x -= segmentAdvance(height);
+        } while (remaining || minus);
+        if (command)
+            command->bounds = {x + segmentAdvance(height), y, right - x - segmentAdvance(height), height};
+        return glyphs;
+    }
+
+    /**
+     * Draw text in the atlas's font and size from the atlas from now on. The atlas must outlive the
+     * sprite.
+     */
+    inline void addGlyphAtlas(const GlyphAtlas *atlas)
+    {
+        if (glyphAtlasCount < SPRITE_MAX_GLYPH_ATLASES)
+            glyphAtlases[glyphAtlasCount++] = atlas;
+    }
+
+    /**
+     * Attach the framebuffers to render into. With a second buffer the sprite works in ping-pong
+     * mode: pushDirty starts a DMA transfer of the buffer that was just rendered and switches
+     * drawing to the other one, so the next frame is rendered while the previous one is streamed.
+     */
+    inline void setFrameBuffers(void *first, void *second, int bpp)
+    {
+        handoff.attach(first, second, bpp);
+        bitsPerPixel = bpp;
+        bandTiles.set();
+        damage.setBitsPerPixel(bpp);
+        damage.select(handoff.getBackIndex());
+        this->setBuffer(first, LCD_H_RES, LCD_V_RES, bpp);
+    }
+
+    /**
+     * Attach two band buffers of LCD_H_RES x height pixels instead of full framebuffers. A frame is
+     * then rendered band by band: for every band the view is drawn again, clipped to the band, and
+     * the band is pushed over DMA while the next one is rasterized into the other buffer. The
+     * height must be a multiple of DAMAGE_TILE_H.
+     */
+    inline void setBandBuffers(void *first, void *second, int height, int bpp)
+    {
+        handoff.attach(first, second, bpp, height);
+        bitsPerPixel = bpp;
+        damage.setBitsPerPixel(bpp);
+        // Band buffers do not keep their content between frames, so staleness is tracked against
+        // the panel only.
+        damage.select(0);
+    }
+
+    /**
+     * Draw into the current framebuffer of another sprite, e.g. to rasterize part of a frame on
+     * another core. Damage is only tracked by the owner, which is expected to issue the same draw
+     * calls clipped to the rest of the frame. Resets the clip rect.
+     */
+    inline void shareBuffer(Sprite *owner)
+    {
+        bitsPerPixel = owner->bitsPerPixel;
+        background = owner->background;
+        backgroundValid = owner->backgroundValid;
+        this->setBuffer(owner->getBuffer(), LCD_H_RES, LCD_V_RES, bitsPerPixel);
+    }
+
+    /**
+     * Attach a full frame buffer, in the pixel format of the framebuffers, to cache the static parts
+     * of a view in. It does not need to be DMA capable.
+     */
+    inline void setBackgroundBuffer(void *buffer)
+    {
+        background = static_cast<uint8_t *>(buffer);
+        backgroundValid = false;
+    }
+
+    /**
+     * Redirect drawing into the background buffer, cleared to black, until endBackground. Draw
+     * calls in between are not recorded as damage.
+     *
+     * @return false if there is no background buffer.
+     */
+    inline bool beginBackground()
+    {
+        if (!background)
+            return false;
+        capturedBuffer = this->getBuffer();
+        backgroundValid = false;
+        capturingBackground = true;
+        this->setBuffer(background, LCD_H_RES, LCD_V_RES, bitsPerPixel);
+        fillSolid(0, 0, LCD_H_RES, LCD_V_RES, 0);
+        return true;
+    }
+
+    /**
+     * Make the image drawn since beginBackground the background of following frames, and draw
+     * into the framebuffer again.
+     */
+    inline void endBackground()
+    {
+        capturingBackground = false;
+        damage.hashFrame(background, backgroundHashes);
+        backgroundValid = true;
+        invalidateDisplayLists();
+        this->setBuffer(capturedBuffer, LCD_H_RES, LCD_V_RES, bitsPerPixel);
+    }
+
+    /**
+     * Copy the background over the clip rect, replacing the clear at the start of a frame.
+     *
+     * @return false if there is no background, in which case the view has to draw it itself.
+     */
+    inline bool restoreBackground()
+    {
+        // Recorded frames are replayed over the background.
+        if (recording)
+            return backgroundValid;
+        if (!copyBackground())
+            return false;
+        if (tracksDamage())
+            damage.restore(backgroundHashes);
+        return true;
+    }
+
+    inline bool isBanded() const
+    {
+        return handoff.isBanded();
+    }
+
+    /**
+     * Number of times a view has to be rendered to produce one frame.
+     */
+    inline int getBandCount() const
+    {
+        return isBanded() ? (LCD_V_RES + handoff.getBandHeight() - 1) / handoff.getBandHeight() : 1;
+    }
+
+    /**
+     * Prepare drawing of the given band. Band 0 starts a new frame. In full frame mode there is a
+     * single band covering the screen and only the per frame statistics are reset.
+     */
+    inline void beginBand(int band)
+    {
+        if (band == 0)
+            handoff.resetStats();
+        if (!isBanded())
+            return;
+        bandY = band * handoff.getBandHeight();
+        int height = std::min(handoff.getBandHeight(), LCD_V_RES - bandY);
+        // Point the sprite at the band buffer as if it was a full framebuffer shifted up by bandY,
+        // and clip to the band so that views keep drawing in screen coordinates and only the
+        // pixels of the band are ever written.
+        this->setBuffer(handoff.getBackBuffer() - bandY * getRowBytes(), LCD_H_RES, LCD_V_RES, bitsPerPixel);
+        this->setClipRect(0, bandY, LCD_H_RES, height);
+        // The buffer still holds the previous band, so every tile of the band has to be cleared
+        // and compared against the panel.
+        fillSolid(0, 0, LCD_H_RES, LCD_V_RES, 0);
+        bandTiles = damageTilesForRect(0, bandY, LCD_H_RES, height);
+        damage.touch(0, bandY, LCD_H_RES, height);
+    }
+
+    inline bool isDoubleBuffered() const
+    {
+        return handoff.isDoubleBuffered();
+    }
+
+    inline int getFrameBufferBytes() const
+    {
+        int rows = isBanded() ? handoff.getBandHeight() : LCD_V_RES;
+        return (isDoubleBuffered() ? 2 : 1) * rows * getRowBytes();
+    }
+
+    /**
+     * Whether setThemeColor has an effect, i.e. the framebuffers are 8 bit.
+     */
+    inline bool hasThemeColors() const
+    {
+        return bitsPerPixel == 8;
+    }
+
+    /**
+     * Show every pixel drawn in the given color as displayed instead. Only affects 8 bit
+     * framebuffers, where it is applied at push time, so a theme change needs no redraw: the tiles
+     * of the framebuffer holding the color are pushed again as they are, along with the next frame.
+     * Band buffers do not hold the frame, so in band mode every tile is.
+     */
+    inline void setThemeColor(uint16_t color, uint16_t displayed)
+    {
+        uint8_t index = toRgb332(color);
+        if (!hasThemeColors() || colorLut[index] == swapBytes(displayed))
+            return;
+        colorLut[index] = swapBytes(displayed);
+        const uint8_t *buffer = static_cast<const uint8_t *>(this->getBuffer());
+        if (isBanded() || !buffer)
+            damage.force(tile_mask_t().set());
+        else
+            damage.force(damageTilesWithValue(buffer, index));
+    }
+
+    /**
+     * Map every RGB332 value back to RGB565. The colors from color.h map back to their exact value.
+     */
+    inline void resetColorLut()
+    {
+        for (int i = 0; i < 256; i++) {
+            uint16_t r = (i >> 5) & 0x07;
+            uint16_t g = (i >> 2) & 0x07;
+            uint16_t b = i & 0x03;
+            uint16_t rgb565 = ((r << 2 | r >> 1) << 11) | ((g << 3 | g) << 5) | (b << 3 | b << 1 | b >> 1);
+            colorLut[i] = swapBytes(rgb565);
+        }
+        for (int i = 0; i < Color::PALETTE_SIZE; i++)
+            colorLut[toRgb332(Color::PALETTE[i])] = swapBytes(Color::PALETTE[i]);
+        colorLut[toRgb332(Color::COLOR_ALARM_BACKGROUND)] = swapBytes(Color::COLOR_BLACK);
+        colorLut[toRgb332(Color::COLOR_ALARM_VALUE)] = swapBytes(Color::COLOR_WHITE);
+        damage.invalidate();
+    }
+
+    /**
+     * Push only the parts of the sprite that changed since the last push. Each changed rectangle is
+     * sent as its own window by clipping the destination, so the bus only carries changed pixels.
+     *
+     * Single buffered, the function will block until all data are written. Double buffered, it
+     * only waits for the transfer of the previous frame, which is the buffer drawn into next, and
+     * returns while the DMA transfer of this frame is still running. The destination must be kept
+     * in a write transaction (startWrite) so the transfer is not waited on at endWrite.
+     *
+     * Only tiles in allowed are pushed, the others stay dirty until a later push allows them. In
+     * band mode only the tiles of the current band are pushed.
+     */
+    template<typename Display>
+    inline void pushDirty(Display *dst, const tile_mask_t &allowed = tile_mask_t().set())
+    {
+        // The sprite stores 16 bit pixels byte swapped, in the order the panel expects them.
+        handoff.push<lgfx::swap565_t>(dst, static_cast<const uint8_t *>(this->getBuffer()), damage, allowed & bandTiles, colorLut);
+        if (isDoubleBuffered() && !isBanded())
+            this->setBuffer(handoff.getBackBuffer(), LCD_H_RES, LCD_V_RES, bitsPerPixel);
+    }
+
+    /**
+     * Force the next pushDirty to send the whole frame, e.g. after something else drew on the panel.
+     */
+    inline void invalidate()
+    {
+        damage.invalidate();
+    }
+
+    /**
+     * Attach the three display lists retained mode needs: one to record into, and one per
+     * framebuffer holding what was last rendered into it.
+     */
+    inline void setDisplayLists(DisplayList *lists)
+    {
+        recordingList = &lists[0];
+        renderedLists[0] = &lists[1];
+        renderedLists[1] = &lists[2];
+        invalidateDisplayLists();
+    }
+
+    /**
+     * Forget what the framebuffers hold, so the next recorded frame is redrawn completely.
+     */
+    inline void invalidateDisplayLists()
+    {
+        renderedListValid[0] = false;
+        renderedListValid[1] = false;
+    }
+
+    /**
+     * Record draw calls into a display list instead of drawing them, until endRecording. Only full
+     * frame rendering retains framebuffer content between frames, so bands can not be recorded.
+     *
+     * @return false if retained mode is not available.
+     */
+    inline bool beginRecording()
+    {
+        if (!recordingList || isBanded())
+            return false;
+        recordingList->clear();
+        recording = true;
+        recordingFailed = false;
+        return true;
+    }
+
+    /**
+     * Compare the recorded list against the one last rendered into the current framebuffer, and
+     * redraw only the tiles covered by commands that changed. The tiles are recorded as damage.
+     *
+     * @return false if the frame could not be recorded completely and nothing was drawn, in which case
+     * it has to be drawn in immediate mode.
+     */
+    inline bool endRecording()
+    {
+        recording = false;
+        int backBuffer = handoff.getBackIndex();
+        if (recordingFailed || recordingList->hasOverflowed()) {
+            renderedListValid[backBuffer] = false;
+            return false;
+        }
+        tile_mask_t tiles;
+        if (renderedListValid[backBuffer])
+            tiles = recordingList->diff(*renderedLists[backBuffer]);
+        else
+            tiles.set();
+        for (int row = 0; row < DAMAGE_TILE_ROWS; row++) {
+            int runStart = -1;
+            for (int col = 0; col <= DAMAGE_TILE_COLS; col++) {
+                bool dirty = col < DAMAGE_TILE_COLS && tiles.test(row * DAMAGE_TILE_COLS + col);
+                if (dirty && runStart < 0) {
+                    runStart = col;
+                } else if (!dirty && runStart >= 0) {
+                    rect_t run = {runStart * DAMAGE_TILE_W, row * DAMAGE_TILE_H, (col - runStart) * DAMAGE_TILE_W, DAMAGE_TILE_H};
+                    replay(run);
+                    touch(run.x, run.y, run.w, run.h);
+                    runStart = -1;
+                }
+            }
+        }
+        std::swap(recordingList, renderedLists[backBuffer]);
+        renderedListValid[backBuffer] = true;
+        return true;
+    }
+
+    /**
+     * Whether some changes were held back by the mask passed to a previous pushDirty.
+     */
+    inline bool hasDeferredDamage() const
+    {
+        return damage.hasDeferred();
+    }
+
+    inline uint32_t getLastPushBytes() const
+    {
+        return handoff.getLastPushBytes();
+    }
+
+    inline uint32_t getLastPushRects() const
+    {
+        return handoff.getLastPushRects();
     }
 };
 
@@ -0,0 +1,89 @@
+#ifndef S3DASH_SPSC_RING_H
+#define S3DASH_SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t capacity;
+    // Most items ever queued at once.
+    uint32_t highWaterMark;
+    uint32_t pushed;
+    // Items dropped because the ring was full.
+    uint32_t overflows;
+} spsc_ring_stats_t;
+
+/**
+ * Lock-free ring of items passed from one producer task to one consumer task.
+ *
+ * Head and tail run freely and wrap at 2^32, which Size divides, so the item count is always
+ * head - tail. Each index is only written by its own side: the producer publishes an item with a
+ * release store of head after copying it in, the consumer frees its slot with a release store of tail
+ * after copying it out.
+ */
+template<typename T, uint32_t Size>
+class SpscRing
+{
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "ring size must be a power of two");
+
+private:
+    T items[Size];
+    std::atomic<uint32_t> head = 0;
+    std::atomic<uint32_t> tail = 0;
+    // Only written by the producer.
+    std::atomic<uint32_t> highWaterMark = 0;
+    std::atomic<uint32_t> pushed = 0;
+    std::atomic<uint32_t> overflows = 0;
+
+public:
+    /**
+     * Queue a copy of item. Producer only.
+     *
+     * @return false if the ring is full, in which case item is dropped and counted as an overflow.
+     */
+    inline bool push(const T &item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t used = h - tail.load(std::memory_order_acquire);
+        if (used == Size) {
+            overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        items[h % Size] = item;
+        head.store(h + 1, std::memory_order_release);
+        pushed.store(pushed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (used + 1 > highWaterMark.load(std::memory_order_relaxed))
+            highWaterMark.store(used + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Dequeue up to max items into out, oldest first. Consumer only.
+     *
+     * @return the number of items dequeued.
+     */
+    inline uint32_t pop(T *out, uint32_t max)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t available = head.load(std::memory_order_acquire) - t;
+        uint32_t count = available < max ? available : max;
+        for (uint32_t i = 0; i < count; i++)
+            out[i] = items[(t + i) % Size];
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Statistics of the ring, from any task. Counters read from another task may be one item behind.
+     */
+    inline void stats(spsc_ring_stats_t *out) const
+    {
+        out->capacity = Size;
+        out->highWaterMark = highWaterMark.load(std::memory_order_relaxed);
+        out->pushed = pushed.load(std::memory_order_relaxed);
+        out->overflows = overflows.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "view_renderer.h"
+
+#include <string.h>
+
+#include "views/ConnectingView.h"
+#include "views/DashMountedView.h"
+#include "views/DisplayModeView.h"
+#include "views/LayoutView.h"
+#include "views/SteeringWheelMountedView.h"
+
+const view_case_t VIEW_CASES[VIEW_CASE_COUNT] = {
+    { "connecting", { DASH_MOUNT, OILP_0 }, false },
+    { "dash oilp0", { DASH_MOUNT, OILP_0 }, true },
+    { "dash oilp1", { DASH_MOUNT, OILP_1 }, true },
+    { "steering wheel", { STEERING_WHEEL_MOUNT, OILP_0 }, true },
+    { "custom layout", { CUSTOM_LAYOUT, OILP_0 }, true },
+};
+
+bool render_state_equal(const render_state_t &a, const render_state_t &b)
+{
+    return memcmp(&a.dash_data, &b.dash_data, sizeof(dash_data_t)) == 0
+        && a.displayModeRaw == b.displayModeRaw
+        && a.invertColor == b.invertColor
+        && a.connected == b.connected;
+}
+
+static void draw_view(DisplayModeView *view, dash_data_t *data, RegionScheduler *scheduler, bool background)
+{
+    if (background)
+    {
+        view->renderBackground();
+        return;
+    }
+    if (scheduler)
+        view->scheduleRegions(scheduler);
+    view->render(data);
+}
+
+void render_view(Sprite *target, const render_state_t &state, const Layout *layout, RegionScheduler *scheduler, bool background)
+{
+    NvsDisplayMode displayMode = *reinterpret_cast<const NvsDisplayMode*>(&state.displayModeRaw);
+    dash_data_t data = state.dash_data;
+    if (!state.connected)
+    //if (false)
+    {
+        if (!background)
+            ConnectingView(target).render();
+        return;
+    }
+    switch (displayMode.displayMode) { 
+        case DASH_MOUNT:
+        {
+            DashMountedView view(target);
+            view.setOilP(static_cast<OilPressureMode>(displayMode.oilpressureMode));
+            view.setInvertColor(state.invertColor);
+            draw_view(&view, &data, scheduler, background);
+        }
+        break;
+        case STEERING_WHEEL_MOUNT:
+        {
+            SteeringWheelMountedView view(target);
+            draw_view(&view, &data, scheduler, background);
+        }
+        break;
+        case CUSTOM_LAYOUT:
+        {
+            LayoutView view(target, layout);
+            view.setInvertColor(state.invertColor);
+            draw_view(&view, &data, scheduler, background);
+        }
+        break;
+    }
+}
+
+void render_frame(Sprite *target, const render_state_t &state, const Layout *layout)
+{
+    target->startWrite();
+    bool retained = target->beginRecording();
+    if (retained)
+    {
+        render_view(target, state, layout, NULL);
+        retained = target->endRecording();
+    }
+    if (!retained)
+        render_view(target, state, layout, NULL);
+    target->endWrite();
+}
+
+void sweep_dash_data(render_state_t *state, int step, int steps)
+{
+    const int last = steps - 1;
+    dash_data_t &data = state->dash_data;
+    data.rpm = step * 9999 / last;
+    data.oil_pressure0 = step * 200 / last;
+    data.oil_pressure1 = 200 - data.oil_pressure0;
+    data.oil_temp = step * 300 / last;
+    data.engine_coolant_temp = 300 - data.oil_temp;
+    data.throttle_per = step * 100 / last;
+    data.brake_per = 100 - data.throttle_per;
+    data.steering = step * 1800 / last - 900;
+    data.stale = step % 4 == 3 ? (1u << DASH_SIGNAL_COUNT) - 1 : 0;
+    state->invertColor = step & 1;
+}
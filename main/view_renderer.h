@@ -0,0 +1,59 @@
+#ifndef S3DASH_VIEW_RENDERER_H
+#define S3DASH_VIEW_RENDERER_H
+
+#include <stdint.h>
+
+#include "dash_data.h"
+#include "layout.h"
+#include "region_scheduler.h"
+#include "sprite.h"
+
+typedef struct {
+    uint16_t displayMode;
+    uint16_t oilpressureMode;
+} NvsDisplayMode;
+
+/**
+ * Everything that decides what ends up on screen. The LCD task skips frames for which this did not change.
+ */
+typedef struct {
+    dash_data_t dash_data;
+    uint32_t displayModeRaw;
+    bool invertColor;
+    bool connected;
+} render_state_t;
+
+/**
+ * A view and the display mode it is shown for, to check or measure every view.
+ */
+typedef struct {
+    const char *name;
+    NvsDisplayMode mode;
+    bool connected;
+} view_case_t;
+
+#define VIEW_CASE_COUNT 5
+extern const view_case_t VIEW_CASES[VIEW_CASE_COUNT];
+
+bool render_state_equal(const render_state_t &a, const render_state_t &b);
+
+/**
+ * Render the view for the given state into target. When scheduler is not null, the view also
+ * registers its refresh regions with it. With background set, only the static parts of the view
+ * are drawn, to be cached. layout is drawn by the custom layout view.
+ */
+void render_view(Sprite *target, const render_state_t &state, const Layout *layout, RegionScheduler *scheduler, bool background = false);
+
+/**
+ * Render a frame into target on a single core the way the LCD task does: recorded into a display
+ * list when target has them, and drawn directly otherwise. Does not push it.
+ */
+void render_frame(Sprite *target, const render_state_t &state, const Layout *layout);
+
+/**
+ * Set the dash data and the alarm color of state to step of a sweep of steps steps, which runs every
+ * signal across its range. Every fourth step has every signal stale.
+ */
+void sweep_dash_data(render_state_t *state, int step, int steps);
+
+#endif
@@ -7,6 +7,9 @@ ConnectingView::ConnectingView(Sprite *renderOn)
 
 void ConnectingView::render()
 {
+    // Shown over a drawn dash when the link drops, so the last values have to go.
+    if (!sprite->restoreBackground())
+        sprite->fillScreen(0);
     sprite->setTextColor(Color::COLOR_WHITE);
     sprite->setTextColor(0xFFFFFF);
     sprite->setFont(&fonts::DejaVu18);
@@ -2,7 +2,7 @@
 #define S3DASH_CONNECTING_VIEW_H
 
 #include "color.h"
-#include "lcd.h"
+#include "lcd_geometry.h"
 #include "sprite.h"
 
 class ConnectingView 
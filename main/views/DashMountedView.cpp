@@ -7,6 +7,7 @@
 #define UI_ROW_BEGIN_1 (UI_SAFE_ZONE_MARGIN)
 #define UI_ROW_BEGIN_2 (UI_SAFE_ZONE_MARGIN + UI_ROW_HEIGHT)
 #define UI_ROW_BEGIN_3 (UI_SAFE_ZONE_MARGIN + UI_ROW_HEIGHT * 2)
+#define UI_HERO_DIGIT_HEIGHT 90
 
 DashMountedView::DashMountedView(Sprite *renderOn)
 {
@@ -21,81 +22,92 @@ void DashMountedView::setupText(UseCase useCase)
         sprite->setFont(&fonts::DejaVu18);
         sprite->setTextSize(1);
         break;
-    case VALUE_LARGE:
-        sprite->setTextColor(Color::COLOR_WHITE);
-        sprite->setFont(&fonts::Font7);
-        sprite->setTextSize(2);
-        break;
     case VALUE_SMALL:
         sprite->setTextColor(Color::COLOR_WHITE);
         sprite->setFont(&fonts::Font7);
         sprite->setTextSize(.55);
         break;
-    case VALUE_LARGE_ALARM:
-        sprite->setTextColor(Color::COLOR_RED);
-        sprite->setFont(&fonts::Font7);
-        sprite->setTextSize(2);
-        break;
     }
 }
 
-void DashMountedView::render(dash_data_t *dash_data)
+void DashMountedView::drawBarLabels()
+{
+    setupText(LABEL);
+    sprite->drawString("THROTTLE /", UI_ROW_BEGIN_1, UI_ROW_BEGIN_3 + 4);
+    sprite->setTextColor(Color::COLOR_RED);
+    sprite->drawString("BRAKE", 128, UI_ROW_BEGIN_3 + 4);
+}
+
+void DashMountedView::renderBackground()
 {
     sprite->fillScreen(0);
     sprite->setColor(Color::COLOR_WHITE);
 
-    // OilP
     setupText(LABEL);
     if (oilPMode == OILP_0)
         sprite->drawString("OILP0 (PSI)", UI_COLUMN_BEGIN_1, UI_ROW_BEGIN_1);
     else
         sprite->drawString("OILP1 (PSI)", UI_COLUMN_BEGIN_1, UI_ROW_BEGIN_1);
+    sprite->drawString("OILT (F)", UI_COLUMN_BEGIN_2, UI_SAFE_ZONE_MARGIN);
+    sprite->drawString("ECT (F)", UI_COLUMN_BEGIN_2, UI_ROW_BEGIN_2);
+    sprite->drawString("STEER", UI_COLUMN_BEGIN_2, UI_ROW_BEGIN_3);
+    // With theme colors the alarm background is part of the background, shown black until the
+    // alarm goes off.
+    if (sprite->hasThemeColors())
+        sprite->fillRect(UI_SAFE_ZONE_MARGIN,  UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT, 220, UI_ROW_BEGIN_3 - UI_SAFE_ZONE_MARGIN, Color::COLOR_ALARM_BACKGROUND);
+    drawBarLabels();
 
-    if (invertedColor) {
-        setupText(VALUE_LARGE_ALARM);
-        sprite->setColor(Color::COLOR_YELLOW);
-        sprite->fillRect(UI_SAFE_ZONE_MARGIN,  UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT, 220, UI_ROW_BEGIN_3 - UI_SAFE_ZONE_MARGIN);
-    }
-    else {
-        setupText(VALUE_LARGE);
+    sprite->fillRect(0, 144, 220, 24, Color::COLOR_GRAY_DARK);
+}
+
+void DashMountedView::render(dash_data_t *dash_data)
+{
+    if (!sprite->restoreBackground())
+        renderBackground();
+
+    // OilP
+    dash_signal_t oilPressureSignal = oilPMode == OILP_0 ? DASH_SIGNAL_OIL_PRESSURE0 : DASH_SIGNAL_OIL_PRESSURE1;
+    uint16_t oilPressureColor = valueColor(dash_data, oilPressureSignal, Color::COLOR_WHITE);
+    if (sprite->hasThemeColors()) {
+        // The alarm blinks through the color LUT, see show_alarm_colors.
+        oilPressureColor = valueColor(dash_data, oilPressureSignal, Color::COLOR_ALARM_VALUE);
+    } else if (invertedColor) {
+        oilPressureColor = Color::COLOR_RED;
+        sprite->fillRect(UI_SAFE_ZONE_MARGIN,  UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT, 220, UI_ROW_BEGIN_3 - UI_SAFE_ZONE_MARGIN, Color::COLOR_YELLOW);
+        // The alarm background covers the bar labels.
+        drawBarLabels();
     }
-    if (oilPMode == OILP_0)
-        sprite->drawRightNumber(dash_data->oil_pressure0, 220, UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT);
-    else
-        sprite->drawRightNumber(dash_data->oil_pressure1, 220, UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT);
+    int oilPressure = oilPMode == OILP_0 ? dash_data->oil_pressure0 : dash_data->oil_pressure1;
+    sprite->drawRightSegmentNumber(oilPressure, 220, UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT, UI_HERO_DIGIT_HEIGHT, oilPressureColor);
 
     // OilT
-    setupText(LABEL);
-    sprite->drawString("OILT (F)", UI_COLUMN_BEGIN_2, UI_SAFE_ZONE_MARGIN);
-
     setupText(VALUE_SMALL);
+    sprite->setTextColor(valueColor(dash_data, DASH_SIGNAL_OIL_TEMP, Color::COLOR_WHITE));
     sprite->drawRightNumber(dash_data->oil_temp, LCD_H_RES - UI_SAFE_ZONE_MARGIN, UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT);
 
     // ECT
-    setupText(LABEL);
-    sprite->drawString("ECT (F)", UI_COLUMN_BEGIN_2, UI_ROW_BEGIN_2);
-
-    setupText(VALUE_SMALL);
+    sprite->setTextColor(valueColor(dash_data, DASH_SIGNAL_ENGINE_COOLANT_TEMP, Color::COLOR_WHITE));
     sprite->drawRightNumber(dash_data->engine_coolant_temp, LCD_H_RES - UI_SAFE_ZONE_MARGIN, UI_ROW_BEGIN_2 + UI_LABEL_HEIGHT);
 
     // PPS / Brake
-    setupText(LABEL);
-    sprite->drawString("THROTTLE /", UI_ROW_BEGIN_1, UI_ROW_BEGIN_3 + 4);
-    sprite->setTextColor(Color::COLOR_RED);
-    sprite->drawString("BRAKE", 128, UI_ROW_BEGIN_3 + 4);
-
-    sprite->fillRect(0, 144, 220, 24, Color::COLOR_GRAY_DARK);
-    sprite->progressBarFromLeft(0, 144, 220, 24, (double) dash_data->throttle_per / 100, Color::COLOR_WHITE);
-    sprite->progressBarFromLeft(0, 144, 220, 24, (double) dash_data->brake_per / 100, Color::COLOR_RED);
-
-    setupText(LABEL);
-    sprite->drawString("STEER", UI_COLUMN_BEGIN_2, UI_ROW_BEGIN_3);
+    if (!DashData::isStale(dash_data, DASH_SIGNAL_THROTTLE))
+        sprite->progressBarFromLeft(0, 144, 220, 24, (double) dash_data->throttle_per / 100, Color::COLOR_WHITE);
+    if (!DashData::isStale(dash_data, DASH_SIGNAL_BRAKE))
+        sprite->progressBarFromLeft(0, 144, 220, 24, (double) dash_data->brake_per / 100, Color::COLOR_RED);
 
     // Steering
-    setupText(VALUE_SMALL);
+    sprite->setTextColor(valueColor(dash_data, DASH_SIGNAL_STEERING, Color::COLOR_WHITE));
     sprite->drawRightNumber(dash_data->steering, LCD_H_RES - UI_SAFE_ZONE_MARGIN, UI_ROW_BEGIN_3 + UI_LABEL_HEIGHT);
 }
 
+void DashMountedView::scheduleRegions(RegionScheduler *scheduler)
+{
+    // Throttle / brake bar
+    scheduler->add(0, 144, 220, 24, REGION_PERIOD_FAST_US);
+    // OilP value and alarm background
+    scheduler->add(UI_SAFE_ZONE_MARGIN, UI_ROW_BEGIN_1 + UI_LABEL_HEIGHT, 220, UI_ROW_BEGIN_3 - UI_SAFE_ZONE_MARGIN, REGION_PERIOD_MEDIUM_US);
+}
+
 void DashMountedView::setOilP(OilPressureMode mode) {
     this->oilPMode = mode;
 }
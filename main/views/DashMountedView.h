@@ -4,11 +4,11 @@
 #include "color.h"
 #include "dash_data.h"
 #include "DisplayModeView.h"
-#include "lcd.h"
+#include "lcd_geometry.h"
 #include "sprite.h"
 
 enum OilPressureMode {OILP_0, OILP_1};
-enum DisplayMode { DASH_MOUNT, STEERING_WHEEL_MOUNT };
+enum DisplayMode { DASH_MOUNT, STEERING_WHEEL_MOUNT, CUSTOM_LAYOUT };
 
 class DashMountedView: public DisplayModeView 
 {
@@ -19,18 +19,24 @@ private:
 
     OilPressureMode oilPMode;
 
-    enum UseCase { LABEL, VALUE_LARGE, VALUE_SMALL, VALUE_LARGE_ALARM};
+    enum UseCase { LABEL, VALUE_SMALL };
 
     void setupText(UseCase useCase);
 
+    void drawBarLabels();
+
 public: 
     DashMountedView(Sprite *renderOn);
 
     void render(dash_data_t *dash_data);
 
+    void renderBackground();
+
     void setOilP(OilPressureMode mode);
 
     void setInvertColor(bool invert);
+
+    void scheduleRegions(RegionScheduler *scheduler);
 };
 
 #endif
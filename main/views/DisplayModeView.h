@@ -1,13 +1,31 @@
 #ifndef S3DASH_DISPLAY_MODE_VIEW_H
 #define S3DASH_DISPLAY_MODE_VIEW_H
 
+#include "color.h"
 #include "dash_data.h"
+#include "region_scheduler.h"
 
 class DisplayModeView 
 {
+protected:
+    /**
+     * Color to draw the value of signal in: stale values are dimmed. Bars and shift lights of stale
+     * signals are not drawn at all.
+     */
+    static inline uint16_t valueColor(const dash_data_t *dash_data, dash_signal_t signal, uint16_t color)
+    {
+        return DashData::isStale(dash_data, signal) ? Color::COLOR_STALE : color;
+    }
+
 public:
     virtual void render(dash_data_t *dash_data) = 0;
+    /**
+     * Draw the parts of the view that do not depend on dash data, over a black screen. The result
+     * may be cached and restored by render instead of drawing it every frame.
+     */
+    virtual void renderBackground() = 0;
     virtual void setInvertColor(bool invert) = 0;
+    virtual void scheduleRegions(RegionScheduler *scheduler) = 0;
 };
 
 #endif
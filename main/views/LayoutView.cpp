@@ -0,0 +1,116 @@
+#include "LayoutView.h"
+
+#include <algorithm>
+
+LayoutView::LayoutView(Sprite *renderOn, const Layout *layout)
+{
+    sprite = renderOn;
+    this->layout = layout;
+}
+
+void LayoutView::setupText(const layout_widget_t &widget)
+{
+    sprite->setTextColor(widget.color);
+    sprite->setFont(widget.font);
+    sprite->setTextSize(widget.textSize);
+}
+
+void LayoutView::drawText(const layout_widget_t &widget, const char *text)
+{
+    switch (widget.align) {
+    case 0:
+        sprite->drawString(text, widget.x, widget.y);
+        break;
+    case 1:
+        sprite->drawRightString(text, widget.x + widget.w, widget.y);
+        break;
+    default:
+        sprite->drawCenterString(text, widget.x + widget.w / 2, widget.y);
+        break;
+    }
+}
+
+void LayoutView::renderBackground()
+{
+    sprite->fillScreen(0);
+
+    const layout_widget_t *widgets = layout->getWidgets();
+    for (int i = 0; i < layout->size(); i++) {
+        const layout_widget_t &widget = widgets[i];
+        switch (widget.type) {
+        case LAYOUT_LABEL:
+            setupText(widget);
+            drawText(widget, widget.text);
+            break;
+        case LAYOUT_BAR:
+            sprite->fillRect(widget.x, widget.y, widget.w, widget.h, widget.trackColor);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void LayoutView::render(dash_data_t *dash_data)
+{
+    if (!sprite->restoreBackground())
+        renderBackground();
+
+    const layout_widget_t *widgets = layout->getWidgets();
+    for (int i = 0; i < layout->size(); i++) {
+        const layout_widget_t &widget = widgets[i];
+        int value = Layout::signalValue(widget, dash_data);
+        bool stale = Layout::signalStale(widget, dash_data);
+        uint16_t color = stale ? Color::COLOR_STALE : widget.color;
+        switch (widget.type) {
+        case LAYOUT_LABEL:
+            break;
+        case LAYOUT_NUMBER:
+        {
+            char text[SPRITE_NUMBER_BYTES];
+            setupText(widget);
+            sprite->setTextColor(color);
+            drawText(widget, Sprite::formatNumber(value, text));
+        }
+        break;
+        case LAYOUT_SEGMENT_NUMBER:
+            sprite->drawRightSegmentNumber(value, widget.x + widget.w, widget.y, widget.h, color);
+            break;
+        case LAYOUT_BAR:
+        {
+            if (stale)
+                break;
+            double percent = std::clamp((double) value / widget.param, 0.0, 1.0);
+            if (widget.vertical)
+                sprite->fillRect(widget.x, widget.y + widget.h - (int)(percent * widget.h), widget.w, (int)(percent * widget.h), widget.color);
+            else
+                sprite->progressBarFromLeft(widget.x, widget.y, widget.w, widget.h, percent, widget.color);
+        }
+        break;
+        case LAYOUT_SHIFT_LIGHT:
+            if (!stale && DashData::calcRpmLevel(value) >= widget.param)
+                sprite->fillRect(widget.x, widget.y, widget.w, widget.h, widget.color);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void LayoutView::scheduleRegions(RegionScheduler *scheduler)
+{
+    // Faster widgets first, so they keep tiles they share with slower ones.
+    const layout_widget_t *widgets = layout->getWidgets();
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < layout->size(); i++) {
+            const layout_widget_t &widget = widgets[i];
+            if (widget.periodUs == 0 || (widget.periodUs <= REGION_PERIOD_FAST_US) != (pass == 0))
+                continue;
+            scheduler->add(widget.x, widget.y, widget.w, widget.h, widget.periodUs);
+        }
+    }
+}
+
+void LayoutView::setInvertColor(bool inverted) {
+    this->invertedColor = inverted;
+}
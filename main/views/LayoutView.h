@@ -0,0 +1,37 @@
+#ifndef S3DASH_LAYOUT_VIEW_H
+#define S3DASH_LAYOUT_VIEW_H
+
+#include "color.h"
+#include "dash_data.h"
+#include "DisplayModeView.h"
+#include "layout.h"
+#include "lcd_geometry.h"
+#include "sprite.h"
+
+/**
+ * Renders a layout loaded from flash. The widgets are walked in order, so later widgets draw over
+ * earlier ones.
+ */
+class LayoutView: public DisplayModeView
+{
+private:
+    Sprite *sprite;
+    const Layout *layout;
+    volatile bool invertedColor;
+
+    void setupText(const layout_widget_t &widget);
+    void drawText(const layout_widget_t &widget, const char *text);
+
+public:
+    LayoutView(Sprite *renderOn, const Layout *layout);
+
+    void render(dash_data_t *dash_data);
+
+    void renderBackground();
+
+    void setInvertColor(bool invert);
+
+    void scheduleRegions(RegionScheduler *scheduler);
+};
+
+#endif
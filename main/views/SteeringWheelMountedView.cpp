@@ -6,6 +6,12 @@
 #define RPM_INDICATOR_GUTTER 5
 #define RPM_INDICATOR_HEIGHT (LCD_V_RES - RPM_INDICATOR_LIGHT_COUNT * (RPM_INDICATOR_GUTTER - 1)) / RPM_INDICATOR_LIGHT_COUNT
 #define RPM_INDICATOR_WIDTH 10
+#define HERO_DIGIT_HEIGHT 90
+#define HERO_X 56
+#define HERO_WIDTH 172
+#define METRIC_START 238
+#define METRIC_HEIGHT 48
+#define METRIC_WIDTH 64
 
 SteeringWheelMountedView::SteeringWheelMountedView(Sprite *renderOn)
 {
@@ -23,9 +29,7 @@ void SteeringWheelMountedView::LabelView(const char *value, int x, int y)
 
 void SteeringWheelMountedView::MetricView(int x, int y, int width, metric_t *metric)
 {
-    LabelView(metric->label, x, y);
-
-    sprite->setTextColor(Color::COLOR_WHITE);
+    sprite->setTextColor(metric->color);
     sprite->setFont(&fonts::Font7);
     sprite->setTextSize(.5);
 
@@ -43,6 +47,8 @@ void SteeringWheelMountedView::ShiftRect(int index, uint16_t color)
 
 void SteeringWheelMountedView::ShiftIndicator(dash_data_t *dash_data)
 {
+    if (DashData::isStale(dash_data, DASH_SIGNAL_RPM))
+        return;
     DashData::RpmLevel rpmLevel = DashData::calcRpmLevel(dash_data->rpm);
     switch (rpmLevel)
     {
@@ -102,61 +108,79 @@ void SteeringWheelMountedView::ShiftIndicator(dash_data_t *dash_data)
 
 void SteeringWheelMountedView::HeroMetricView(int x, int y, int width, metric_t *metric)
 {
-    LabelView(metric->label, x, y);
-
-    sprite->setTextColor(Color::COLOR_WHITE);
-    sprite->setFont(&fonts::Font7);
-    sprite->setTextSize(2);
-
-    sprite->drawRightNumber(metric->value, x + width, y + 16);
+    sprite->drawRightSegmentNumber(metric->value, x + width, y + 16, HERO_DIGIT_HEIGHT, metric->color);
 }
 
-void SteeringWheelMountedView::render(dash_data_t *dash_data)
+void SteeringWheelMountedView::renderBackground()
 {
     sprite->fillScreen(0);
     sprite->setColor(Color::COLOR_WHITE);
 
-    sprite->progressBarFromBottom(UI_SAFE_ZONE_MARGIN, 
-                                  TOP_SPACING, 
-                                  20, 
-                                  140, 
-                                  (double) dash_data->brake_per / 100, 
-                                  Color::COLOR_RED
-                                  );
-    sprite->progressBarFromBottom(UI_SAFE_ZONE_MARGIN + 20 + 2, 
-                                  TOP_SPACING, 
-                                  20, 
-                                  140, 
-                                  (double) dash_data->throttle_per / 100, 
-                                  Color::COLOR_WHITE
-                                  );
-    LabelView("BRAKE / PPS", 56, 130);
+    LabelView("BRAKE / PPS", HERO_X, 130);
+    LabelView("OILP (PSI)", HERO_X, UI_SAFE_ZONE_MARGIN);
+    LabelView("OILT (F)", METRIC_START, UI_SAFE_ZONE_MARGIN);
+    LabelView("ECT (F)", METRIC_START, UI_SAFE_ZONE_MARGIN + METRIC_HEIGHT);
+    LabelView("STEER", METRIC_START, UI_SAFE_ZONE_MARGIN + METRIC_HEIGHT * 2);
+}
+
+void SteeringWheelMountedView::render(dash_data_t *dash_data)
+{
+    if (!sprite->restoreBackground())
+        renderBackground();
+
+    if (!DashData::isStale(dash_data, DASH_SIGNAL_BRAKE))
+        sprite->progressBarFromBottom(UI_SAFE_ZONE_MARGIN, 
+                                      TOP_SPACING, 
+                                      20, 
+                                      140, 
+                                      (double) dash_data->brake_per / 100, 
+                                      Color::COLOR_RED
+                                      );
+    if (!DashData::isStale(dash_data, DASH_SIGNAL_THROTTLE))
+        sprite->progressBarFromBottom(UI_SAFE_ZONE_MARGIN + 20 + 2, 
+                                      TOP_SPACING, 
+                                      20, 
+                                      140, 
+                                      (double) dash_data->throttle_per / 100, 
+                                      Color::COLOR_WHITE
+                                      );
 
     metric_t metric;
     metric.label = "OILP (PSI)";
     metric.value = dash_data->oil_pressure0;
-    HeroMetricView(56, UI_SAFE_ZONE_MARGIN, 172, &metric);
+    metric.color = valueColor(dash_data, DASH_SIGNAL_OIL_PRESSURE0, Color::COLOR_WHITE);
+    HeroMetricView(HERO_X, UI_SAFE_ZONE_MARGIN, HERO_WIDTH, &metric);
 
     int y = UI_SAFE_ZONE_MARGIN;
-    const int METRIC_START = 238;
-    const int METRIC_HEIGHT = 48;
-    const int METRIC_WIDTH = 64;
 
     ShiftIndicator(dash_data);
 
     metric.label = "OILT (F)";
     metric.value = dash_data->oil_temp;
+    metric.color = valueColor(dash_data, DASH_SIGNAL_OIL_TEMP, Color::COLOR_WHITE);
     MetricView(METRIC_START, y, METRIC_WIDTH, &metric);
 
     metric.label = "ECT (F)";
     metric.value = dash_data->engine_coolant_temp;
+    metric.color = valueColor(dash_data, DASH_SIGNAL_ENGINE_COOLANT_TEMP, Color::COLOR_WHITE);
     MetricView(METRIC_START, y + METRIC_HEIGHT, METRIC_WIDTH, &metric);
 
     metric.label = "STEER";
     metric.value = dash_data->steering;
+    metric.color = valueColor(dash_data, DASH_SIGNAL_STEERING, Color::COLOR_WHITE);
     MetricView(METRIC_START, y + METRIC_HEIGHT * 2, METRIC_WIDTH, &metric);
 }
 
+void SteeringWheelMountedView::scheduleRegions(RegionScheduler *scheduler)
+{
+    // Brake / throttle bars
+    scheduler->add(UI_SAFE_ZONE_MARGIN, TOP_SPACING, 20 + 2 + 20, 140, REGION_PERIOD_FAST_US);
+    // Shift lights
+    scheduler->add(LCD_H_RES - RPM_INDICATOR_WIDTH, 0, RPM_INDICATOR_WIDTH, LCD_V_RES, REGION_PERIOD_FAST_US);
+    // OilP hero value
+    scheduler->add(HERO_X, UI_SAFE_ZONE_MARGIN + 16, HERO_WIDTH, 100, REGION_PERIOD_MEDIUM_US);
+}
+
 void SteeringWheelMountedView::setInvertColor(bool inverted) {
     this->invertedColor = inverted;
 }
\ No newline at end of file
@@ -4,7 +4,7 @@
 #include "color.h"
 #include "dash_data.h"
 #include "DisplayModeView.h"
-#include "lcd.h"
+#include "lcd_geometry.h"
 #include "metric.h"
 #include "sprite.h"
 
@@ -25,7 +25,11 @@ public:
 
     void render(dash_data_t *dash_data);
 
+    void renderBackground();
+
     void setInvertColor(bool invert);
+
+    void scheduleRegions(RegionScheduler *scheduler);
 };
 
 #endif
@@ -4,6 +4,7 @@
 typedef struct {
     const char *label;
     int value;
+    uint16_t color;
 } metric_t;
 
 #endif
@@ -0,0 +1,124 @@
+/**
+ * Time the CAN decode on the development machine, per frame: the functions tools/dbc_codegen.py
+ * generates from s3dash.dbc, the signal table set to the same signals, and the decode the firmware
+ * used before either. Frames are random payloads spread over the messages of s3dash.dbc, with one in
+ * eight of an ID none of them decodes. Absolute numbers say little about the ESP32-S3, relative ones
+ * show what a change to the decode costs.
+ *
+ * Then the kernels of can_decode.h per signal, over the same payloads: CanDecode::extract with the
+ * signal known at compile time, the shift and mask CanSignalTable computes when the table is set, and
+ * bitsToUIntLe for little endian signals.
+ *
+ * Usage: can_decode_benchmark [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+
+#include "can_dbc.h"
+#include "can_decode.h"
+#include "can_signals.h"
+#include "old_can_decode.h"
+
+#define CAN_BENCHMARK_FRAMES 4096
+
+typedef struct {
+    uint32_t canId;
+    alignas(4) uint8_t payload[8];
+} benchmark_frame_t;
+
+static benchmark_frame_t frames[CAN_BENCHMARK_FRAMES];
+static dash_data_atomic_t dash_data;
+static CanSignalTable table;
+
+/**
+ * value, hidden from the optimizer, so runtime parameters are not folded into constants and results
+ * not thrown away.
+ */
+template<typename T>
+static inline T opaque(T value)
+{
+    asm volatile("" : "+r"(value));
+    return value;
+}
+
+template<typename Fn>
+static double nanosecondsPerFrame(int rounds, Fn decode)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (benchmark_frame_t &frame : frames)
+            decode(frame);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (static_cast<double>(rounds) * CAN_BENCHMARK_FRAMES);
+}
+
+/**
+ * Time the kernels on one signal and print a row.
+ */
+template<unsigned Start, unsigned Length, bool BigEndian, bool Signed>
+static void timeKernels(const char *name, int rounds)
+{
+    double compileTime = nanosecondsPerFrame(rounds, [](const benchmark_frame_t &frame) {
+        opaque(CanDecode::extract<Start, Length, BigEndian, Signed>(CanDecode::load(frame.payload)));
+    });
+    double runtime = nanosecondsPerFrame(rounds, [](const benchmark_frame_t &frame) {
+        unsigned shift = opaque(BigEndian ? CanDecode::bigEndianShift(Start, Length) : Start);
+        unsigned length = opaque(Length);
+        uint64_t signBit = opaque(CanDecode::signBit(Length, Signed));
+        uint64_t bits = CanDecode::load(frame.payload);
+        uint64_t word = opaque(BigEndian) ? CanDecode::swap(bits) : bits;
+        opaque(CanDecode::signExtend(CanDecode::field(word, shift, length), signBit));
+    });
+    if (BigEndian) {
+        printf("%-16s %10.2f %10.2f %10s\n", name, compileTime, runtime, "-");
+        return;
+    }
+    double old = nanosecondsPerFrame(rounds, [](benchmark_frame_t &frame) {
+        opaque(OldCanDecode::bitsToUIntLe(frame.payload, opaque(Start), opaque(Length)));
+    });
+    printf("%-16s %10.2f %10.2f %10.2f\n", name, compileTime, runtime, old);
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    const int signalCount = sizeof(CanDbc::SIGNALS) / sizeof(CanDbc::SIGNALS[0]);
+    if (rounds <= 0 || !table.setSignals(CanDbc::SIGNALS, signalCount, &dash_data)) {
+        fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 1;
+    }
+    std::mt19937 random(18);
+    for (benchmark_frame_t &frame : frames) {
+        frame.canId = random() % 8 == 0 ? 0x7FF : CanDbc::SIGNALS[random() % signalCount].canId;
+        for (uint8_t &byte : frame.payload)
+            byte = random();
+    }
+
+    double generated = nanosecondsPerFrame(rounds, [](const benchmark_frame_t &frame) {
+        CanDbc::decode(frame.canId, frame.payload, 0, &dash_data);
+    });
+    double signalTable = nanosecondsPerFrame(rounds, [](const benchmark_frame_t &frame) {
+        const can_message_t *message = table.find(frame.canId);
+        if (message)
+            table.decode(message, frame.payload, 0);
+    });
+    double old = nanosecondsPerFrame(rounds, [](benchmark_frame_t &frame) {
+        OldCanDecode::decode(frame.canId, frame.payload, dash_data);
+    });
+    printf("%-16s %10s\n", "decode", "ns/frame");
+    printf("%-16s %10.2f\n", "generated", generated);
+    printf("%-16s %10.2f\n", "signal table", signalTable);
+    printf("%-16s %10.2f\n", "old switch", old);
+
+    printf("\n%-16s %10s %10s %10s\n", "ns/signal", "template", "runtime", "old");
+    timeKernels<16, 14, false, false>("rpm 16|14", rounds);
+    timeKernels<16, 16, false, true>("steering 16|16-", rounds);
+    timeKernels<5, 2, false, false>("byte 5|2", rounds);
+    timeKernels<7, 12, true, true>("motorola 7|12-", rounds);
+    timeKernels<39, 32, true, false>("motorola 39|32", rounds);
+    return 0;
+}
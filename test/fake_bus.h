@@ -0,0 +1,125 @@
+#ifndef S3DASH_TEST_FAKE_BUS_H
+#define S3DASH_TEST_FAKE_BUS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "lcd_geometry.h"
+
+/**
+ * Stands in for the LovyanGFX device FrameHandoff pushes to, with a panel of LCD_H_RES x LCD_V_RES
+ * 16 bit pixels.
+ *
+ * DMA transfers are modelled the worst way round: pushImageDMA only records the transfer, and the
+ * pixels are read from the source when it completes, i.e. at the next waitDMA, pushImageDMA or
+ * pushImage. A buffer drawn into while its transfer is still running shows up on the panel.
+ */
+class FakeBus
+{
+private:
+    typedef struct {
+        int x;
+        int y;
+        int w;
+        int h;
+        int clipX;
+        int clipY;
+        int clipW;
+        int clipH;
+        const uint16_t *pixels;
+    } transfer_t;
+
+    int clipX = 0;
+    int clipY = 0;
+    int clipW = LCD_H_RES;
+    int clipH = LCD_V_RES;
+    bool pending = false;
+    transfer_t transfer;
+
+    void complete()
+    {
+        if (!pending)
+            return;
+        pending = false;
+        write(transfer);
+    }
+
+    void write(const transfer_t &t)
+    {
+        int x0 = std::max(t.x, t.clipX);
+        int y0 = std::max(t.y, t.clipY);
+        int x1 = std::min(t.x + t.w, t.clipX + t.clipW);
+        int y1 = std::min(t.y + t.h, t.clipY + t.clipH);
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++)
+                panel[y][x] = t.pixels[(y - t.y) * t.w + x - t.x];
+        }
+        bytes += std::max(0, x1 - x0) * std::max(0, y1 - y0) * sizeof(uint16_t);
+    }
+
+    transfer_t start(int x, int y, int w, int h, const uint16_t *pixels) const
+    {
+        return {x, y, w, h, clipX, clipY, clipW, clipH, pixels};
+    }
+
+public:
+    uint16_t panel[LCD_V_RES][LCD_H_RES] = {};
+    // Pixel bytes written to the panel, and calls made.
+    uint32_t bytes = 0;
+    int waits = 0;
+    int dmaPushes = 0;
+    int blockingPushes = 0;
+
+    void setClipRect(int x, int y, int w, int h)
+    {
+        clipX = x;
+        clipY = y;
+        clipW = w;
+        clipH = h;
+    }
+
+    void clearClipRect()
+    {
+        setClipRect(0, 0, LCD_H_RES, LCD_V_RES);
+    }
+
+    void waitDMA()
+    {
+        waits++;
+        complete();
+    }
+
+    void pushImage(int x, int y, int w, int h, const uint16_t *pixels)
+    {
+        blockingPushes++;
+        complete();
+        write(start(x, y, w, h, pixels));
+    }
+
+    void pushImageDMA(int x, int y, int w, int h, const uint16_t *pixels)
+    {
+        // A transfer only starts once the previous one is done.
+        dmaPushes++;
+        complete();
+        transfer = start(x, y, w, h, pixels);
+        pending = true;
+    }
+
+    /**
+     * Whether a transfer still running reads from any of the bytes of [start, start + length).
+     */
+    bool isReading(const void *start, size_t length) const
+    {
+        if (!pending)
+            return false;
+        const uint8_t *begin = reinterpret_cast<const uint8_t *>(transfer.pixels);
+        const uint8_t *end = begin + transfer.w * transfer.h * sizeof(uint16_t);
+        const uint8_t *other = static_cast<const uint8_t *>(start);
+        return begin < other + length && other < end;
+    }
+};
+
+#endif
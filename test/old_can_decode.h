@@ -0,0 +1,73 @@
+#ifndef S3DASH_TEST_OLD_CAN_DECODE_H
+#define S3DASH_TEST_OLD_CAN_DECODE_H
+
+#include <stdint.h>
+
+#include "dash_data.h"
+
+/**
+ * The CAN decode of the firmware before CanDecode and the signal table: bitsToUIntLe from dash_data.h
+ * and the switch of notify_cb, kept to test and time the new decode against.
+ */
+namespace OldCanDecode
+{
+    inline uint32_t bitsToUIntLe(uint8_t *payload, uint32_t bitOffset, uint32_t bitLength) {
+        uint32_t result = 0;
+        if (bitOffset >= 64 || bitLength >32 || bitOffset + bitLength > 64)
+            return 0;
+        uint32_t startByte = bitOffset/8;
+        uint32_t endByte = (bitOffset+bitLength - 1) / 8;
+        uint8_t mask = 0;
+        int shift = 0;
+        for (uint32_t i = startByte; i <= endByte; i++ ) {
+            if (i == startByte) {
+                mask = (1U << (8 - bitOffset % 8)) - 1;
+                result |= (payload[i] >> (bitOffset % 8)) & mask;
+                shift += (8 - bitOffset % 8);
+                continue;
+            }
+            if (i == endByte) {
+                uint8_t bitsToRead = (bitOffset + bitLength) % 8;
+                if (bitsToRead == 0) {
+                    result |= static_cast<uint32_t>(payload[i])<<shift;
+                } else {
+                    mask = (1U << bitsToRead) - 1;
+                    result |= static_cast<uint32_t>(payload[i] & mask) <<shift;
+                }
+                continue;
+            }
+            result |= static_cast<uint32_t>(payload[i])<<shift;
+            shift += 8;
+        }
+        return result;
+    }
+
+    inline void decode(uint32_t can_id, uint8_t *payload, dash_data_atomic_t &dash_data_share)
+    {
+        switch (can_id)
+        {
+        case 0x40:
+            dash_data_share.rpm = static_cast<uint16_t>(bitsToUIntLe(payload, 16, 14));
+            dash_data_share.throttle_per = ((int)*(payload + 4)) * 100 / 255;
+            break;
+        case 0x138:
+            dash_data_share.steering = *(int16_t *)(payload + 2) / 10;
+            break;
+        case 0x139:
+            dash_data_share.brake_per = ((int)*(payload + 5)) * 128 / 100;
+            break;
+        case 0x345:
+            dash_data_share.oil_temp = ((int)*(payload + 3)) - 40;
+            dash_data_share.oil_temp = dash_data_share.oil_temp * 9 / 5 + 32;
+            dash_data_share.engine_coolant_temp = ((int)*(payload + 4)) - 40;
+            dash_data_share.engine_coolant_temp = dash_data_share.engine_coolant_temp * 9 / 5 + 32;
+            break;
+        case 0x662:
+            dash_data_share.oil_pressure0 = static_cast<uint16_t>(bitsToUIntLe(payload, 0, 16)) / 10;
+            dash_data_share.oil_pressure1 = static_cast<uint16_t>(bitsToUIntLe(payload, 16, 16)) / 10;
+            break;
+        }
+    }
+}
+
+#endif
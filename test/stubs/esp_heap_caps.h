@@ -0,0 +1,23 @@
+#ifndef S3DASH_TEST_ESP_HEAP_CAPS_H
+#define S3DASH_TEST_ESP_HEAP_CAPS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// The host has a single heap, so the capabilities asked for are ignored.
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void *heap_caps_malloc(size_t size, uint32_t)
+{
+    return malloc(size);
+}
+
+inline void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+#endif
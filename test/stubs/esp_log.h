@@ -0,0 +1,13 @@
+#ifndef S3DASH_TEST_ESP_LOG_H
+#define S3DASH_TEST_ESP_LOG_H
+
+#include <stdio.h>
+
+// ESP-IDF logging on the host: errors and warnings go to stderr, the rest is dropped after its format
+// is checked against its arguments.
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) do { if (0) fprintf(stderr, "I %s: " format "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, format, ...) do { if (0) fprintf(stderr, "D %s: " format "\n", tag, ##__VA_ARGS__); } while (0)
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef S3DASH_TEST_ESP_PARTITION_H
+#define S3DASH_TEST_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+/**
+ * A single data partition held in memory, which the esp_partition functions below find and read.
+ * Tests fill it in, and can make reads reaching past failReadsFrom fail.
+ */
+struct FakePartition
+{
+    esp_partition_t partition = {ESP_PARTITION_TYPE_DATA, 0, 0, 0, ""};
+    std::vector<uint8_t> bytes;
+    bool present = false;
+    size_t failReadsFrom = SIZE_MAX;
+
+    static FakePartition &get()
+    {
+        static FakePartition fake;
+        return fake;
+    }
+
+    static void set(const char *label, esp_partition_subtype_t subtype, const std::vector<uint8_t> &bytes, size_t size)
+    {
+        FakePartition &fake = get();
+        fake = FakePartition();
+        fake.partition.subtype = subtype;
+        fake.partition.size = size;
+        strncpy(fake.partition.label, label, sizeof(fake.partition.label) - 1);
+        fake.bytes = bytes;
+        fake.bytes.resize(size, 0xFF);
+        fake.present = true;
+    }
+};
+
+inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    const FakePartition &fake = FakePartition::get();
+    if (!fake.present || fake.partition.type != type || fake.partition.subtype != subtype
+        || (label && strcmp(label, fake.partition.label) != 0))
+        return nullptr;
+    return &fake.partition;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size)
+{
+    const FakePartition &fake = FakePartition::get();
+    if (partition != &fake.partition || offset + size > fake.bytes.size())
+        return ESP_ERR_INVALID_SIZE;
+    if (offset + size > fake.failReadsFrom)
+        return ESP_FAIL;
+    memcpy(dst, fake.bytes.data() + offset, size);
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef S3DASH_TEST_LOVYANGFX_H
+#define S3DASH_TEST_LOVYANGFX_H
+
+// The part of LovyanGFX that firmware code without any drawing refers to, for host tests built
+// without LovyanGFX. The fonts are only compared by address; the test defines them.
+namespace lgfx
+{
+    struct IFont
+    {
+    };
+}
+
+namespace fonts
+{
+    extern const lgfx::IFont DejaVu18;
+    extern const lgfx::IFont DejaVu12;
+    extern const lgfx::IFont Font7;
+}
+
+#endif
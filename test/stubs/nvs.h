@@ -0,0 +1,83 @@
+#ifndef S3DASH_TEST_NVS_H
+#define S3DASH_TEST_NVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "esp_err.h"
+
+#define ESP_ERR_NVS_BASE 0x1100
+#define ESP_ERR_NVS_NOT_FOUND (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_LENGTH (ESP_ERR_NVS_BASE + 0x0c)
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE,
+} nvs_open_mode_t;
+
+/**
+ * Blobs of an NVS partition held in memory, by namespace and key, which the nvs functions below
+ * read. Tests fill it in.
+ */
+struct FakeNvs
+{
+    std::map<std::string, std::map<std::string, std::vector<uint8_t>>> blobs;
+    std::vector<std::string> handles;
+
+    static FakeNvs &get()
+    {
+        static FakeNvs fake;
+        return fake;
+    }
+
+    static void clear()
+    {
+        get() = FakeNvs();
+    }
+
+    static void setBlob(const char *name, const char *key, const void *value, size_t length)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(value);
+        get().blobs[name][key].assign(bytes, bytes + length);
+    }
+};
+
+inline esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    FakeNvs &fake = FakeNvs::get();
+    if (open_mode == NVS_READONLY && fake.blobs.find(name) == fake.blobs.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    fake.handles.push_back(name);
+    *out_handle = fake.handles.size();
+    return ESP_OK;
+}
+
+inline esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    FakeNvs &fake = FakeNvs::get();
+    const std::map<std::string, std::vector<uint8_t>> &keys = fake.blobs[fake.handles.at(handle - 1)];
+    auto blob = keys.find(key);
+    if (blob == keys.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (out_value) {
+        if (*length < blob->second.size())
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out_value, blob->second.data(), blob->second.size());
+    }
+    *length = blob->second.size();
+    return ESP_OK;
+}
+
+inline void nvs_close(nvs_handle_t handle)
+{
+    (void)handle;
+}
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef S3DASH_TEST_SDKCONFIG_H
+#define S3DASH_TEST_SDKCONFIG_H
+
+// Host builds target no ESP32 chip, so every CONFIG_IDF_TARGET_* is left undefined and the firmware
+// headers pick their portable code paths.
+
+#endif
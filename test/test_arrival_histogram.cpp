@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "arrival_histogram.h"
+
+namespace
+{
+    /**
+     * Bucket an arrival deltaUs after the previous one of message 0 falls into.
+     */
+    int bucketOf(uint32_t deltaUs, uint32_t firstUs = 1000000)
+    {
+        ArrivalHistograms histograms;
+        histograms.record(0, firstUs);
+        histograms.record(0, firstUs + deltaUs);
+        int found = -1;
+        for (int b = 0; b < ARRIVAL_HISTOGRAM_BUCKETS; b++) {
+            uint32_t count = histograms.getCount(0, b);
+            EXPECT_LE(count, 1u);
+            if (count) {
+                EXPECT_EQ(found, -1) << "delta " << deltaUs << " us counted twice";
+                found = b;
+            }
+        }
+        return found;
+    }
+}
+
+TEST(ArrivalHistograms, BucketsArePowersOfTwoMilliseconds)
+{
+    EXPECT_EQ(bucketOf(0), 0);
+    EXPECT_EQ(bucketOf(999), 0);
+    EXPECT_EQ(bucketOf(1000), 1);
+    EXPECT_EQ(bucketOf(1999), 1);
+    EXPECT_EQ(bucketOf(2000), 2);
+    EXPECT_EQ(bucketOf(3999), 2);
+    EXPECT_EQ(bucketOf(4000), 3);
+    EXPECT_EQ(bucketOf(50000), 6);
+    for (int b = 1; b < ARRIVAL_HISTOGRAM_BUCKETS - 1; b++) {
+        uint32_t lowMs = 1u << (b - 1);
+        EXPECT_EQ(bucketOf(lowMs * 1000), b);
+        EXPECT_EQ(bucketOf(lowMs * 2000 - 1), b);
+    }
+}
+
+TEST(ArrivalHistograms, LastBucketHoldsEverythingLonger)
+{
+    uint32_t lastMs = 1u << (ARRIVAL_HISTOGRAM_BUCKETS - 2);
+    EXPECT_EQ(bucketOf(lastMs * 1000 - 1), ARRIVAL_HISTOGRAM_BUCKETS - 2);
+    EXPECT_EQ(bucketOf(lastMs * 1000), ARRIVAL_HISTOGRAM_BUCKETS - 1);
+    EXPECT_EQ(bucketOf(60000000), ARRIVAL_HISTOGRAM_BUCKETS - 1);
+    EXPECT_EQ(bucketOf(UINT32_MAX), ARRIVAL_HISTOGRAM_BUCKETS - 1);
+}
+
+TEST(ArrivalHistograms, DeltasSpanTheTimestampWrap)
+{
+    // Timestamps are the low 32 bits of esp_timer_get_time.
+    EXPECT_EQ(bucketOf(8192, UINT32_MAX - 4095), 4);
+}
+
+TEST(ArrivalHistograms, CountsEveryFrameButTheFirstPerMessage)
+{
+    ArrivalHistograms histograms;
+    for (int i = 0; i < 10; i++) {
+        histograms.record(0, i * 50000);
+        histograms.record(3, i * 200000);
+    }
+    histograms.record(CAN_SIGNALS_MAX - 1, 0);
+    EXPECT_EQ(histograms.getCount(0, 6), 9u);
+    EXPECT_EQ(histograms.getCount(3, 8), 9u);
+    for (int b = 0; b < ARRIVAL_HISTOGRAM_BUCKETS; b++) {
+        EXPECT_EQ(histograms.getCount(1, b), 0u);
+        EXPECT_EQ(histograms.getCount(CAN_SIGNALS_MAX - 1, b), 0u);
+    }
+}
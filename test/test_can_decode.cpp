@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "can_decode.h"
+#include "old_can_decode.h"
+
+namespace
+{
+    const unsigned MAX_START = 64;
+    const unsigned MAX_LENGTH = 32;
+
+    int64_t signedValue(uint64_t raw, unsigned length, bool isSigned)
+    {
+        if (isSigned && (raw >> (length - 1)) & 1)
+            return static_cast<int64_t>(raw) - (static_cast<int64_t>(1) << length);
+        return static_cast<int64_t>(raw);
+    }
+
+    /**
+     * Next bit of a big endian signal as numbered in DBC files: down within a byte, then on to the
+     * top bit of the next byte.
+     */
+    unsigned nextBigEndianBit(unsigned bit)
+    {
+        return bit % 8 == 0 ? bit + 15 : bit - 1;
+    }
+
+    bool bigEndianFits(unsigned start, unsigned length)
+    {
+        unsigned bit = start;
+        for (unsigned i = 1; i < length; i++)
+            bit = nextBigEndianBit(bit);
+        return bit < 64;
+    }
+
+    /**
+     * A big endian signal read bit by bit, most significant first.
+     */
+    int64_t bigEndianReference(const uint8_t *payload, unsigned start, unsigned length, bool isSigned)
+    {
+        uint64_t raw = 0;
+        unsigned bit = start;
+        for (unsigned i = 0; i < length; i++, bit = nextBigEndianBit(bit))
+            raw = raw << 1 | ((payload[bit / 8] >> (bit % 8)) & 1);
+        return signedValue(raw, length, isSigned);
+    }
+
+    bool fits(unsigned start, unsigned length, bool bigEndian)
+    {
+        return bigEndian ? CanDecode::bigEndianShift(start, length) >= 0 : start + length <= 64;
+    }
+
+    typedef int64_t (*extract_t)(uint64_t bits);
+
+    // CanDecode::extract instantiated for every start and length, null where the signal does not fit.
+    template<unsigned Start, unsigned Length, bool BigEndian, bool Signed>
+    constexpr extract_t extractor()
+    {
+        if constexpr (BigEndian ? CanDecode::bigEndianShift(Start, Length) >= 0 : Start + Length <= 64)
+            return &CanDecode::extract<Start, Length, BigEndian, Signed>;
+        else
+            return nullptr;
+    }
+
+    template<bool BigEndian, bool Signed, size_t... I>
+    constexpr std::array<extract_t, sizeof...(I)> extractors(std::index_sequence<I...>)
+    {
+        return {extractor<I / MAX_LENGTH, I % MAX_LENGTH + 1, BigEndian, Signed>()...};
+    }
+
+    typedef std::make_index_sequence<MAX_START * MAX_LENGTH> every_signal_t;
+
+    // Indexed by big endian and signed, then by start * MAX_LENGTH + length - 1.
+    const std::array<extract_t, MAX_START * MAX_LENGTH> EXTRACTORS[2][2] = {
+        {extractors<false, false>(every_signal_t()), extractors<false, true>(every_signal_t())},
+        {extractors<true, false>(every_signal_t()), extractors<true, true>(every_signal_t())},
+    };
+
+    /**
+     * Payloads with a single bit set, with a single bit clear, and random ones.
+     */
+    std::vector<std::array<uint8_t, 8>> payloads()
+    {
+        std::vector<std::array<uint8_t, 8>> all;
+        for (int bit = 0; bit < 64; bit++) {
+            std::array<uint8_t, 8> set = {}, clear;
+            set[bit / 8] = 1 << (bit % 8);
+            for (int i = 0; i < 8; i++)
+                clear[i] = ~set[i];
+            all.push_back(set);
+            all.push_back(clear);
+        }
+        std::mt19937 random(19);
+        for (int i = 0; i < 64; i++) {
+            std::array<uint8_t, 8> payload;
+            for (uint8_t &byte : payload)
+                byte = random();
+            all.push_back(payload);
+        }
+        return all;
+    }
+
+    /**
+     * A signal through the templates and through the runtime functions CanSignalTable uses.
+     */
+    void expectDecodes(const std::array<uint8_t, 8> &payload, unsigned start, unsigned length, bool bigEndian,
+                       bool isSigned, int64_t expected)
+    {
+        uint64_t bits = CanDecode::load(payload.data());
+        extract_t extract = EXTRACTORS[bigEndian][isSigned][start * MAX_LENGTH + length - 1];
+        ASSERT_NE(extract, nullptr);
+        EXPECT_EQ(extract(bits), expected) << "start " << start << " length " << length;
+
+        uint64_t word = bigEndian ? CanDecode::swap(bits) : bits;
+        unsigned shift = bigEndian ? CanDecode::bigEndianShift(start, length) : start;
+        uint64_t raw = CanDecode::field(word, shift, length);
+        EXPECT_EQ(CanDecode::signExtend(raw, CanDecode::signBit(length, isSigned)), expected)
+            << "start " << start << " length " << length;
+    }
+}
+
+TEST(CanDecode, LittleEndianMatchesTheOldDecode)
+{
+    for (std::array<uint8_t, 8> payload : payloads()) {
+        for (unsigned start = 0; start < MAX_START; start++) {
+            for (unsigned length = 1; length <= MAX_LENGTH && start + length <= 64; length++) {
+                // bitsToUIntLe did not mask fields starting and ending in the same byte below its
+                // top bit, returning the bits above them too.
+                uint64_t mask = (static_cast<uint64_t>(1) << length) - 1;
+                uint64_t raw = OldCanDecode::bitsToUIntLe(payload.data(), start, length) & mask;
+                for (bool isSigned : {false, true})
+                    expectDecodes(payload, start, length, false, isSigned, signedValue(raw, length, isSigned));
+            }
+        }
+    }
+}
+
+TEST(CanDecode, BigEndianMatchesTheDbcBitOrder)
+{
+    for (std::array<uint8_t, 8> payload : payloads()) {
+        for (unsigned start = 0; start < MAX_START; start++) {
+            for (unsigned length = 1; length <= MAX_LENGTH; length++) {
+                if (!bigEndianFits(start, length))
+                    continue;
+                for (bool isSigned : {false, true})
+                    expectDecodes(payload, start, length, true, isSigned,
+                                  bigEndianReference(payload.data(), start, length, isSigned));
+            }
+        }
+    }
+}
+
+TEST(CanDecode, SignalsPastThePayloadDoNotFit)
+{
+    for (unsigned start = 0; start < MAX_START; start++) {
+        for (unsigned length = 1; length <= MAX_LENGTH; length++) {
+            EXPECT_EQ(fits(start, length, true), bigEndianFits(start, length)) << "start " << start << " length " << length;
+            for (bool bigEndian : {false, true}) {
+                for (bool isSigned : {false, true})
+                    EXPECT_EQ(EXTRACTORS[bigEndian][isSigned][start * MAX_LENGTH + length - 1] != nullptr,
+                              fits(start, length, bigEndian));
+            }
+        }
+    }
+}
+
+TEST(CanDecode, SteeringMatchesTheOldDecode)
+{
+    // Steering as generated from s3dash.dbc: 16 bits from bit 16, little endian and signed, over 10.
+    std::mt19937 random(19);
+    dash_data_atomic_t old = {};
+    for (uint32_t steering = 0; steering <= 0xFFFF; steering++) {
+        alignas(8) uint8_t payload[8];
+        for (uint8_t &byte : payload)
+            byte = random();
+        payload[2] = steering;
+        payload[3] = steering >> 8;
+        OldCanDecode::decode(0x138, payload, old);
+        uint64_t bits = CanDecode::load(payload);
+        ASSERT_EQ((CanDecode::scale<1, 10, 0>(CanDecode::extract<16, 16, false, true>(bits))), old.steering.load())
+            << "steering 0x" << std::hex << steering;
+    }
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+#include <random>
+#include <vector>
+
+#include "can_dbc.h"
+#include "can_signals.h"
+#include "nvs.h"
+
+static const int BUILT_IN_COUNT = sizeof(CanDbc::SIGNALS) / sizeof(CanDbc::SIGNALS[0]);
+
+/**
+ * The blob tools/dbc_codegen.py writes for s3dash.dbc, as it would be stored in NVS.
+ */
+static std::vector<uint8_t> readBlob()
+{
+    std::vector<uint8_t> blob;
+    FILE *file = fopen(CAN_SIGNALS_TEST_BLOB, "rb");
+    if (!file)
+        return blob;
+    int c;
+    while ((c = fgetc(file)) != EOF)
+        blob.push_back(c);
+    fclose(file);
+    return blob;
+}
+
+class CanSignalsTest : public testing::Test
+{
+protected:
+    dash_data_atomic_t dashData = {};
+    CanSignalTable table;
+
+    void SetUp() override
+    {
+        FakeNvs::clear();
+    }
+};
+
+TEST_F(CanSignalsTest, BlobMatchesTheBuiltInTable)
+{
+    std::vector<uint8_t> blob = readBlob();
+    ASSERT_EQ(blob.size(), sizeof(CanDbc::SIGNALS));
+    EXPECT_EQ(memcmp(blob.data(), CanDbc::SIGNALS, blob.size()), 0);
+}
+
+TEST_F(CanSignalsTest, LoadsTheBlobFromNvs)
+{
+    // Without the last message, to tell the table loaded apart from the built in one.
+    std::vector<uint8_t> blob = readBlob();
+    uint32_t lastId = CanDbc::SIGNALS[BUILT_IN_COUNT - 1].canId;
+    int count = BUILT_IN_COUNT;
+    while (CanDbc::SIGNALS[count - 1].canId == lastId)
+        count--;
+    FakeNvs::setBlob(CAN_SIGNALS_NVS_NAMESPACE, CAN_SIGNALS_NVS_KEY, blob.data(), count * sizeof(can_signal_t));
+
+    EXPECT_TRUE(table.load(&dashData));
+    EXPECT_EQ(table.find(lastId), nullptr);
+    EXPECT_NE(table.find(CanDbc::SIGNALS[0].canId), nullptr);
+}
+
+TEST_F(CanSignalsTest, FallsBackToTheBuiltInTable)
+{
+    EXPECT_FALSE(table.load(&dashData));
+    for (const can_signal_t &signal : CanDbc::SIGNALS)
+        EXPECT_NE(table.find(signal.canId), nullptr);
+
+    // A blob cut short, and one with an unknown dash signal.
+    std::vector<uint8_t> blob = readBlob();
+    FakeNvs::setBlob(CAN_SIGNALS_NVS_NAMESPACE, CAN_SIGNALS_NVS_KEY, blob.data(), blob.size() - 1);
+    testing::internal::CaptureStderr();
+    EXPECT_FALSE(table.load(&dashData));
+    EXPECT_NE(testing::internal::GetCapturedStderr().find("No valid signal table in NVS"), std::string::npos);
+
+    reinterpret_cast<can_signal_t *>(blob.data())->signal = DASH_SIGNAL_COUNT;
+    FakeNvs::setBlob(CAN_SIGNALS_NVS_NAMESPACE, CAN_SIGNALS_NVS_KEY, blob.data(), blob.size());
+    testing::internal::CaptureStderr();
+    EXPECT_FALSE(table.load(&dashData));
+    EXPECT_NE(testing::internal::GetCapturedStderr().find("Invalid signal 0"), std::string::npos);
+    EXPECT_NE(table.find(CanDbc::SIGNALS[BUILT_IN_COUNT - 1].canId), nullptr);
+}
+
+/**
+ * Every field a decode writes, to compare two decodes.
+ */
+static std::vector<uint32_t> fieldsOf(dash_data_atomic_t &data)
+{
+    std::vector<uint32_t> fields;
+    for (int signal = 0; signal < DASH_SIGNAL_COUNT; signal++) {
+        std::atomic<int> *field = DashData::signalField(&data, static_cast<dash_signal_t>(signal));
+        fields.push_back(field->load());
+        fields.push_back(data.updatedUs[signal].load());
+    }
+    return fields;
+}
+
+TEST_F(CanSignalsTest, TableDecodesLikeTheGeneratedDecoders)
+{
+    // Random payloads of every message of s3dash.dbc, and of IDs close to them which neither decodes.
+    // Both number the messages the same way, for the arrival histograms.
+    ASSERT_TRUE(table.setSignals(CanDbc::SIGNALS, BUILT_IN_COUNT, &dashData));
+    dash_data_atomic_t generated = {};
+    std::mt19937 random(18);
+    int mismatches = 0;
+    for (int i = 0; i < 200000; i++) {
+        uint32_t canId = CanDbc::SIGNALS[random() % BUILT_IN_COUNT].canId + (random() % 4 == 0 ? random() % 3 - 1 : 0);
+        uint8_t payload[8];
+        for (uint8_t &byte : payload)
+            byte = random();
+        uint32_t nowUs = random();
+
+        int index = CanDbc::decode(canId, payload, nowUs, &generated);
+        const can_message_t *message = table.find(canId);
+        EXPECT_EQ(index, message ? table.messageIndex(message) : -1) << "CAN ID 0x" << std::hex << canId;
+        if (message)
+            table.decode(message, payload, nowUs);
+        if (fieldsOf(generated) != fieldsOf(dashData) && mismatches++ < 10)
+            ADD_FAILURE() << "CAN ID 0x" << std::hex << canId << " decoded differently";
+    }
+    EXPECT_EQ(mismatches, 0);
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include "conn_params_ladder.h"
+
+TEST(ConnParamsLadder, StartsAtTheShortestInterval)
+{
+    ConnParamsLadder ladder;
+    const conn_params_step_t &first = ladder.restart();
+    EXPECT_EQ(&first, &CONN_PARAMS_LADDER[0]);
+    EXPECT_EQ(ladder.getStep(), 0);
+}
+
+TEST(ConnParamsLadder, FallsBackOneStepPerRejection)
+{
+    ConnParamsLadder ladder;
+    ladder.restart();
+    for (int step = 1; step < CONN_PARAMS_STEPS; step++) {
+        const conn_params_step_t *next = ladder.rejected();
+        ASSERT_EQ(next, &CONN_PARAMS_LADDER[step]);
+        EXPECT_EQ(ladder.getStep(), step);
+    }
+}
+
+TEST(ConnParamsLadder, KeepsTheLastStepOnceEveryStepWasRejected)
+{
+    ConnParamsLadder ladder;
+    ladder.restart();
+    for (int step = 1; step < CONN_PARAMS_STEPS; step++)
+        ladder.rejected();
+    EXPECT_EQ(ladder.rejected(), nullptr);
+    EXPECT_EQ(ladder.rejected(), nullptr);
+    EXPECT_EQ(ladder.getStep(), CONN_PARAMS_STEPS - 1);
+}
+
+TEST(ConnParamsLadder, RestartsOnANewConnection)
+{
+    ConnParamsLadder ladder;
+    ladder.restart();
+    ladder.rejected();
+    ladder.rejected();
+    EXPECT_EQ(&ladder.restart(), &CONN_PARAMS_LADDER[0]);
+    EXPECT_EQ(ladder.getStep(), 0);
+    EXPECT_EQ(ladder.rejected(), &CONN_PARAMS_LADDER[1]);
+}
+
+TEST(ConnParamsLadder, StepsAreValidAndSlowerEachTime)
+{
+    for (int step = 0; step < CONN_PARAMS_STEPS; step++) {
+        const conn_params_step_t &params = CONN_PARAMS_LADDER[step];
+        // Limits of the Bluetooth Core specification: intervals of 7.5 ms to 4 s, a supervision
+        // timeout of 100 ms to 32 s and longer than two connection intervals, with no latency.
+        EXPECT_GE(params.minInterval, 6);
+        EXPECT_LE(params.maxInterval, 3200);
+        EXPECT_LE(params.minInterval, params.maxInterval);
+        EXPECT_GE(params.timeout, 10);
+        EXPECT_LE(params.timeout, 3200);
+        EXPECT_GT(params.timeout * 10 * 100, params.maxInterval * 125 * 2) << "step " << step;
+        if (step > 0) {
+            EXPECT_GE(params.minInterval, CONN_PARAMS_LADDER[step - 1].minInterval);
+            EXPECT_GT(params.maxInterval, CONN_PARAMS_LADDER[step - 1].maxInterval);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "damage.h"
+
+namespace
+{
+    alignas(16) uint16_t frame[LCD_V_RES * LCD_H_RES];
+
+    const tile_mask_t ALL = tile_mask_t().set();
+
+    void fill(int x, int y, int w, int h, uint16_t value)
+    {
+        for (int row = y; row < y + h; row++) {
+            for (int col = x; col < x + w; col++)
+                frame[row * LCD_H_RES + col] = value;
+        }
+    }
+}
+
+TEST(DamageTracker, MergesChangedTilesIntoRectangles)
+{
+    static DamageTracker damage;
+    rect_t rects[DAMAGE_MAX_RECTS];
+    damage.collect(frame, rects, ALL);
+
+    fill(DAMAGE_TILE_W, DAMAGE_TILE_H, DAMAGE_TILE_W * 2, DAMAGE_TILE_H * 3, 0xFFFF);
+    damage.touch(0, 0, LCD_H_RES, LCD_V_RES);
+    ASSERT_EQ(damage.collect(frame, rects, ALL), 1);
+    EXPECT_EQ(rects[0].x, DAMAGE_TILE_W);
+    EXPECT_EQ(rects[0].y, DAMAGE_TILE_H);
+    EXPECT_EQ(rects[0].w, DAMAGE_TILE_W * 2);
+    EXPECT_EQ(rects[0].h, DAMAGE_TILE_H * 3);
+
+    // Redrawing the same pixels is not a change.
+    damage.touch(0, 0, LCD_H_RES, LCD_V_RES);
+    EXPECT_EQ(damage.collect(frame, rects, ALL), 0);
+}
+
+TEST(DamageTracker, HeldBackTilesStayDeferredAcrossBuffers)
+{
+    static DamageTracker damage;
+    rect_t rects[DAMAGE_MAX_RECTS];
+    damage.collect(frame, rects, ALL);
+    damage.select(1);
+    damage.collect(frame, rects, ALL);
+    damage.select(0);
+    EXPECT_FALSE(damage.hasDeferred());
+
+    // A change drawn into buffer 0 is held back by the mask, then drawing moves on to buffer 1,
+    // which has nothing stale of its own.
+    fill(0, 0, DAMAGE_TILE_W, DAMAGE_TILE_H, 0x1234);
+    damage.touch(0, 0, DAMAGE_TILE_W, DAMAGE_TILE_H);
+    tile_mask_t held = damageTilesForRect(0, 0, DAMAGE_TILE_W, DAMAGE_TILE_H);
+    EXPECT_EQ(damage.collect(frame, rects, ~held), 0);
+    damage.select(1);
+    EXPECT_TRUE(damage.hasDeferred());
+
+    // Pushing other tiles does not release it.
+    damage.collect(frame, rects, ~held);
+    EXPECT_TRUE(damage.hasDeferred());
+
+    // Redrawn into buffer 1 and allowed, it is pushed and nothing is deferred anymore.
+    damage.touch(0, 0, DAMAGE_TILE_W, DAMAGE_TILE_H);
+    EXPECT_EQ(damage.collect(frame, rects, held), 1);
+    EXPECT_FALSE(damage.hasDeferred());
+}
+
+TEST(DamageTracker, InvalidateForgetsDeferredTiles)
+{
+    static DamageTracker damage;
+    rect_t rects[DAMAGE_MAX_RECTS];
+    damage.collect(frame, rects, tile_mask_t());
+    EXPECT_TRUE(damage.hasDeferred());
+    damage.invalidate();
+    EXPECT_FALSE(damage.hasDeferred());
+}
+
+TEST(DamageTracker, FindsTilesHoldingAValue)
+{
+    static uint8_t frame8[LCD_V_RES * LCD_H_RES];
+    frame8[5 * LCD_H_RES + 40] = 7;
+    frame8[(LCD_V_RES - 1) * LCD_H_RES + LCD_H_RES - 1] = 7;
+    tile_mask_t expected = damageTilesForRect(40, 5, 1, 1) | damageTilesForRect(LCD_H_RES - 1, LCD_V_RES - 1, 1, 1);
+    EXPECT_EQ(damageTilesWithValue(frame8, 7), expected);
+    EXPECT_TRUE(damageTilesWithValue(frame8, 8).none());
+}
+
+TEST(DamageTracker, ForcedTilesArePushedUnchanged)
+{
+    static DamageTracker damage;
+    rect_t rects[DAMAGE_MAX_RECTS];
+    damage.collect(frame, rects, ALL);
+    damage.select(1);
+    damage.collect(frame, rects, ALL);
+
+    tile_mask_t tiles = damageTilesForRect(DAMAGE_TILE_W * 2, 0, DAMAGE_TILE_W, DAMAGE_TILE_H);
+    damage.force(tiles);
+    // Held back like any other stale tile until allowed.
+    EXPECT_EQ(damage.collect(frame, rects, ~tiles), 0);
+    EXPECT_TRUE(damage.hasDeferred());
+    ASSERT_EQ(damage.collect(frame, rects, ALL), 1);
+    EXPECT_EQ(rects[0].x, DAMAGE_TILE_W * 2);
+    EXPECT_EQ(rects[0].w, DAMAGE_TILE_W);
+    // Once.
+    damage.select(0);
+    EXPECT_EQ(damage.collect(frame, rects, ALL), 0);
+}
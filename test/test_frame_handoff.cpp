@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+
+#include "fake_bus.h"
+#include "frame_handoff.h"
+
+namespace
+{
+    const int FRAME_PIXELS = LCD_H_RES * LCD_V_RES;
+
+    alignas(16) uint16_t buffers[2][FRAME_PIXELS];
+    alignas(16) uint8_t buffers8[2][FRAME_PIXELS];
+
+    /**
+     * Pixel of frame n at x, y: a small rectangle moving over a plain background.
+     */
+    uint16_t framePixel(int n, int x, int y)
+    {
+        int left = n * 37 % (LCD_H_RES - 40);
+        int top = n * 13 % (LCD_V_RES - 20);
+        bool inside = x >= left && x < left + 40 && y >= top && y < top + 20;
+        return inside ? 0xF800 + n : 0x0841;
+    }
+
+    /**
+     * Draw frame n into a full 16 bit framebuffer, touching the whole screen as a redraw would.
+     */
+    void render(uint8_t *buffer, DamageTracker &damage, int n)
+    {
+        uint16_t *pixels = reinterpret_cast<uint16_t *>(buffer);
+        for (int y = 0; y < LCD_V_RES; y++) {
+            for (int x = 0; x < LCD_H_RES; x++)
+                pixels[y * LCD_H_RES + x] = framePixel(n, x, y);
+        }
+        damage.touch(0, 0, LCD_H_RES, LCD_V_RES);
+    }
+
+    void expectPanelShows(const FakeBus &bus, int n)
+    {
+        for (int y = 0; y < LCD_V_RES; y++) {
+            for (int x = 0; x < LCD_H_RES; x++)
+                ASSERT_EQ(bus.panel[y][x], framePixel(n, x, y)) << "frame " << n << " at " << x << ", " << y;
+        }
+    }
+
+    const tile_mask_t ALL = tile_mask_t().set();
+}
+
+TEST(FrameHandoff, SingleBufferedPushIsWrittenBeforeReturning)
+{
+    static FakeBus bus;
+    static FrameHandoff handoff;
+    static DamageTracker damage;
+    handoff.attach(buffers[0], nullptr, 16);
+    for (int n = 0; n < 4; n++) {
+        EXPECT_EQ(handoff.getBackBuffer(), reinterpret_cast<uint8_t *>(buffers[0]));
+        render(handoff.getBackBuffer(), damage, n);
+        handoff.push<uint16_t>(&bus, handoff.getBackBuffer(), damage, ALL, nullptr);
+        EXPECT_FALSE(bus.isReading(buffers[0], sizeof(buffers[0])));
+        expectPanelShows(bus, n);
+    }
+    EXPECT_EQ(bus.dmaPushes, 0);
+    EXPECT_EQ(bus.waits, 0);
+}
+
+TEST(FrameHandoff, DoubleBufferedNeverRendersIntoTheBufferInFlight)
+{
+    static FakeBus bus;
+    static FrameHandoff handoff;
+    static DamageTracker damage;
+    handoff.attach(buffers[0], buffers[1], 16);
+    damage.select(handoff.getBackIndex());
+    for (int n = 0; n < 20; n++) {
+        uint8_t *back = handoff.getBackBuffer();
+        ASSERT_FALSE(bus.isReading(back, sizeof(buffers[0]))) << "frame " << n;
+        render(back, damage, n);
+        // Rendering must not have changed what the transfer still running sends.
+        if (n > 0) {
+            static FakeBus finished;
+            finished = bus;
+            finished.waitDMA();
+            expectPanelShows(finished, n - 1);
+        }
+        handoff.push<uint16_t>(&bus, back, damage, ALL, nullptr);
+        EXPECT_NE(handoff.getBackBuffer(), back);
+    }
+    bus.waitDMA();
+    expectPanelShows(bus, 19);
+    EXPECT_EQ(bus.blockingPushes, 0);
+}
+
+TEST(FrameHandoff, UnchangedFramesSendNothing)
+{
+    static FakeBus bus;
+    static FrameHandoff handoff;
+    static DamageTracker damage;
+    handoff.attach(buffers[0], buffers[1], 16);
+    damage.select(handoff.getBackIndex());
+    // Both buffers have to be pushed once before the panel is known to match either.
+    for (int i = 0; i < 2; i++) {
+        render(handoff.getBackBuffer(), damage, 5);
+        handoff.push<uint16_t>(&bus, handoff.getBackBuffer(), damage, ALL, nullptr);
+    }
+    bus.waitDMA();
+    uint32_t bytes = bus.bytes;
+    handoff.resetStats();
+    render(handoff.getBackBuffer(), damage, 5);
+    handoff.push<uint16_t>(&bus, handoff.getBackBuffer(), damage, ALL, nullptr);
+    bus.waitDMA();
+    EXPECT_EQ(bus.bytes, bytes);
+    EXPECT_EQ(handoff.getLastPushRects(), 0u);
+}
+
+TEST(FrameHandoff, EightBitFramesAreExpandedThroughTheLut)
+{
+    static FakeBus bus;
+    static FrameHandoff handoff;
+    static DamageTracker damage;
+    uint16_t lut[256];
+    for (int i = 0; i < 256; i++)
+        lut[i] = i * 0x0101 ^ 0x5A5A;
+    damage.setBitsPerPixel(8);
+    handoff.attach(buffers8[0], buffers8[1], 8);
+    damage.select(handoff.getBackIndex());
+    for (int n = 0; n < 6; n++) {
+        uint8_t *back = handoff.getBackBuffer();
+        for (int i = 0; i < FRAME_PIXELS; i++)
+            back[i] = (i / LCD_H_RES + n) * 7 + i % LCD_H_RES / 32;
+        damage.touch(0, 0, LCD_H_RES, LCD_V_RES);
+        handoff.push<uint16_t>(&bus, back, damage, ALL, lut);
+        bus.waitDMA();
+        for (int i = 0; i < FRAME_PIXELS; i++)
+            ASSERT_EQ(bus.panel[i / LCD_H_RES][i % LCD_H_RES], lut[back[i]]) << "frame " << n << " pixel " << i;
+    }
+}
+
+TEST(FrameHandoff, BandsAreHandedOverOneAfterAnother)
+{
+    const int BAND_HEIGHT = DAMAGE_TILE_H * 2;
+    const int ROW_BYTES = LCD_H_RES * 2;
+    static FakeBus bus;
+    static FrameHandoff handoff;
+    static DamageTracker damage;
+    handoff.attach(buffers[0], buffers[1], 16, BAND_HEIGHT);
+    for (int n = 0; n < 3; n++) {
+        for (int bandY = 0; bandY < LCD_V_RES; bandY += BAND_HEIGHT) {
+            int height = std::min(BAND_HEIGHT, LCD_V_RES - bandY);
+            uint8_t *back = handoff.getBackBuffer();
+            ASSERT_FALSE(bus.isReading(back, BAND_HEIGHT * ROW_BYTES));
+            // Drawn into in screen coordinates, as Sprite::beginBand sets it up.
+            uint16_t *shifted = reinterpret_cast<uint16_t *>(back - bandY * ROW_BYTES);
+            for (int y = bandY; y < bandY + height; y++) {
+                for (int x = 0; x < LCD_H_RES; x++)
+                    shifted[y * LCD_H_RES + x] = framePixel(n, x, y);
+            }
+            damage.touch(0, bandY, LCD_H_RES, height);
+            tile_mask_t band = damageTilesForRect(0, bandY, LCD_H_RES, height);
+            handoff.push<uint16_t>(&bus, reinterpret_cast<uint8_t *>(shifted), damage, band, nullptr);
+        }
+        bus.waitDMA();
+        expectPanelShows(bus, n);
+    }
+}
+
+TEST(FrameHandoff, ChangesHeldBackInOneBufferAreNotForgottenAfterTheSwap)
+{
+    static FakeBus bus;
+    static FrameHandoff handoff;
+    static DamageTracker damage;
+    handoff.attach(buffers[0], buffers[1], 16);
+    damage.select(handoff.getBackIndex());
+    for (int i = 0; i < 2; i++) {
+        render(handoff.getBackBuffer(), damage, 0);
+        handoff.push<uint16_t>(&bus, handoff.getBackBuffer(), damage, ALL, nullptr);
+    }
+    ASSERT_FALSE(damage.hasDeferred());
+
+    // A slow value changes in one buffer, but its tiles are not due.
+    const rect_t value = {160, 80, 24, 10};
+    tile_mask_t slow = damageTilesForRect(value.x, value.y, value.w, value.h);
+    auto drawValue = [&](uint8_t *buffer) {
+        render(buffer, damage, 0);
+        uint16_t *pixels = reinterpret_cast<uint16_t *>(buffer);
+        for (int y = value.y; y < value.y + value.h; y++) {
+            for (int x = value.x; x < value.x + value.w; x++)
+                pixels[y * LCD_H_RES + x] = 0x07E0;
+        }
+    };
+    drawValue(handoff.getBackBuffer());
+    handoff.resetStats();
+    handoff.push<uint16_t>(&bus, handoff.getBackBuffer(), damage, ~slow, nullptr);
+    EXPECT_EQ(handoff.getLastPushRects(), 0u);
+    // The new back buffer has nothing stale, the LCD task still has to wake up for the held back
+    // tiles and push them once due.
+    EXPECT_TRUE(damage.hasDeferred());
+    drawValue(handoff.getBackBuffer());
+    handoff.push<uint16_t>(&bus, handoff.getBackBuffer(), damage, ALL, nullptr);
+    EXPECT_FALSE(damage.hasDeferred());
+    bus.waitDMA();
+    EXPECT_EQ(bus.panel[value.y][value.x], 0x07E0);
+    EXPECT_EQ(bus.panel[value.y + value.h - 1][value.x + value.w - 1], 0x07E0);
+}
+
+TEST(FrameHandoff, LutChangesArePushedWithoutRedrawing)
+{
+    static FakeBus bus;
+    static FrameHandoff handoff;
+    static DamageTracker damage;
+    uint16_t lut[256];
+    for (int i = 0; i < 256; i++)
+        lut[i] = i;
+    damage.setBitsPerPixel(8);
+    handoff.attach(buffers8[0], nullptr, 8);
+    uint8_t *buffer = handoff.getBackBuffer();
+    memset(buffer, 1, FRAME_PIXELS);
+    // The alarm area, in a color of its own.
+    for (int y = 30; y < 60; y++)
+        memset(buffer + y * LCD_H_RES + 100, 4, 50);
+    damage.touch(0, 0, LCD_H_RES, LCD_V_RES);
+    handoff.push<uint16_t>(&bus, buffer, damage, ALL, lut);
+
+    // As Sprite::setThemeColor does it.
+    lut[4] = 0xFFE0;
+    damage.force(damageTilesWithValue(buffer, 4));
+    bus.bytes = 0;
+    handoff.push<uint16_t>(&bus, buffer, damage, ALL, lut);
+    EXPECT_EQ(bus.panel[30][100], 0xFFE0);
+    EXPECT_EQ(bus.panel[59][149], 0xFFE0);
+    EXPECT_EQ(bus.panel[29][100], 1);
+    // Only the tiles of the area are sent again.
+    tile_mask_t area = damageTilesForRect(100, 30, 50, 30);
+    EXPECT_EQ(bus.bytes, area.count() * DAMAGE_TILE_W * DAMAGE_TILE_H * sizeof(uint16_t));
+}
@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "esp_partition.h"
+#include "layout.h"
+
+const lgfx::IFont fonts::DejaVu18 = {};
+const lgfx::IFont fonts::DejaVu12 = {};
+const lgfx::IFont fonts::Font7 = {};
+
+namespace
+{
+    const size_t PARTITION_SIZE = 0x10000;
+
+    std::vector<uint8_t> readFile(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // LAYOUT_TEST_BLOB is built from data/layout.json by tools/layout_tool.py.
+    std::vector<uint8_t> toolBlob()
+    {
+        std::vector<uint8_t> blob = readFile(LAYOUT_TEST_BLOB);
+        EXPECT_EQ(blob.size(), sizeof(layout_blob_header_t) + 7 * sizeof(layout_blob_widget_t));
+        return blob;
+    }
+
+    void flash(const std::vector<uint8_t> &blob)
+    {
+        FakePartition::set(LAYOUT_PARTITION_NAME, LAYOUT_PARTITION_SUBTYPE, blob, PARTITION_SIZE);
+    }
+
+    /**
+     * Run layout_tool.py check on blob.
+     *
+     * @return whether the tool accepts it.
+     */
+    bool toolAccepts(const std::vector<uint8_t> &blob)
+    {
+        std::string path = testing::TempDir() + "layout_test.bin";
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(blob.data()), blob.size());
+        std::string command = std::string(LAYOUT_TEST_PYTHON) + " " + LAYOUT_TEST_TOOL + " check " + path + " > /dev/null 2>&1";
+        return system(command.c_str()) == 0;
+    }
+
+    layout_blob_widget_t *blobWidget(std::vector<uint8_t> &blob, int index)
+    {
+        return reinterpret_cast<layout_blob_widget_t *>(blob.data() + sizeof(layout_blob_header_t)) + index;
+    }
+
+    layout_blob_header_t *blobHeader(std::vector<uint8_t> &blob)
+    {
+        return reinterpret_cast<layout_blob_header_t *>(blob.data());
+    }
+
+    /**
+     * Load the flashed layout, returning what it logged.
+     */
+    std::string load(Layout *layout, bool expectLoaded)
+    {
+        testing::internal::CaptureStderr();
+        EXPECT_EQ(layout->load(), expectLoaded);
+        EXPECT_EQ(layout->isLoaded(), expectLoaded);
+        return testing::internal::GetCapturedStderr();
+    }
+}
+
+TEST(Layout, LoadsWhatTheToolBuilds)
+{
+    flash(toolBlob());
+    Layout layout;
+    load(&layout, true);
+    ASSERT_EQ(layout.size(), 7);
+    const layout_widget_t *w = layout.getWidgets();
+
+    EXPECT_EQ(w[0].type, LAYOUT_LABEL);
+    EXPECT_EQ(w[0].signal, DASH_SIGNAL_NONE);
+    EXPECT_EQ(w[0].signalOffset, -1);
+    EXPECT_EQ(w[0].font, &fonts::DejaVu12);
+    EXPECT_FLOAT_EQ(w[0].textSize, 1);
+    EXPECT_EQ(w[0].align, 0);
+    EXPECT_EQ(w[0].x, 2);
+    EXPECT_EQ(w[0].y, 2);
+    EXPECT_EQ(w[0].w, 60);
+    EXPECT_EQ(w[0].h, 14);
+    EXPECT_EQ(w[0].color, 0xFFFF);
+    EXPECT_EQ(w[0].trackColor, 0x4208);
+    EXPECT_EQ(w[0].periodUs, 0);
+    EXPECT_STREQ(w[0].text, "OIL TEMP");
+
+    EXPECT_EQ(w[1].type, LAYOUT_NUMBER);
+    EXPECT_EQ(w[1].signal, DASH_SIGNAL_OIL_TEMP);
+    EXPECT_EQ(w[1].signalOffset, offsetof(dash_data_t, oil_temp));
+    EXPECT_EQ(w[1].font, &fonts::DejaVu18);
+    EXPECT_EQ(w[1].align, 1);
+    EXPECT_EQ(w[1].color, 0xFFE0);
+    EXPECT_EQ(w[1].periodUs, 100000);
+    EXPECT_STREQ(w[1].text, "");
+
+    EXPECT_EQ(w[2].type, LAYOUT_SEGMENT_NUMBER);
+    EXPECT_EQ(w[2].signal, DASH_SIGNAL_RPM);
+    EXPECT_EQ(w[2].font, &fonts::Font7);
+    EXPECT_FLOAT_EQ(w[2].textSize, .55f);
+    EXPECT_EQ(w[2].align, 2);
+    EXPECT_EQ(w[2].periodUs, 1000000 / 30);
+
+    EXPECT_EQ(w[3].type, LAYOUT_BAR);
+    EXPECT_EQ(w[3].signal, DASH_SIGNAL_THROTTLE);
+    EXPECT_EQ(w[3].signalOffset, offsetof(dash_data_t, throttle_per));
+    EXPECT_FALSE(w[3].vertical);
+    EXPECT_EQ(w[3].param, 100);
+    EXPECT_EQ(w[3].color, 0x07E0);
+    EXPECT_EQ(w[3].trackColor, 0x2104);
+    EXPECT_EQ(w[3].x + w[3].w, 320);
+    EXPECT_EQ(w[3].y + w[3].h, 170);
+
+    EXPECT_EQ(w[4].signal, DASH_SIGNAL_BRAKE);
+    EXPECT_TRUE(w[4].vertical);
+    EXPECT_EQ(w[4].color, 0xF800);
+
+    EXPECT_EQ(w[5].type, LAYOUT_SHIFT_LIGHT);
+    EXPECT_EQ(w[5].param, 7200);
+
+    EXPECT_EQ(w[6].signal, DASH_SIGNAL_STEERING);
+    EXPECT_EQ(w[6].signalOffset, offsetof(dash_data_t, steering));
+    EXPECT_FLOAT_EQ(w[6].textSize, 1.5f);
+    EXPECT_STREQ(w[6].text, "STEER");
+
+    dash_data_t data = {};
+    data.steering = -42;
+    EXPECT_EQ(Layout::signalValue(w[6], &data), -42);
+    EXPECT_EQ(Layout::signalValue(w[0], &data), 0);
+}
+
+TEST(Layout, ToolAndFirmwareRejectTheSameWidgets)
+{
+    typedef void (*mutation_t)(layout_blob_widget_t *);
+    const struct {
+        const char *name;
+        bool valid;
+        mutation_t mutate;
+    } cases[] = {
+        {"unchanged", true, [](layout_blob_widget_t *) {}},
+        {"unknown type", false, [](layout_blob_widget_t *w) { w->type = LAYOUT_WIDGET_TYPE_COUNT; }},
+        {"unknown signal", false, [](layout_blob_widget_t *w) { w->signal = DASH_SIGNAL_COUNT; }},
+        {"unbound bar", false, [](layout_blob_widget_t *w) { w->signal = DASH_SIGNAL_NONE; }},
+        {"unbound label", true, [](layout_blob_widget_t *w) { w->type = LAYOUT_LABEL; w->signal = DASH_SIGNAL_NONE; }},
+        {"unknown font", false, [](layout_blob_widget_t *w) { w->font = LAYOUT_FONT_COUNT; }},
+        {"unknown alignment", false, [](layout_blob_widget_t *w) { w->flags = 3; }},
+        {"negative x", false, [](layout_blob_widget_t *w) { w->x = -1; }},
+        {"past the right edge", false, [](layout_blob_widget_t *w) { w->x = 1; }},
+        {"past the bottom edge", false, [](layout_blob_widget_t *w) { w->h = 21; }},
+        {"unterminated text", false, [](layout_blob_widget_t *w) { memset(w->text, 'A', LAYOUT_TEXT_BYTES); }},
+        {"empty bar", false, [](layout_blob_widget_t *w) { w->param = 0; }},
+    };
+    for (const auto &c : cases) {
+        std::vector<uint8_t> blob = toolBlob();
+        // The full width throttle bar.
+        c.mutate(blobWidget(blob, 3));
+        layout_widget_t compiled;
+        EXPECT_EQ(Layout::compileWidget(*blobWidget(blob, 3), &compiled), c.valid) << c.name;
+        EXPECT_EQ(toolAccepts(blob), c.valid) << c.name;
+        flash(blob);
+        Layout layout;
+        load(&layout, c.valid);
+    }
+}
+
+TEST(Layout, BadHeadersLeaveTheBuiltInViews)
+{
+    std::vector<uint8_t> blob = toolBlob();
+    blobHeader(blob)->magic = 0xFFFFFFFF;
+    flash(blob);
+    Layout layout;
+    EXPECT_EQ(load(&layout, false), "");
+
+    blob = toolBlob();
+    blobHeader(blob)->version = LAYOUT_VERSION + 1;
+    flash(blob);
+    EXPECT_NE(load(&layout, false).find("Unsupported layout version 2"), std::string::npos);
+    EXPECT_FALSE(toolAccepts(blob));
+
+    for (uint16_t count : {0, LAYOUT_MAX_WIDGETS + 1}) {
+        blob = toolBlob();
+        blobHeader(blob)->widgetCount = count;
+        flash(blob);
+        std::string log = load(&layout, false);
+        EXPECT_NE(log.find("Invalid layout widget count " + std::to_string(count)), std::string::npos) << log;
+        EXPECT_EQ(log.find("version"), std::string::npos) << log;
+        EXPECT_FALSE(toolAccepts(blob));
+    }
+}
+
+TEST(Layout, ReadErrorsLeaveTheBuiltInViews)
+{
+    const size_t failures[] = {0, sizeof(layout_blob_header_t) + 2 * sizeof(layout_blob_widget_t)};
+    for (size_t offset : failures) {
+        flash(toolBlob());
+        FakePartition::get().failReadsFrom = offset;
+        Layout layout;
+        std::string log = load(&layout, false);
+        EXPECT_NE(log.find("Failed to read layout"), std::string::npos) << log;
+        EXPECT_EQ(layout.size(), 0);
+    }
+
+    FakePartition::get().present = false;
+    Layout layout;
+    load(&layout, false);
+}
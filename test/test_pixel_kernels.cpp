@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "pixel_kernels.h"
+
+namespace
+{
+    // Room for every head alignment in front of the longest span, and guard bytes after it.
+    const size_t MAX_COUNT = 96;
+    const size_t GUARD = 32;
+    const size_t BUFFER_BYTES = 16 + MAX_COUNT * 2 + GUARD;
+
+    struct alignas(16) Buffer
+    {
+        uint8_t bytes[BUFFER_BYTES];
+
+        Buffer(uint8_t seed)
+        {
+            for (size_t i = 0; i < BUFFER_BYTES; i++)
+                bytes[i] = static_cast<uint8_t>(seed + i * 7);
+        }
+    };
+
+    void expectSame(const Buffer &actual, const Buffer &expected, size_t offset, size_t count)
+    {
+        for (size_t i = 0; i < BUFFER_BYTES; i++)
+            ASSERT_EQ(actual.bytes[i], expected.bytes[i]) << "byte " << i << " offset " << offset << " count " << count;
+    }
+}
+
+TEST(PixelKernels, Fill16MatchesReference)
+{
+    for (size_t offset = 0; offset < 16; offset += 2) {
+        for (size_t count = 0; count <= MAX_COUNT; count++) {
+            Buffer actual(1), expected(1);
+            PixelKernels::fill16(reinterpret_cast<uint16_t *>(actual.bytes + offset), 0xA55A, count);
+            for (size_t i = 0; i < count; i++) {
+                expected.bytes[offset + 2 * i] = 0x5A;
+                expected.bytes[offset + 2 * i + 1] = 0xA5;
+            }
+            expectSame(actual, expected, offset, count);
+        }
+    }
+}
+
+TEST(PixelKernels, Fill8MatchesReference)
+{
+    for (size_t offset = 0; offset < 16; offset++) {
+        for (size_t count = 0; count <= MAX_COUNT; count++) {
+            Buffer actual(1), expected(1);
+            PixelKernels::fill8(actual.bytes + offset, 0xC3, count);
+            for (size_t i = 0; i < count; i++)
+                expected.bytes[offset + i] = 0xC3;
+            expectSame(actual, expected, offset, count);
+        }
+    }
+}
+
+TEST(PixelKernels, CopyMatchesReference)
+{
+    Buffer source(100);
+    for (size_t dstOffset = 0; dstOffset < 16; dstOffset++) {
+        for (size_t srcOffset = 0; srcOffset < 16; srcOffset++) {
+            for (size_t count = 0; count <= MAX_COUNT; count++) {
+                Buffer actual(1), expected(1);
+                PixelKernels::copy(actual.bytes + dstOffset, source.bytes + srcOffset, count);
+                for (size_t i = 0; i < count; i++)
+                    expected.bytes[dstOffset + i] = source.bytes[srcOffset + i];
+                expectSame(actual, expected, dstOffset, count);
+            }
+        }
+    }
+}
+
+TEST(PixelKernels, CopySwap16MatchesReference)
+{
+    Buffer source(100);
+    for (size_t dstOffset = 0; dstOffset < 16; dstOffset += 2) {
+        for (size_t srcOffset = 0; srcOffset < 16; srcOffset += 2) {
+            for (size_t count = 0; count <= MAX_COUNT; count++) {
+                Buffer actual(1), expected(1);
+                PixelKernels::copySwap16(reinterpret_cast<uint16_t *>(actual.bytes + dstOffset),
+                                         reinterpret_cast<const uint16_t *>(source.bytes + srcOffset), count);
+                for (size_t i = 0; i < count; i++) {
+                    expected.bytes[dstOffset + 2 * i] = source.bytes[srcOffset + 2 * i + 1];
+                    expected.bytes[dstOffset + 2 * i + 1] = source.bytes[srcOffset + 2 * i];
+                }
+                expectSame(actual, expected, dstOffset, count);
+            }
+        }
+    }
+}
+
+TEST(PixelKernels, RectsOnlyTouchTheRect)
+{
+    const int stride = 40;
+    const int rows = 12;
+    const int rects[][4] = {{0, 0, stride, rows}, {0, 3, stride, 4}, {3, 2, 17, 5}, {39, 0, 1, 12}, {5, 5, 0, 3}};
+    for (const auto &rect : rects) {
+        int x = rect[0], y = rect[1], w = rect[2], h = rect[3];
+        std::vector<uint16_t> pixels(stride * rows, 0x1111), expectedPixels(pixels);
+        std::vector<uint8_t> bytes(stride * rows, 0x22), expectedBytes(bytes);
+        std::vector<uint8_t> copied(stride * rows * 2, 0x33), expectedCopied(copied);
+        std::vector<uint8_t> source(stride * rows * 2);
+        for (size_t i = 0; i < source.size(); i++)
+            source[i] = static_cast<uint8_t>(i);
+        for (int row = y; row < y + h; row++) {
+            for (int col = x; col < x + w; col++) {
+                expectedPixels[row * stride + col] = 0xBEEF;
+                expectedBytes[row * stride + col] = 0x44;
+                expectedCopied[row * stride * 2 + col * 2] = source[row * stride * 2 + col * 2];
+                expectedCopied[row * stride * 2 + col * 2 + 1] = source[row * stride * 2 + col * 2 + 1];
+            }
+        }
+        PixelKernels::fillRect16(pixels.data(), stride, x, y, w, h, 0xBEEF);
+        PixelKernels::fillRect8(bytes.data(), stride, x, y, w, h, 0x44);
+        PixelKernels::copyRect(copied.data(), source.data(), stride * 2, (y * stride + x) * 2, w * 2, h);
+        EXPECT_EQ(pixels, expectedPixels) << x << "," << y << " " << w << "x" << h;
+        EXPECT_EQ(bytes, expectedBytes) << x << "," << y << " " << w << "x" << h;
+        EXPECT_EQ(copied, expectedCopied) << x << "," << y << " " << w << "x" << h;
+    }
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "view_harness.h"
+
+// Steps of the dash data sweep every view is rendered for, and the ones compared against the
+// golden images in test/golden: the bottom of every range, a step with every signal stale and the
+// top of every range.
+#define VIEW_TEST_STEPS 8
+static const int GOLDEN_STEPS[] = {0, 3, VIEW_TEST_STEPS - 1};
+
+namespace
+{
+    ViewHarness harness;
+
+    std::string fileName(const view_case_t &view, int step)
+    {
+        std::string name = view.name;
+        for (char &c : name) {
+            if (c == ' ')
+                c = '_';
+        }
+        return name + "_" + std::to_string(step) + ".ppm";
+    }
+
+    void writeFile(const std::string &path, const std::vector<uint8_t> &bytes)
+    {
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    }
+
+    /**
+     * Compare frame against its golden image, or replace the golden image when
+     * S3DASH_UPDATE_GOLDEN is set. A frame that does not match is written to the build directory.
+     *
+     * @return false if there is no golden image to compare against.
+     */
+    bool expectGolden(const view_case_t &view, int step, const uint8_t *frame)
+    {
+        std::vector<uint8_t> ppm = ViewHarness::toPpm(frame);
+        std::string golden = std::string(VIEW_TEST_GOLDEN_DIR) + "/" + fileName(view, step);
+        if (getenv("S3DASH_UPDATE_GOLDEN")) {
+            writeFile(golden, ppm);
+            return true;
+        }
+        std::ifstream file(golden, std::ios::binary);
+        std::string actual = std::string(VIEW_TEST_OUTPUT_DIR) + "/" + fileName(view, step);
+        if (!file) {
+            writeFile(actual, ppm);
+            return false;
+        }
+        std::vector<uint8_t> expected((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (expected != ppm) {
+            writeFile(actual, ppm);
+            ADD_FAILURE() << view.name << " step " << step << " does not match " << golden << ", see " << actual;
+        }
+        return true;
+    }
+}
+
+class Views : public testing::TestWithParam<int>
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        ASSERT_TRUE(harness.begin(VIEW_TEST_LAYOUT_BLOB));
+    }
+};
+
+TEST_P(Views, MatchTheReferenceAndTheGoldenImages)
+{
+    const view_case_t &view = VIEW_CASES[GetParam()];
+    harness.select(view);
+    int missing = 0;
+    for (int step = 0; step < VIEW_TEST_STEPS; step++) {
+        harness.render(step, VIEW_TEST_STEPS);
+        harness.renderReference();
+        int different = 0;
+        for (int i = 0; i < VIEW_FRAME_BYTES; i += 2)
+            different += memcmp(harness.getFrame() + i, harness.getReferenceFrame() + i, 2) != 0;
+        EXPECT_EQ(different, 0) << view.name << " step " << step << " differs from the reference";
+        for (int golden : GOLDEN_STEPS) {
+            if (golden == step)
+                missing += !expectGolden(view, step, harness.getFrame());
+        }
+    }
+    // Only checked against the reference until the golden images are created, see golden/README.md.
+    if (missing)
+        GTEST_SKIP() << missing << " golden images of " << view.name << " missing from " << VIEW_TEST_GOLDEN_DIR
+                     << ", frames written to " << VIEW_TEST_OUTPUT_DIR << ". Review them and build update_golden_images.";
+}
+
+TEST_P(Views, GiveWayToTheConnectingViewWithoutABackgroundCache)
+{
+    // The connecting view shown when the link drops has to clear the values drawn before it, also
+    // when there is no cached background to restore.
+    const view_case_t &view = VIEW_CASES[GetParam()];
+    const view_case_t &connecting = VIEW_CASES[0];
+    harness.select(connecting);
+    harness.render(3, VIEW_TEST_STEPS);
+    std::vector<uint8_t> expected(harness.getFrame(), harness.getFrame() + VIEW_FRAME_BYTES);
+
+    harness.select(view);
+    harness.render(3, VIEW_TEST_STEPS);
+    harness.setBackgroundCache(false);
+    harness.select(connecting);
+    harness.render(3, VIEW_TEST_STEPS);
+    harness.setBackgroundCache(true);
+    EXPECT_EQ(memcmp(harness.getFrame(), expected.data(), VIEW_FRAME_BYTES), 0) << view.name << " shows through";
+}
+
+INSTANTIATE_TEST_SUITE_P(AllViews, Views, testing::Range(0, VIEW_CASE_COUNT),
+                         [](const testing::TestParamInfo<int> &info) {
+                             std::string name = VIEW_CASES[info.param].name;
+                             for (char &c : name) {
+                                 if (c == ' ')
+                                     c = '_';
+                             }
+                             return name;
+                         });
@@ -0,0 +1,50 @@
+/**
+ * Time every view on the development machine: frames rendered through the LCD sprite the way the
+ * firmware does, and through plain LovyanGFX, over the dash data sweep of the view tests. Absolute
+ * numbers say little about the ESP32-S3, but relative ones show what a change to a view or to the
+ * rendering path costs.
+ *
+ * Usage: view_benchmark [sweeps]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "view_harness.h"
+
+#define VIEW_BENCHMARK_STEPS 32
+
+static ViewHarness harness;
+
+template<typename Fn>
+static double nanosecondsPerFrame(int sweeps, Fn render)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int sweep = 0; sweep < sweeps; sweep++) {
+        for (int step = 0; step < VIEW_BENCHMARK_STEPS; step++)
+            render(step);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (sweeps * VIEW_BENCHMARK_STEPS);
+}
+
+int main(int argc, char **argv)
+{
+    int sweeps = argc > 1 ? atoi(argv[1]) : 20;
+    if (sweeps <= 0 || !harness.begin(VIEW_TEST_LAYOUT_BLOB)) {
+        fprintf(stderr, "usage: %s [sweeps]\n", argv[0]);
+        return 1;
+    }
+    printf("%-16s %14s %14s\n", "view", "ns/frame", "reference");
+    for (const view_case_t &view : VIEW_CASES) {
+        harness.select(view);
+        double sprite = nanosecondsPerFrame(sweeps, [](int step) { harness.render(step, VIEW_BENCHMARK_STEPS); });
+        double reference = nanosecondsPerFrame(sweeps, [](int step) {
+            sweep_dash_data(&harness.state, step, VIEW_BENCHMARK_STEPS);
+            harness.renderReference();
+        });
+        printf("%-16s %14.0f %14.0f\n", view.name, sprite, reference);
+    }
+    return 0;
+}
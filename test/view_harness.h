@@ -0,0 +1,138 @@
+#ifndef S3DASH_TEST_VIEW_HARNESS_H
+#define S3DASH_TEST_VIEW_HARNESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "esp_partition.h"
+#include "glyph_atlas_store.h"
+#include "layout.h"
+#include "pixel_kernels.h"
+#include "sprite.h"
+#include "view_renderer.h"
+
+#define VIEW_FRAME_BYTES (LCD_H_RES * LCD_V_RES * 2)
+
+/**
+ * Renders the views on the host the two ways verify_views does on the device: through a sprite set
+ * up like the LCD sprite, with glyph atlases, the background cache and retained mode, and through a
+ * plain sprite drawing everything through LovyanGFX. The custom layout view shows the layout built
+ * from test/data/layout.json.
+ */
+class ViewHarness
+{
+private:
+    alignas(16) uint8_t framebuffer[VIEW_FRAME_BYTES];
+    alignas(16) uint8_t background[VIEW_FRAME_BYTES];
+    alignas(16) uint8_t referenceFrame[VIEW_FRAME_BYTES];
+    DisplayList displayLists[3];
+    GlyphAtlas atlases[GLYPH_ATLAS_COUNT];
+    Layout layout;
+
+public:
+    Sprite sprite;
+    Sprite reference;
+    render_state_t state = {};
+
+    /**
+     * @return false if the glyph atlases or the layout could not be built.
+     */
+    bool begin(const char *layoutBlob)
+    {
+        sprite.setFrameBuffers(framebuffer, nullptr, 16);
+        sprite.setBackgroundBuffer(background);
+        sprite.setDisplayLists(displayLists);
+        for (int i = 0; i < GLYPH_ATLAS_COUNT; i++) {
+            const glyph_atlas_spec_t &spec = GLYPH_ATLAS_SPECS[i];
+            if (!atlases[i].build(spec.font, spec.size, spec.charset))
+                return false;
+            sprite.addGlyphAtlas(&atlases[i]);
+        }
+        reference.setFrameBuffers(referenceFrame, nullptr, 16);
+
+        std::ifstream file(layoutBlob, std::ios::binary);
+        std::vector<uint8_t> blob((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        FakePartition::set(LAYOUT_PARTITION_NAME, LAYOUT_PARTITION_SUBTYPE, blob, 0x10000);
+        return layout.load();
+    }
+
+    /**
+     * Show view from now on, drawing its background into the cache.
+     */
+    void select(const view_case_t &view)
+    {
+        state = {};
+        state.displayModeRaw = *reinterpret_cast<const uint32_t *>(&view.mode);
+        state.connected = view.connected;
+        sprite.invalidateDisplayLists();
+        if (sprite.beginBackground()) {
+            render_view(&sprite, state, &layout, nullptr, true);
+            sprite.endBackground();
+        }
+    }
+
+    /**
+     * Give the LCD sprite the background cache, or take it away like a failed allocation does.
+     */
+    void setBackgroundCache(bool enabled)
+    {
+        sprite.setBackgroundBuffer(enabled ? background : nullptr);
+    }
+
+    /**
+     * Render step of a sweep of steps through the LCD sprite.
+     */
+    void render(int step, int steps)
+    {
+        sweep_dash_data(&state, step, steps);
+        render_frame(&sprite, state, &layout);
+    }
+
+    /**
+     * Render the current state through the reference sprite.
+     */
+    void renderReference()
+    {
+        reference.startWrite();
+        render_view(&reference, state, &layout, nullptr);
+        reference.endWrite();
+    }
+
+    const uint8_t *getFrame() const
+    {
+        return framebuffer;
+    }
+
+    const uint8_t *getReferenceFrame() const
+    {
+        return referenceFrame;
+    }
+
+    /**
+     * Encode a frame as a binary PPM image, 8 bits per channel.
+     */
+    static std::vector<uint8_t> toPpm(const uint8_t *frame)
+    {
+        // Framebuffers hold byte swapped RGB565.
+        static uint16_t pixels[LCD_H_RES * LCD_V_RES];
+        PixelKernels::copySwap16(pixels, reinterpret_cast<const uint16_t *>(frame), LCD_H_RES * LCD_V_RES);
+        char header[32];
+        int headerBytes = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", LCD_H_RES, LCD_V_RES);
+        std::vector<uint8_t> ppm(header, header + headerBytes);
+        ppm.reserve(headerBytes + LCD_H_RES * LCD_V_RES * 3);
+        for (uint16_t pixel : pixels) {
+            ppm.push_back((pixel >> 11) * 255 / 31);
+            ppm.push_back((pixel >> 5 & 0x3F) * 255 / 63);
+            ppm.push_back((pixel & 0x1F) * 255 / 31);
+        }
+        return ppm;
+    }
+};
+
+#endif
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+"""Generate the CAN decode header from a DBC file.
+
+Every message gets an inline decode function whose bit offsets, lengths, endianness and scales are
+template parameters of main/can_decode.h, so the compiler turns each signal into constant shifts and
+multiplies. A switch over the CAN IDs dispatches to them. The signals are also emitted as a
+can_signal_t table, the built in signal table of main/can_signals.cpp and the bridge filters come
+from it.
+
+Only signals named after a dash signal are decoded, the others are listed as skipped in the header.
+
+    dbc_codegen.py main/s3dash.dbc can_dbc.h
+
+The firmware build runs it, see main/CMakeLists.txt.
+
+The same table can be written as the can_signal_t blob CanSignalTable::load reads from NVS, to
+decode the CAN messages of another car without rebuilding the firmware, along with a CSV for the
+NVS partition generator of ESP-IDF:
+
+    dbc_codegen.py other.dbc --blob can_signals.bin --nvs-csv nvs.csv
+    nvs_partition_gen.py generate nvs.csv nvs.bin 0x6000
+    parttool.py write_partition --partition-name nvs --input nvs.bin
+"""
+import argparse
+import os
+import re
+import struct
+import sys
+from fractions import Fraction
+
+# Must match dash_signal_t in main/dash_data.h, with the field of dash_data_atomic_t each is stored in.
+SIGNALS = {
+    'rpm': ('DASH_SIGNAL_RPM', 'rpm'),
+    'oil_pressure0': ('DASH_SIGNAL_OIL_PRESSURE0', 'oil_pressure0'),
+    'oil_pressure1': ('DASH_SIGNAL_OIL_PRESSURE1', 'oil_pressure1'),
+    'oil_temp': ('DASH_SIGNAL_OIL_TEMP', 'oil_temp'),
+    'engine_coolant_temp': ('DASH_SIGNAL_ENGINE_COOLANT_TEMP', 'engine_coolant_temp'),
+    'throttle': ('DASH_SIGNAL_THROTTLE', 'throttle_per'),
+    'brake': ('DASH_SIGNAL_BRAKE', 'brake_per'),
+    'steering': ('DASH_SIGNAL_STEERING', 'steering'),
+}
+CAN_SIGNALS_MAX = 32
+CAN_SIGNAL_BIG_ENDIAN = 0x01
+CAN_SIGNAL_SIGNED = 0x02
+# Where CanSignalTable::load looks for the blob, see main/can_signals.h.
+NVS_NAMESPACE = 'storage'
+NVS_KEY = 'can_signals'
+DEFAULT_INTERVAL_MS = 50
+MAX_SCALE_DENOMINATOR = 10000
+
+# can_signal_t of main/can_signals.h: CAN ID, start bit, length, flags, dash signal, scale numerator
+# and denominator, offset, interval in ms and a reserved half word, little endian and packed.
+SIGNAL_BLOB = struct.Struct('<IBBBBiiiHH')
+assert SIGNAL_BLOB.size == 24
+SIGNAL_INDEXES = {name: index for index, name in enumerate(SIGNALS)}
+
+MESSAGE_RE = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)')
+SIGNAL_RE = re.compile(r'^SG_\s+(\w+)\s*(M|m\d+)?\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+                       r'\(([^,]+),([^)]+)\)\s*\[([^|]*)\|([^\]]*)\]\s*"([^"]*)"')
+INTERVAL_DEFAULT_RE = re.compile(r'^BA_DEF_DEF_\s+"GenMsgCycleTime"\s+(\d+)\s*;')
+INTERVAL_RE = re.compile(r'^BA_\s+"GenMsgCycleTime"\s+BO_\s+(\d+)\s+(\d+)\s*;')
+
+
+class DbcError(Exception):
+    pass
+
+
+def parse(path):
+    """Return the messages of a DBC file as dicts, in file order, and the default cycle time."""
+    messages = []
+    intervals = {}
+    default_interval = DEFAULT_INTERVAL_MS
+    with open(path, encoding='latin-1') as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            match = MESSAGE_RE.match(line)
+            if match:
+                messages.append({'id': int(match.group(1)), 'name': match.group(2), 'dlc': int(match.group(3)),
+                                 'signals': [], 'skipped': []})
+                continue
+            match = SIGNAL_RE.match(line)
+            if match:
+                if not messages:
+                    raise DbcError('line %d: signal outside of a message' % number)
+                name, mux, start, length, order, sign, factor, offset = match.groups()[:8]
+                message = messages[-1]
+                if name not in SIGNALS:
+                    message['skipped'].append(name)
+                    continue
+                if mux:
+                    raise DbcError('line %d: multiplexed signal %s is not supported' % (number, name))
+                message['signals'].append({'name': name, 'start': int(start), 'length': int(length),
+                                           'big_endian': order == '0', 'signed': sign == '-',
+                                           'factor': factor.strip(), 'offset': offset.strip(), 'line': number})
+                continue
+            match = INTERVAL_DEFAULT_RE.match(line)
+            if match:
+                default_interval = int(match.group(1))
+                continue
+            match = INTERVAL_RE.match(line)
+            if match:
+                intervals[int(match.group(1))] = int(match.group(2))
+    for message in messages:
+        message['interval'] = intervals.get(message['id'], default_interval)
+        # Bit 31 flags extended IDs in DBC files.
+        message['id'] &= 0x1FFFFFFF
+    return messages
+
+
+def check_signal(signal):
+    """Apply the checks CanSignalTable::validate applies on the device, and rationalize the scale."""
+    where = 'line %d: signal %s' % (signal['line'], signal['name'])
+    start, length = signal['start'], signal['length']
+    if length < 1 or length > 32:
+        raise DbcError('%s: length %d does not fit in an int' % (where, length))
+    if signal['big_endian']:
+        msb = (7 - start // 8) * 8 + start % 8
+        if start >= 64 or msb + 1 < length:
+            raise DbcError('%s: runs past the end of the payload' % where)
+    elif start + length > 64:
+        raise DbcError('%s: runs past the end of the payload' % where)
+
+    factor = Fraction(signal['factor'])
+    scale = factor.limit_denominator(MAX_SCALE_DENOMINATOR)
+    if abs(scale - factor) > abs(factor) * Fraction(1, 10 ** 9):
+        raise DbcError('%s: no rational scale close to %s' % (where, signal['factor']))
+    offset = Fraction(signal['offset'])
+    if offset.denominator != 1:
+        raise DbcError('%s: offset %s is not an integer' % (where, signal['offset']))
+    if scale == 0 or not -2 ** 31 <= scale.numerator < 2 ** 31 or not -2 ** 31 <= offset < 2 ** 31:
+        raise DbcError('%s: scale or offset out of range' % where)
+    signal['num'], signal['den'], signal['offset'] = scale.numerator, scale.denominator, int(offset)
+
+
+def generate(messages, source):
+    out = []
+    out.append('// Generated by tools/dbc_codegen.py from %s, do not edit.' % source)
+    out.append('#ifndef S3DASH_CAN_DBC_H')
+    out.append('#define S3DASH_CAN_DBC_H')
+    out.append('')
+    out.append('#include "can_decode.h"')
+    out.append('#include "can_signals.h"')
+    out.append('#include "dash_data.h"')
+    out.append('')
+    out.append('namespace CanDbc')
+    out.append('{')
+    for message in messages:
+        out.append('    // %s, every %d ms.%s' % (message['name'], message['interval'],
+                   ' Skipped: %s.' % ', '.join(message['skipped']) if message['skipped'] else ''))
+        out.append('    inline void decode_0x%x(uint64_t bits, uint32_t nowUs, dash_data_atomic_t *dst)' % message['id'])
+        out.append('    {')
+        for s in message['signals']:
+            value = 'CanDecode::scale<%d, %d, %d>(CanDecode::extract<%d, %d, %s, %s>(bits))' % (
+                s['num'], s['den'], s['offset'], s['start'], s['length'],
+                'true' if s['big_endian'] else 'false', 'true' if s['signed'] else 'false')
+            out.append('        dst->%s.store(%s, std::memory_order_relaxed);' % (SIGNALS[s['name']][1], value))
+            out.append('        dst->updatedUs[%s].store(nowUs, std::memory_order_relaxed);' % SIGNALS[s['name']][0])
+        out.append('    }')
+        out.append('')
+    out.append('    /**')
+    out.append('     * Decode a message of %s from its 8 byte payload into the dash data, stamped with' % source)
+    out.append('     * nowUs, between DashData::beginWrite and DashData::endWrite.')
+    out.append('     *')
+    out.append('     * @return the index of the message in CanSignalTable set to SIGNALS, which numbers messages by')
+    out.append('     * ascending CAN ID, or -1 if the message is not in %s.' % source)
+    out.append('     */')
+    out.append('    inline int decode(uint32_t canId, const uint8_t *payload, uint32_t nowUs, dash_data_atomic_t *dst)')
+    out.append('    {')
+    out.append('        switch (canId) {')
+    ids = sorted(m['id'] for m in messages)
+    for message in messages:
+        out.append('        case 0x%x: decode_0x%x(CanDecode::load(payload), nowUs, dst); return %d;'
+                   % (message['id'], message['id'], ids.index(message['id'])))
+    out.append('        default: return -1;')
+    out.append('        }')
+    out.append('    }')
+    out.append('')
+    out.append('    // The same signals for CanSignalTable.')
+    out.append('    inline constexpr can_signal_t SIGNALS[] = {')
+    for message in messages:
+        for s in message['signals']:
+            flags = []
+            if s['big_endian']:
+                flags.append('CAN_SIGNAL_BIG_ENDIAN')
+            if s['signed']:
+                flags.append('CAN_SIGNAL_SIGNED')
+            out.append('        { 0x%x, %d, %d, %s, %s, %d, %d, %d, %d, 0 },'
+                       % (message['id'], s['start'], s['length'], ' | '.join(flags) or '0',
+                          SIGNALS[s['name']][0], s['num'], s['den'], s['offset'], message['interval']))
+    out.append('    };')
+    out.append('}')
+    out.append('')
+    out.append('#endif')
+    return '\n'.join(out) + '\n'
+
+
+def generate_blob(messages):
+    """Pack the signals as the array of can_signal_t stored in NVS, in the order of the header table."""
+    blob = b''
+    for message in messages:
+        for s in message['signals']:
+            flags = (CAN_SIGNAL_BIG_ENDIAN if s['big_endian'] else 0) | (CAN_SIGNAL_SIGNED if s['signed'] else 0)
+            blob += SIGNAL_BLOB.pack(message['id'], s['start'], s['length'], flags, SIGNAL_INDEXES[s['name']],
+                                     s['num'], s['den'], s['offset'], message['interval'], 0)
+    return blob
+
+
+def generate_nvs_csv(blob_path):
+    """List the blob in a CSV for nvs_partition_gen.py, under the namespace and key the firmware reads."""
+    return 'key,type,encoding,value\n%s,namespace,,\n%s,file,binary,%s\n' % (
+        NVS_NAMESPACE, NVS_KEY, os.path.abspath(blob_path))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('dbc')
+    parser.add_argument('header', nargs='?', help='decode header to generate')
+    parser.add_argument('--blob', help='can_signal_t blob to write, for the NVS signal table')
+    parser.add_argument('--nvs-csv', help='nvs_partition_gen.py CSV to write, storing the blob')
+    args = parser.parse_args()
+    if not args.header and not args.blob:
+        parser.error('nothing to generate, give a header or --blob')
+    if args.nvs_csv and not args.blob:
+        parser.error('--nvs-csv needs --blob')
+
+    try:
+        messages = [m for m in parse(args.dbc) if m['signals']]
+        for message in messages:
+            if message['dlc'] > 8:
+                raise DbcError('message %s: CAN FD payloads are not supported' % message['name'])
+            if not 0 < message['interval'] < 65536:
+                raise DbcError('message %s: cycle time %d out of range' % (message['name'], message['interval']))
+            for signal in message['signals']:
+                check_signal(signal)
+        count = sum(len(m['signals']) for m in messages)
+        if count == 0 or count > CAN_SIGNALS_MAX:
+            raise DbcError('%d dash signals, between 1 and %d are supported' % (count, CAN_SIGNALS_MAX))
+        ids = [m['id'] for m in messages]
+        if len(set(ids)) != len(ids):
+            raise DbcError('duplicate message IDs')
+    except DbcError as e:
+        print('%s: %s' % (args.dbc, e), file=sys.stderr)
+        return 1
+
+    if args.blob:
+        with open(args.blob, 'wb') as f:
+            f.write(generate_blob(messages))
+    if args.nvs_csv:
+        with open(args.nvs_csv, 'w') as f:
+            f.write(generate_nvs_csv(args.blob))
+    if not args.header:
+        return 0
+
+    header = generate(messages, os.path.basename(args.dbc))
+    # Leave the header alone when unchanged, so its includers are not rebuilt.
+    try:
+        with open(args.header) as f:
+            if f.read() == header:
+                return 0
+    except OSError:
+        pass
+    with open(args.header, 'w') as f:
+        f.write(header)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
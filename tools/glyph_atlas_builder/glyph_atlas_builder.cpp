@@ -0,0 +1,57 @@
+/**
+ * Rasterize the glyph atlases of GLYPH_ATLAS_SPECS with the same LovyanGFX the firmware uses, and
+ * write them in the format loadGlyphAtlases reads from the glyphs partition:
+ *
+ *   glyph_atlas_blob_header_t
+ *   per atlas: glyph_atlas_blob_atlas_t, then its spanCount glyph_span_t
+ *
+ * Usage: glyph_atlas_builder <output.bin>
+ */
+#include <stdio.h>
+
+#include "glyph_atlas_store.h"
+
+static GlyphAtlas atlases[GLYPH_ATLAS_COUNT];
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <output.bin>\n", argv[0]);
+        return 2;
+    }
+
+    size_t bytes = sizeof(glyph_atlas_blob_header_t);
+    for (int i = 0; i < GLYPH_ATLAS_COUNT; i++) {
+        const glyph_atlas_spec_t &spec = GLYPH_ATLAS_SPECS[i];
+        if (!atlases[i].build(spec.font, spec.size, spec.charset)) {
+            fprintf(stderr, "Failed to build the atlas of %s at size %.2f\n", spec.name, spec.size);
+            return 1;
+        }
+        bytes += sizeof(glyph_atlas_blob_atlas_t) + atlases[i].getSpanCount() * sizeof(glyph_span_t);
+    }
+    if (bytes > GLYPH_ATLAS_PARTITION_SIZE) {
+        fprintf(stderr, "Glyph atlases take %zu bytes, the partition holds %d\n", bytes, GLYPH_ATLAS_PARTITION_SIZE);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[1], "wb");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+    glyph_atlas_blob_header_t header = {GLYPH_ATLAS_MAGIC, GLYPH_ATLAS_VERSION, GLYPH_ATLAS_COUNT, glyphAtlasSpecHash()};
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+    for (int i = 0; written && i < GLYPH_ATLAS_COUNT; i++) {
+        glyph_atlas_blob_atlas_t blob;
+        blob.spanCount = atlases[i].getSpanCount();
+        memcpy(blob.glyphs, atlases[i].getGlyphs(), sizeof(blob.glyphs));
+        written = fwrite(&blob, sizeof(blob), 1, out) == 1
+            && fwrite(atlases[i].getAllSpans(), sizeof(glyph_span_t), blob.spanCount, out) == blob.spanCount;
+    }
+    if (fclose(out) != 0 || !written) {
+        perror(argv[1]);
+        return 1;
+    }
+    printf("Wrote %d glyph atlases, %zu bytes\n", GLYPH_ATLAS_COUNT, bytes);
+    return 0;
+}
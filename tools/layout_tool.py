@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Build and check view layout blobs for the layout partition.
+
+The blob format must match main/layout.h.
+
+    layout_tool.py build layout.json layout.bin
+    layout_tool.py check layout.bin
+    parttool.py write_partition --partition-name layout --input layout.bin
+"""
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = 0x4C443353
+VERSION = 1
+MAX_WIDGETS = 32
+TEXT_BYTES = 16
+LCD_H_RES = 320
+LCD_V_RES = 170
+
+HEADER = struct.Struct('<IHH')
+WIDGET = struct.Struct('<BBBBhhhhHHHHi%ds' % TEXT_BYTES)
+assert WIDGET.size == 40
+
+TYPES = ['label', 'number', 'segment_number', 'bar', 'shift_light']
+SIGNALS = ['rpm', 'oil_pressure0', 'oil_pressure1', 'oil_temp', 'engine_coolant_temp', 'throttle', 'brake',
+           'steering']
+SIGNAL_NONE = 0xFF
+FONTS = ['dejavu18', 'dejavu12', 'font7']
+ALIGNS = ['left', 'right', 'center']
+FLAG_ALIGN_MASK = 0x03
+FLAG_VERTICAL = 0x04
+
+
+def check_widget(index, type, signal, font, flags, x, y, w, h, param, text):
+    """Apply the checks Layout::compileWidget applies on the device."""
+    errors = []
+    if type >= len(TYPES):
+        errors.append('unknown type %d' % type)
+    if signal >= len(SIGNALS) and (signal != SIGNAL_NONE or type != 0):
+        errors.append('unknown signal %d, only labels can be unbound' % signal)
+    if font >= len(FONTS):
+        errors.append('unknown font %d' % font)
+    if flags & FLAG_ALIGN_MASK > 2:
+        errors.append('unknown alignment %d' % (flags & FLAG_ALIGN_MASK))
+    if x < 0 or y < 0 or w < 0 or h < 0 or x + w > LCD_H_RES or y + h > LCD_V_RES:
+        errors.append('rectangle %d,%d %dx%d outside of the %dx%d screen' % (x, y, w, h, LCD_H_RES, LCD_V_RES))
+    if b'\0' not in text:
+        errors.append('text must be shorter than %d bytes' % TEXT_BYTES)
+    if type == TYPES.index('bar') and param <= 0:
+        errors.append('bars need a positive full scale param')
+    return ['widget %d: %s' % (index, e) for e in errors]
+
+
+def pack_widget(index, widget):
+    type = TYPES.index(widget['type'])
+    signal = SIGNALS.index(widget['signal']) if 'signal' in widget else SIGNAL_NONE
+    font = FONTS.index(widget.get('font', 'dejavu18'))
+    flags = ALIGNS.index(widget.get('align', 'left'))
+    if widget.get('vertical', False):
+        flags |= FLAG_VERTICAL
+    text = widget.get('text', '').encode('ascii')
+    text = text + b'\0' * (TEXT_BYTES - len(text)) if len(text) < TEXT_BYTES else text
+    fields = (type, signal, font, flags, widget['x'], widget['y'], widget.get('w', 0), widget.get('h', 0),
+              round(widget.get('size', 1) * 100), int(str(widget.get('color', 0xFFFF)), 0),
+              int(str(widget.get('track_color', 0x4208)), 0), widget.get('refresh_hz', 0), widget.get('param', 0),
+              text)
+    errors = check_widget(index, type, signal, font, flags, *fields[4:8], fields[12], text)
+    if errors:
+        raise ValueError('\n'.join(errors))
+    return WIDGET.pack(*fields)
+
+
+def build(args):
+    with open(args.input) as f:
+        widgets = json.load(f)['widgets']
+    if not 0 < len(widgets) <= MAX_WIDGETS:
+        sys.exit('a layout needs 1 to %d widgets' % MAX_WIDGETS)
+    try:
+        blob = HEADER.pack(MAGIC, VERSION, len(widgets)) + b''.join(
+            pack_widget(i, w) for i, w in enumerate(widgets))
+    except (ValueError, KeyError) as e:
+        sys.exit('invalid layout: %s' % e)
+    with open(args.output, 'wb') as f:
+        f.write(blob)
+    print('wrote %d widgets, %d bytes' % (len(widgets), len(blob)))
+
+
+def check(args):
+    with open(args.input, 'rb') as f:
+        blob = f.read()
+    if len(blob) < HEADER.size:
+        sys.exit('blob too short')
+    magic, version, count = HEADER.unpack_from(blob)
+    if magic != MAGIC or version != VERSION:
+        sys.exit('not a version %d layout blob' % VERSION)
+    if not 0 < count <= MAX_WIDGETS or HEADER.size + count * WIDGET.size > len(blob):
+        sys.exit('bad widget count %d' % count)
+    errors = []
+    for i in range(count):
+        fields = WIDGET.unpack_from(blob, HEADER.size + i * WIDGET.size)
+        errors += check_widget(i, *fields[0:8], fields[12], fields[13])
+    if errors:
+        sys.exit('\n'.join(errors))
+    print('valid layout with %d widgets' % count)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+    build_parser = commands.add_parser('build', help='build a blob from a JSON layout')
+    build_parser.add_argument('input')
+    build_parser.add_argument('output')
+    build_parser.set_defaults(func=build)
+    check_parser = commands.add_parser('check', help='validate a blob')
+    check_parser.add_argument('input')
+    check_parser.set_defaults(func=check)
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == '__main__':
+    main()